@@ -0,0 +1,64 @@
+#include "bench/bench.h"
+#include "sched/idle.h"
+
+void Benchmarks::runAll() {
+
+    Logger::printFormat("[bench] running kernel microbenchmarks...\n");
+
+    // virtual memory
+    addressSpaceSwitch();
+    largePageMapping();
+    mappingThroughput();
+    temporaryMapping();
+    framebufferBlit();
+
+    // communication
+    ringChannels();
+
+    // data structures
+    containers();
+
+    // synchronization
+    lockContention();
+
+    Logger::printFormat("[bench] all benchmarks finished\n");
+
+}
+
+void Benchmarks::runScheduled() {
+
+    Logger::printFormat("[bench] running scheduler benchmarks...\n");
+
+    // threads
+    scheduling();
+
+    Logger::printFormat("[bench] scheduler benchmarks finished\n");
+
+}
+
+void Benchmarks::serviceSecondaryCore() {
+
+    // run every posted job once
+    static usz seenGenerations[CPU::maxCoreCount];
+    usz core = CPU::getCoreAPICID();
+    usz generation = __atomic_load_n(&jobGeneration, __ATOMIC_ACQUIRE);
+    if(generation == seenGenerations[core]) return;
+    seenGenerations[core] = generation;
+    job(jobData);
+    __atomic_add_fetch(&finishedCores, 1, __ATOMIC_RELEASE);
+
+}
+
+void Benchmarks::runOnAllCores(EventHandler function, void *data) {
+
+    // post the job, run it on this core and wait for all secondary cores
+    job = function;
+    jobData = data;
+    __atomic_store_n(&finishedCores, 0, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&jobGeneration, 1, __ATOMIC_RELEASE);
+    Idle::wakeAll();
+    function(data);
+    usz secondaryCores = BootBoot::getStructure().coreCount - 1;
+    while(__atomic_load_n(&finishedCores, __ATOMIC_ACQUIRE) != secondaryCores) CPU::pause();
+
+}
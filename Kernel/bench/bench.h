@@ -0,0 +1,48 @@
+#pragma once
+#include <driver/arch/cpu.h>
+#include <util/bootboot.h>
+#include <util/logger.h>
+#include <util/types.h>
+
+/**
+ * @brief Class running microbenchmarks of kernel subsystems (built in only with BENCHMARKS=1)
+ */
+class Benchmarks {
+
+public:
+
+    /**
+     * @brief Runs all benchmarks and prints their results using kernel logger
+     */
+    static void runAll();
+
+    /**
+     * @brief Runs benchmarks of the scheduler, called by thread once scheduling runs on all cores
+     */
+    static void runScheduled();
+
+    /**
+     * @brief Runs work posted by benchmarks on all cores, called repeatedly by secondary cores while they wait
+     */
+    static void serviceSecondaryCore();
+
+private:
+
+    static void runOnAllCores(EventHandler function, void *data);
+
+    static void addressSpaceSwitch();
+    static void largePageMapping();
+    static void mappingThroughput();
+    static void temporaryMapping();
+    static void framebufferBlit();
+    static void ringChannels();
+    static void containers();
+    static void lockContention();
+    static void scheduling();
+
+    static inline EventHandler job = nullptr;
+    static inline void *jobData = nullptr;
+    static inline usz jobGeneration = 0;
+    static inline usz finishedCores = 0;
+
+};
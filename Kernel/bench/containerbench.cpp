@@ -0,0 +1,79 @@
+#include "bench/bench.h"
+#include "util/intrusivelist.h"
+#include "util/list.h"
+#include "util/vector.h"
+
+void Benchmarks::containers() {
+
+    static constexpr usz elements = 4096;
+
+    struct Node {
+        u64 value;
+        IntrusiveLink<Node> link;
+    };
+
+    // appending: list allocates node per element, vector grows geometrically, intrusive list only links
+    u64 start = CPU::readTimestampCounter();
+    List<u64> *list = new List<u64>();
+    for(usz i = 0; i < elements; i++) list->appendBack(i);
+    u64 listAppendCycles = (CPU::readTimestampCounter() - start) / elements;
+
+    start = CPU::readTimestampCounter();
+    Vector<u64> *vector = new Vector<u64>();
+    for(usz i = 0; i < elements; i++) vector->appendBack(i);
+    u64 vectorAppendCycles = (CPU::readTimestampCounter() - start) / elements;
+
+    Node *nodes = new Node[elements];
+    IntrusiveList<Node, &Node::link> *intrusiveList = new IntrusiveList<Node, &Node::link>();
+    start = CPU::readTimestampCounter();
+    for(usz i = 0; i < elements; i++) {
+        nodes[i].value = i;
+        intrusiveList->appendBack(&nodes[i]);
+    }
+    u64 intrusiveAppendCycles = (CPU::readTimestampCounter() - start) / elements;
+
+    // indexed loop, as most of the kernel iterated lists (list is sampled, full loop is quadratic)
+    u64 sum = 0;
+    static constexpr usz listSamples = 256;
+    start = CPU::readTimestampCounter();
+    for(usz i = 0; i < listSamples; i++) sum += list->get((i * 16) % elements);
+    u64 listIndexCycles = (CPU::readTimestampCounter() - start) / listSamples;
+
+    start = CPU::readTimestampCounter();
+    for(usz i = 0; i < elements; i++) sum += vector->get(i);
+    u64 vectorIndexCycles = (CPU::readTimestampCounter() - start) / elements;
+
+    // sequential walk
+    start = CPU::readTimestampCounter();
+    list->forEach([&](u64 value) { sum += value; });
+    u64 listWalkCycles = (CPU::readTimestampCounter() - start) / elements;
+
+    start = CPU::readTimestampCounter();
+    vector->forEach([&](u64 value) { sum += value; });
+    u64 vectorWalkCycles = (CPU::readTimestampCounter() - start) / elements;
+
+    start = CPU::readTimestampCounter();
+    intrusiveList->forEach([&](Node *node) { sum += node->value; });
+    u64 intrusiveWalkCycles = (CPU::readTimestampCounter() - start) / elements;
+
+    // removing from the front until empty
+    start = CPU::readTimestampCounter();
+    while(list->size() != 0) list->remove(0);
+    u64 listRemoveCycles = (CPU::readTimestampCounter() - start) / elements;
+
+    start = CPU::readTimestampCounter();
+    while(!intrusiveList->isEmpty()) intrusiveList->removeFront();
+    u64 intrusiveRemoveCycles = (CPU::readTimestampCounter() - start) / elements;
+
+    Logger::printFormat("[bench] containers (%u elements of u64, checksum 0x%x):\n", elements, sum);
+    Logger::printFormat("[bench]   append: List %u, Vector %u, IntrusiveList %u cycles/element\n", listAppendCycles, vectorAppendCycles, intrusiveAppendCycles);
+    Logger::printFormat("[bench]   indexed access: List %u, Vector %u cycles/element\n", listIndexCycles, vectorIndexCycles);
+    Logger::printFormat("[bench]   walk: List %u, Vector %u, IntrusiveList %u cycles/element\n", listWalkCycles, vectorWalkCycles, intrusiveWalkCycles);
+    Logger::printFormat("[bench]   remove front: List %u, IntrusiveList %u cycles/element\n", listRemoveCycles, intrusiveRemoveCycles);
+
+    delete list;
+    delete vector;
+    delete intrusiveList;
+    delete[] nodes;
+
+}
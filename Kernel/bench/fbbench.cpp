@@ -0,0 +1,53 @@
+#include "bench/bench.h"
+#include "driver/arch/hpet.h"
+#include "mem/vas.h"
+#include "util/bootboot.h"
+
+void Benchmarks::framebufferBlit() {
+
+    static constexpr usz rounds = 16;
+
+    // map the framebuffer once more for every compared memory type
+    BootBoot::Structure& bootboot = BootBoot::getStructure();
+    usz framebufferPhysical = bootboot.framebufferPointer - CPU::pagingBase;
+    usz framebufferSize = static_cast<usz>(bootboot.framebufferScanline) * bootboot.framebufferHeight;
+    VirtualAddressSpace *kernelSpace = VirtualAddressSpace::getKernelVirtualAddressSpace();
+    VirtualMemoryObject *uncachedObject = new MMIOVirtualMemoryObject(reinterpret_cast<void*>(framebufferPhysical), framebufferSize);
+    VirtualMemoryObject *combinedObject = new MMIOVirtualMemoryObject(reinterpret_cast<void*>(framebufferPhysical), framebufferSize);
+    combinedObject->setCacheMode(VirtualMemoryObject::CacheMode::WriteCombining);
+    volatile u64 *uncached = reinterpret_cast<volatile u64*>(kernelSpace->mapObject(uncachedObject));
+    volatile u64 *combined = reinterpret_cast<volatile u64*>(kernelSpace->mapObject(combinedObject));
+
+    // copy current screen contents to memory, so blitting them back does not change what is displayed
+    VirtualMemoryObject *bufferObject = new MemoryBackedVirtualMemoryObject(framebufferSize, false, nullptr, true);
+    u64 *buffer = reinterpret_cast<u64*>(kernelSpace->mapObject(bufferObject));
+    usz words = framebufferSize / sizeof(u64);
+    for(usz i = 0; i < words; i++) buffer[i] = uncached[i];
+
+    // blit whole frame repeatedly
+    auto measure = [&](volatile u64 *target) -> u64 {
+
+        u64 start = HPET::getNanoseconds();
+        for(usz i = 0; i < rounds; i++) {
+            for(usz j = 0; j < words; j++) target[j] = buffer[j];
+        }
+        asm volatile("sfence" : : : "memory");
+        u64 nanoseconds = HPET::getNanoseconds() - start;
+        return (nanoseconds != 0) ? (rounds * framebufferSize * 1000000000ull) / (nanoseconds * 1024ull * 1024ull) : 0;
+
+    };
+
+    u64 uncachedRate = measure(uncached);
+    u64 combinedRate = measure(combined);
+
+    Logger::printFormat("[bench] framebuffer blit of %u KiB (PAT programmed: %b):\n", framebufferSize / 1024, CPU::pageAttributeTableEnabled());
+    Logger::printFormat("[bench]   UC-: %u MiB/s, WC: %u MiB/s\n", uncachedRate, combinedRate);
+
+    kernelSpace->unmapObject(const_cast<u64*>(uncached));
+    kernelSpace->unmapObject(const_cast<u64*>(combined));
+    kernelSpace->unmapObject(buffer);
+    uncachedObject->release();
+    combinedObject->release();
+    bufferObject->release();
+
+}
@@ -0,0 +1,72 @@
+#include "bench/bench.h"
+#include "util/spinlock.h"
+
+namespace {
+
+    // lock equivalent to the original spinlock (test-and-set without pause), as a baseline
+    struct TestAndSetLock {
+        bool locked;
+        void lock() {
+            bool expected = false;
+            while(!__atomic_compare_exchange_n(&locked, &expected, true, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) expected = false;
+        }
+        void unlock() { __atomic_store_n(&locked, false, __ATOMIC_RELEASE); }
+    };
+
+    struct ContentionState {
+        usz kind;
+        TestAndSetLock testAndSetLock;
+        RawSpinlock rawLock;
+        Spinlock irqSaveLock;
+        MCSLock mcsLock;
+        alignas(CPU::cacheLineSize) usz counter;
+        alignas(CPU::cacheLineSize) usz startedCores;
+    };
+
+    constexpr usz iterationsPerCore = 100000;
+
+    // states are static, as they are over-aligned
+    ContentionState contentionStates[4] = {};
+
+    void contend(void *data) {
+
+        // wait for all cores, so that they start contending at the same time
+        ContentionState *state = reinterpret_cast<ContentionState*>(data);
+        __atomic_add_fetch(&state->startedCores, 1, __ATOMIC_ACQ_REL);
+        while(__atomic_load_n(&state->startedCores, __ATOMIC_ACQUIRE) != BootBoot::getStructure().coreCount) CPU::pause();
+
+        // take the lock repeatedly with tiny critical section
+        for(usz i = 0; i < iterationsPerCore; i++) {
+            switch(state->kind) {
+                case 0: state->testAndSetLock.lock(); state->counter++; state->testAndSetLock.unlock(); break;
+                case 1: { ScopedRawSpinlock lock(state->rawLock); state->counter++; break; }
+                case 2: { ScopedSpinlock lock(state->irqSaveLock); state->counter++; break; }
+                default: { ScopedMCSLock lock(state->mcsLock, false); state->counter++; break; }
+            }
+        }
+
+    }
+
+}
+
+void Benchmarks::lockContention() {
+
+    static const char *names[] = { "test-and-set", "ticket", "ticket (irqsave)", "MCS" };
+    usz coreCount = BootBoot::getStructure().coreCount;
+    Logger::printFormat("[bench] lock contention (%u cores, %u acquisitions per core):\n", coreCount, iterationsPerCore);
+
+    // run every kind of lock on all cores at once
+    for(usz kind = 0; kind < 4; kind++) {
+
+        ContentionState *state = &contentionStates[kind];
+        state->kind = kind;
+        u64 start = CPU::readTimestampCounter();
+        runOnAllCores(&contend, state);
+        u64 cycles = (CPU::readTimestampCounter() - start) / (iterationsPerCore * coreCount);
+
+        if(state->counter != iterationsPerCore * coreCount) Logger::printFormat("[bench]   %s lock lost updates!\n", names[kind]);
+        Logger::printFormat("[bench]   %s: %u cycles/acquisition\n", names[kind], cycles);
+
+    }
+
+}
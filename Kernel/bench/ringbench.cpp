@@ -0,0 +1,49 @@
+#include "bench/bench.h"
+#include "mem/vas.h"
+#include "util/ring.h"
+
+void Benchmarks::ringChannels() {
+
+    static constexpr usz capacity = 256;
+    static constexpr usz messages = 1024 * 1024;
+    using SPSC = SPSCRing<u64, capacity>;
+    using MPMC = MPMCRing<u64, capacity>;
+
+    // place rings in shared object mapped twice, as two processes would do (rings are over-aligned, so they are not put on heap)
+    VirtualAddressSpace *kernelSpace = VirtualAddressSpace::getKernelVirtualAddressSpace();
+    VirtualMemoryObject *sharedObject = new SharedMemoryVirtualMemoryObject(sizeof(SPSC) + sizeof(MPMC));
+    u8 *producerView = reinterpret_cast<u8*>(kernelSpace->mapObject(sharedObject));
+    u8 *consumerView = reinterpret_cast<u8*>(kernelSpace->mapObject(sharedObject));
+    sharedObject->release();
+
+    // push and pop in batches through different mappings of the same memory
+    auto measure = [&](auto *sendRing, auto *receiveRing) -> u64 {
+
+        u64 start = CPU::readTimestampCounter();
+        u64 sum = 0;
+        for(usz sent = 0; sent < messages; sent += capacity) {
+            for(usz i = 0; i < capacity; i++) sendRing->push(sent + i);
+            u64 value = 0;
+            while(receiveRing->pop(value)) sum += value;
+        }
+        u64 cycles = (CPU::readTimestampCounter() - start) / messages;
+        if(sum != (messages - 1) * messages / 2) Logger::printFormat("[bench]   ring lost messages!\n");
+        return cycles;
+
+    };
+
+    SPSC *spscRing = reinterpret_cast<SPSC*>(producerView);
+    spscRing->initialize();
+    u64 spscCycles = measure(spscRing, reinterpret_cast<SPSC*>(consumerView));
+    MPMC *mpmcRing = reinterpret_cast<MPMC*>(producerView + sizeof(SPSC));
+    mpmcRing->initialize();
+    u64 mpmcCycles = measure(mpmcRing, reinterpret_cast<MPMC*>(consumerView + sizeof(SPSC)));
+
+    Logger::printFormat("[bench] ring channels over shared memory (%u messages, single core):\n", messages);
+    Logger::printFormat("[bench]   SPSC: %u cycles/message, MPMC: %u cycles/message\n", spscCycles, mpmcCycles);
+
+    // last mapping releases the object
+    kernelSpace->unmapObject(producerView);
+    kernelSpace->unmapObject(consumerView);
+
+}
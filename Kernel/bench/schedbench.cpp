@@ -0,0 +1,84 @@
+#include "bench/bench.h"
+#include "sched/scheduler.h"
+
+namespace {
+
+    constexpr usz switchIterations = 10000;
+    constexpr usz totalWorkIterations = 1ull << 28;
+
+    struct SchedulingState {
+        Thread *waiter;
+        usz iterations;
+        usz remainingThreads;
+    };
+
+    SchedulingState schedulingState = {};
+
+    void finishThread(SchedulingState *state) {
+
+        // last finished thread wakes the benchmark up
+        if(__atomic_sub_fetch(&state->remainingThreads, 1, __ATOMIC_ACQ_REL) == 0) Scheduler::wakeUp(state->waiter);
+
+    }
+
+    void pingPong(void *data) {
+
+        // just give the core to the other thread over and over
+        SchedulingState *state = reinterpret_cast<SchedulingState*>(data);
+        for(usz i = 0; i < state->iterations; i++) Scheduler::yield();
+        finishThread(state);
+
+    }
+
+    void work(void *data) {
+
+        // burn fixed count of iterations (volatile, so that the loop is not optimized out)
+        SchedulingState *state = reinterpret_cast<SchedulingState*>(data);
+        volatile usz counter = 0;
+        for(usz i = 0; i < state->iterations; i++) counter = counter + 1;
+        finishThread(state);
+
+    }
+
+    void runThreads(SchedulingState *state, EventHandler function, usz threadCount, usz iterations, i32 affinity) {
+
+        // start threads and sleep until the last one finishes
+        state->waiter = Scheduler::getCurrentThread();
+        state->iterations = iterations;
+        state->remainingThreads = threadCount;
+        for(usz i = 0; i < threadCount; i++) Scheduler::createThread(function, state, "benchmark", affinity);
+        Scheduler::block();
+
+    }
+
+}
+
+void Benchmarks::scheduling() {
+
+    SchedulingState *state = &schedulingState;
+    usz coreCount = BootBoot::getStructure().coreCount;
+
+    // two threads pinned to this core switch to each other (the benchmark itself is blocked meanwhile)
+    u64 start = CPU::readTimestampCounter();
+    runThreads(state, &pingPong, 2, switchIterations, CPU::getCoreAPICID());
+    u64 cycles = (CPU::readTimestampCounter() - start) / (2 * switchIterations);
+    Logger::printFormat("[bench] context switch (yield between two threads): %u cycles\n", cycles);
+
+    // the same amount of work split between more and more threads, all created on this core, so that idle cores
+    // have to steal them
+    Logger::printFormat("[bench] throughput scaling (%u cores, work stealing):\n", coreCount);
+    u64 singleThreadCycles = 0;
+    for(usz threads = 1; threads <= coreCount * 2; threads *= 2) {
+
+        u64 stolenBefore = Scheduler::getStolenCount();
+        start = CPU::readTimestampCounter();
+        runThreads(state, &work, threads, totalWorkIterations / threads, Thread::anyCore);
+        cycles = CPU::readTimestampCounter() - start;
+        if(threads == 1) singleThreadCycles = cycles;
+
+        Logger::printFormat("[bench]   %u threads: %u cycles, speedup x%u.%u, stolen threads: %u\n", threads, cycles,
+            singleThreadCycles / cycles, ((singleThreadCycles * 10) / cycles) % 10, Scheduler::getStolenCount() - stolenBefore);
+
+    }
+
+}
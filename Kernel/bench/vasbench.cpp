@@ -0,0 +1,173 @@
+#include "bench/bench.h"
+#include "driver/arch/hpet.h"
+#include "mem/kmap.h"
+#include "mem/vas.h"
+
+void Benchmarks::addressSpaceSwitch() {
+
+    static constexpr usz iterations = 10000;
+    static constexpr usz kernelPagesTouched = 64;
+
+    // create two spaces, each with single demand paged page
+    VirtualAddressSpace *spaces[2];
+    volatile u64 *userPages[2];
+    for(usz i = 0; i < 2; i++) {
+        spaces[i] = new VirtualAddressSpace();
+        userPages[i] = reinterpret_cast<volatile u64*>(spaces[i]->mapObject(new DemandPagedVirtualMemoryObject(PhysicalAllocator::pageSize, nullptr, true)));
+    }
+
+    // kernel buffer is touched after every switch, as kernel works after switching too
+    VirtualAddressSpace *kernelSpace = VirtualAddressSpace::getKernelVirtualAddressSpace();
+    VirtualMemoryObject *kernelObject = new MemoryBackedVirtualMemoryObject(kernelPagesTouched * PhysicalAllocator::pageSize, true, nullptr, true);
+    volatile u64 *kernelBuffer = reinterpret_cast<volatile u64*>(kernelSpace->mapObject(kernelObject));
+
+    // switch back and forth, optionally emulating switches without PCIDs (flush) and global pages (global flush)
+    auto measure = [&](usz flushType) -> u64 {
+
+        u64 start = CPU::readTimestampCounter();
+        for(usz i = 0; i < iterations; i++) {
+            for(usz j = 0; j < 2; j++) {
+                spaces[j]->activate();
+                if(flushType == 1) CPU::flushTLB();
+                else if(flushType == 2) CPU::flushGlobalTLB();
+                userPages[j][0] = userPages[j][0] + 1;
+                for(usz k = 0; k < kernelPagesTouched; k++) {
+                    volatile u64 *value = &kernelBuffer[k * (PhysicalAllocator::pageSize / sizeof(u64))];
+                    *value = *value + 1;
+                }
+            }
+        }
+        return (CPU::readTimestampCounter() - start) / (iterations * 2);
+
+    };
+
+    // first run commits user pages and warms up caches
+    measure(0);
+    u64 tagged = measure(0);
+    u64 flushed = measure(1);
+    u64 globalFlushed = measure(2);
+    kernelSpace->activate();
+
+    Logger::printFormat("[bench] address space switch + %u kernel page touches (PCIDs used: %b):\n", kernelPagesTouched, CPU::processContextIdentifiersEnabled());
+    Logger::printFormat("[bench]   tagged switch: %u cycles, non-global flush: %u cycles, full flush: %u cycles\n", tagged, flushed, globalFlushed);
+
+    kernelSpace->unmapObject(const_cast<u64*>(kernelBuffer));
+    kernelObject->release();
+
+    // NOTE: spaces are not freed, as address spaces cannot be destroyed yet
+
+}
+
+void Benchmarks::largePageMapping() {
+
+    static constexpr usz objectSize = 64 * 1024 * 1024;
+    static constexpr usz sweeps = 16;
+
+    // map the same amount of memory once using 4KiB pages and once using large pages
+    VirtualAddressSpace *kernelSpace = VirtualAddressSpace::getKernelVirtualAddressSpace();
+    VirtualMemoryObject *smallObject = new MemoryBackedVirtualMemoryObject(objectSize, true, nullptr, true);
+    VirtualMemoryObject *largeObject = new MemoryBackedVirtualMemoryObject(objectSize, false, nullptr, true);
+    volatile u64 *smallPages = reinterpret_cast<volatile u64*>(kernelSpace->mapObject(smallObject));
+    volatile u64 *largePages = reinterpret_cast<volatile u64*>(kernelSpace->mapObject(largeObject));
+
+    // read one word from every 4KiB page, each access needs different TLB entry when using 4KiB pages
+    auto measure = [&](volatile u64 *buffer) -> u64 {
+
+        u64 start = CPU::readTimestampCounter();
+        for(usz i = 0; i < sweeps; i++) {
+            for(usz offset = 0; offset < objectSize; offset += PhysicalAllocator::pageSize) (void)buffer[offset / sizeof(u64)];
+        }
+        u64 cycles = CPU::readTimestampCounter() - start;
+        return cycles / (sweeps * (objectSize / PhysicalAllocator::pageSize));
+
+    };
+
+    // first sweeps warm up caches
+    measure(smallPages);
+    measure(largePages);
+    u64 smallCycles = measure(smallPages);
+    u64 largeCycles = measure(largePages);
+
+    Logger::printFormat("[bench] page-strided reads over %u MiB (1GiB pages supported: %b):\n", objectSize / (1024 * 1024), CPU::supportsHugePages());
+    Logger::printFormat("[bench]   4KiB pages: %u cycles/access, promoted large pages: %u cycles/access\n", smallCycles, largeCycles);
+
+    kernelSpace->unmapObject(const_cast<u64*>(smallPages));
+    kernelSpace->unmapObject(const_cast<u64*>(largePages));
+    smallObject->release();
+    largeObject->release();
+
+}
+
+void Benchmarks::mappingThroughput() {
+
+    static constexpr usz rounds = 8;
+    static constexpr usz smallObjectSize = 64 * 1024 * 1024;
+    static constexpr usz mmioObjectSize = 256 * 1024 * 1024;
+
+    // 4KiB pages object (e.g. scattered buffers) and large MMIO window (e.g. ECAM), which is never accessed
+    VirtualAddressSpace *kernelSpace = VirtualAddressSpace::getKernelVirtualAddressSpace();
+    VirtualMemoryObject *smallObject = new MemoryBackedVirtualMemoryObject(smallObjectSize, true, nullptr, true);
+    VirtualMemoryObject *mmioObject = new MMIOVirtualMemoryObject(reinterpret_cast<void*>(0x100000000ull), mmioObjectSize);
+
+    // map and unmap objects repeatedly
+    auto measure = [&](VirtualMemoryObject *object, usz pageCount) {
+
+        u64 mapNanoseconds = 0, unmapNanoseconds = 0;
+        for(usz i = 0; i < rounds; i++) {
+            u64 start = HPET::getNanoseconds();
+            void *address = kernelSpace->mapObject(object);
+            u64 middle = HPET::getNanoseconds();
+            kernelSpace->unmapObject(address);
+            u64 end = HPET::getNanoseconds();
+            mapNanoseconds += middle - start;
+            unmapNanoseconds += end - middle;
+        }
+
+        u64 mapRate = (mapNanoseconds != 0) ? (rounds * pageCount * 1000000000ull) / mapNanoseconds : 0;
+        u64 unmapRate = (unmapNanoseconds != 0) ? (rounds * pageCount * 1000000000ull) / unmapNanoseconds : 0;
+        Logger::printFormat("[bench]   %u pages: map %u pages/s, unmap %u pages/s\n", pageCount, mapRate, unmapRate);
+
+    };
+
+    Logger::printFormat("[bench] mapping throughput (in 4KiB pages):\n");
+    measure(smallObject, smallObjectSize / PhysicalAllocator::pageSize);
+    measure(mmioObject, mmioObjectSize / PhysicalAllocator::pageSize);
+
+    smallObject->release();
+    mmioObject->release();
+
+}
+
+void Benchmarks::temporaryMapping() {
+
+    static constexpr usz iterations = 10000;
+
+    // map single page, touch it and unmap it again, once through slot and once through full object mapping
+    VirtualAddressSpace *kernelSpace = VirtualAddressSpace::getKernelVirtualAddressSpace();
+    void *page = PhysicalAllocator::allocatePage(kernelPID);
+
+    u64 start = CPU::readTimestampCounter();
+    for(usz i = 0; i < iterations; i++) {
+        volatile u64 *mapped = reinterpret_cast<volatile u64*>(KernelMap::map(page));
+        mapped[0] = mapped[0] + 1;
+        KernelMap::unmap(const_cast<u64*>(mapped));
+    }
+    u64 slotCycles = (CPU::readTimestampCounter() - start) / iterations;
+
+    start = CPU::readTimestampCounter();
+    for(usz i = 0; i < iterations; i++) {
+        VirtualMemoryObject *object = new MMIOVirtualMemoryObject(page, PhysicalAllocator::pageSize);
+        object->setCacheMode(VirtualMemoryObject::CacheMode::WriteBack);
+        volatile u64 *mapped = reinterpret_cast<volatile u64*>(kernelSpace->mapObject(object));
+        mapped[0] = mapped[0] + 1;
+        kernelSpace->unmapObject(const_cast<u64*>(mapped));
+        object->release();
+    }
+    u64 objectCycles = (CPU::readTimestampCounter() - start) / iterations;
+
+    Logger::printFormat("[bench] temporary mapping of single page (map, touch, unmap):\n");
+    Logger::printFormat("[bench]   per-core slot: %u cycles, object mapping: %u cycles\n", slotCycles, objectCycles);
+
+    PhysicalAllocator::freePage(page);
+
+}
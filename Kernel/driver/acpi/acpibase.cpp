@@ -19,8 +19,8 @@ void ACPI::initialize() {
         // TODO: panic! 
     }
 
-    // create table list
-    tables = new List<Table*>;
+    // create table map, it is published when complete
+    HashMap<u32, Table*> *newTables = new HashMap<u32, Table*>();
     Logger::printFormat("[acpibase] XSDT valid, listing all tables...\n");
 
     // list all tables contained in xsdt
@@ -47,8 +47,8 @@ void ACPI::initialize() {
             Logger::printFormat("[acpibase]   - %c%c%c%c at 0x%x\n", header->signature[0], header->signature[1], header->signature[2], header->signature[3], reinterpret_cast<u64>(header));
             printed++;
 
-            // if valid, append it to table list
-            tables->appendBack(header);
+            // if valid, add it to table map (first table of given signature wins, as it did with lookup by scanning)
+            if(!newTables->contains(signatureKey(header->signature))) newTables->insert(signatureKey(header->signature), header);
 
         }
     }
@@ -71,14 +71,17 @@ void ACPI::initialize() {
             Logger::printFormat("[acpibase]   - %c%c%c%c at 0x%x\n", header->signature[0], header->signature[1], header->signature[2], header->signature[3], reinterpret_cast<u64>(header));
             printed++;
 
-            // if valid, append it to table list
-            tables->appendBack(header);
+            // if valid, add it to table map (first table of given signature wins, as it did with lookup by scanning)
+            if(!newTables->contains(signatureKey(header->signature))) newTables->insert(signatureKey(header->signature), header);
 
         }
     }
 
     if(printed == 0) Logger::printFormat("[acpibase] no tables found...\n");
 
+    // publish tables, lookups read them under RCU without locking
+    RCU::assign(tables, newTables);
+
 }
 
 bool ACPI::validate(Table *table) {
@@ -96,22 +99,19 @@ bool ACPI::validate(Table *table) {
 
 ACPI::Table *ACPI::getTableBySignature(const char *signature) {
 
-    // iterate through list
-    for(usz i = 0; i < tables->size(); i++) {
-
-        // get table
-        Table *table = tables->get(i);
-
-        // compare signatures
-        bool good = true;
-        for(int i = 0; i < 4; i++) if(signature[i] != table->signature[i]) good = false;
+    // look the table up by its signature
+    ScopedRCURead read;
+    HashMap<u32, Table*> *currentTables = RCU::dereference(tables);
+    if(currentTables == nullptr) return nullptr;
+    Table **table = currentTables->find(signatureKey(signature));
+    return (table == nullptr) ? nullptr : *table;
 
-        // return if found
-        if(good) return table;
+}
 
-    }
+u32 ACPI::signatureKey(const char *signature) {
 
-    // return nullptr if not found
-    return nullptr;
+    // pack 4 characters of signature into single integer
+    const u8 *bytes = reinterpret_cast<const u8*>(signature);
+    return static_cast<u32>(bytes[0]) | static_cast<u32>(bytes[1]) << 8 | static_cast<u32>(bytes[2]) << 16 | static_cast<u32>(bytes[3]) << 24;
 
 }
\ No newline at end of file
@@ -3,7 +3,8 @@
 #include <util/bootboot.h>
 #include <util/logger.h>
 #include <util/types.h>
-#include <util/list.h>
+#include <util/hashmap.h>
+#include <util/rcu.h>
 
 /**
  * @brief Class for managing ACPI tables exposed by platform firmware
@@ -58,8 +59,9 @@ private:
     } __attribute__((packed));
 
     static inline XSDT *xsdt = nullptr;
-    static inline List<Table*> *tables;
+    static inline HashMap<u32, Table*> *tables = nullptr;
 
     static bool validate(Table *table);
+    static u32 signatureKey(const char *signature);
     
 };
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "driver/ahci/ahcibase.h"
+#include "sched/bootgraph.h"
 
 AHCI::AHCI(PCIDevice *device) {
 
@@ -67,22 +68,32 @@ AHCI::AHCI(PCIDevice *device) {
     // enable AHCI mode and interrupts
     abar->globalHostControl = abar->globalHostControl | (1 << 1) | (1 << 31);
 
-    // setup all ports of HBA
+    // setup all ports of HBA, every port waits for its link on its own, so they are initialized concurrently during boot
     portInformation = new PortInfo[numberOfPorts];
-    drives = new List<PortInfo*>();
+    drives = new Vector<PortInfo*>();
+    PortInitialization *portInitializations = new PortInitialization[numberOfPorts];
     for(u8 i = 0; i < numberOfPorts; i++) {
 
         // check whether port is actually implemented
+        portInitializations[i].ahci = this;
+        portInitializations[i].portNumber = i;
+        portInitializations[i].initialized = false;
+        portInitializations[i].task = BootGraph::noTask;
         if((abar->portsImplemented & (1 << i)) == 0) continue;
         Logger::printFormat("[ahci]   - port %d is implemented, creating memory spaces...\n", i);
 
         // initialize port
-        if(!initializePort(i)) continue;
+        portInitializations[i].task = BootGraph::spawn("ahci port", &AHCI::initializePortTask, &portInitializations[i]);
 
-        // if port initialized successfully add it to the list
-        drives->appendBack(&portInformation[i]);
+    }
+    for(u8 i = 0; i < numberOfPorts; i++) {
+
+        // if port initialized successfully add it to the list (in order of ports)
+        BootGraph::waitFor(portInitializations[i].task);
+        if(portInitializations[i].initialized) drives->appendBack(&portInformation[i]);
 
     }
+    delete[] portInitializations;
 
     // identify devices
     identifyDevices();
@@ -92,8 +103,7 @@ AHCI::AHCI(PCIDevice *device) {
     
     for(usz i = 0; i < drives->size(); i++) {
         PortInfo *port = drives->get(i);
-        AHCIBlockDevice *device = new AHCIBlockDevice(this, port->portNumber);
-        blockDevices->appendBack(device);
+        registerBlockDevice(new AHCIBlockDevice(this, port->portNumber));
     }
 
 }
@@ -105,7 +115,11 @@ usz AHCI::getSectorCount(u8 port) {
     return 0;
 }
 
-bool AHCI::readSectors(u8 port, usz sectorStart, usz sectorCount, VirtualMemoryObject *buffer, EventHandler handler, void *handlerData) {
+usz AHCI::getSectorSize(u8 port) {
+    return portInformation[port].sectorSize;
+}
+
+bool AHCI::readSectors(u8 port, usz sectorStart, usz sectorCount, VirtualMemoryObject *buffer, BlockRequestHandler handler, void *handlerData) {
 
     // just issue a command
     return issueCommand(port, ataCommandReadDMAEx, sectorCount, sectorStart, true, false, buffer, handler, handlerData);
@@ -164,8 +178,12 @@ bool AHCI::initializePort(u8 portNumber) {
 
     }
 
-    // set port number
+    // set port number and work item completing its requests
     portInformation[portNumber].portNumber = portNumber;
+    portInformation[portNumber].completionWork.function = &AHCI::completeRequests;
+    portInformation[portNumber].completionWork.data = &portInformation[portNumber];
+    portInformation[portNumber].completionQueueWork.function = &AHCI::completeRequests;
+    portInformation[portNumber].completionQueueWork.data = &portInformation[portNumber];
 
     // all spaces created, initialize port - fill command list accordingly
     for(usz i = 0; i < numberOfCommandSlots; i++) {
@@ -261,7 +279,7 @@ void AHCI::identifyDevices() {
 
 }
 
-bool AHCI::issueCommand(u8 port, u8 command, u16 transferSectors, usz accessSector, bool mediaAccess, bool write, VirtualMemoryObject *data, EventHandler handler, void *handlerData) {
+bool AHCI::issueCommand(u8 port, u8 command, u16 transferSectors, usz accessSector, bool mediaAccess, bool write, VirtualMemoryObject *data, BlockRequestHandler handler, void *handlerData) {
 
     // lock port's spinlock
     ScopedSpinlock lock(portInformation[port].portSpinlock);
@@ -272,9 +290,20 @@ bool AHCI::issueCommand(u8 port, u8 command, u16 transferSectors, usz accessSect
         return false;
     }
 
-    // check size (max 128 prdt, one page per entry)
+    // check size, every physically contiguous extent of the buffer needs one PRDT entry per 4MiB
     usz sectorSize = portInformation[port].sectorSize;
-    if((transferSectors * sectorSize) > (128 * PhysicalAllocator::pageSize)) return false;
+    usz transferBytes = transferSectors * sectorSize;
+    if(transferBytes > data->objectSize()) return false;
+    usz prdtLength = 0;
+    usz described = 0;
+    data->objectPages()->forEach([&](const Extent& extent) {
+        if(described >= transferBytes) return;
+        usz length = extent.pageCount * extent.pageSize;
+        if(length > transferBytes - described) length = transferBytes - described;
+        prdtLength += (length + (maxPRDByteCount - 1)) / maxPRDByteCount;
+        described += length;
+    });
+    if(prdtLength > maxPRDTLength) return false;
     // TODO: make it smarter (like split into two or more commands maybe?)
 
     // create request
@@ -305,7 +334,6 @@ bool AHCI::issueCommand(u8 port, u8 command, u16 transferSectors, usz accessSect
     volatile CommandHeader *commandSlot = &portInformation[port].commandList[slot];
     commandSlot->commandFISLength = sizeof(CommandFIS) / sizeof(u32);
     commandSlot->write = write;
-    u32 prdtLength = ((transferSectors * sectorSize) + (PhysicalAllocator::pageSize - 1)) / PhysicalAllocator::pageSize;
     commandSlot->prdtLength = prdtLength;
 
     // configure command FIS
@@ -345,14 +373,25 @@ bool AHCI::issueCommand(u8 port, u8 command, u16 transferSectors, usz accessSect
 
     
 
-    // configure command PRDT
-    for(usz i = 0; i < prdtLength; i++) {
-        u64 pageAddress = reinterpret_cast<u64>(data->objectPages()->get(i));
-        commandTable->physicalRegionDescriptorTable[i].byteCount = PhysicalAllocator::pageSize - 1;
-        commandTable->physicalRegionDescriptorTable[i].dataBaseAddress = pageAddress & 0xffffffff;
-        commandTable->physicalRegionDescriptorTable[i].dataBaseAddressUpper = (pageAddress >> 32) & 0xffffffff;
-        commandTable->physicalRegionDescriptorTable[i].interrupt = 1;
-    }
+    // configure command PRDT, extents are split only where single entry cannot describe them
+    usz entry = 0;
+    described = 0;
+    data->objectPages()->forEach([&](const Extent& extent) {
+        usz address = extent.address;
+        usz length = extent.pageCount * extent.pageSize;
+        if(length > transferBytes - described) length = transferBytes - described;
+        while(length > 0) {
+            usz chunk = (length > maxPRDByteCount) ? maxPRDByteCount : length;
+            commandTable->physicalRegionDescriptorTable[entry].byteCount = chunk - 1;
+            commandTable->physicalRegionDescriptorTable[entry].dataBaseAddress = address & 0xffffffff;
+            commandTable->physicalRegionDescriptorTable[entry].dataBaseAddressUpper = (address >> 32) & 0xffffffff;
+            commandTable->physicalRegionDescriptorTable[entry].interrupt = 1;
+            entry++;
+            address += chunk;
+            length -= chunk;
+            described += chunk;
+        }
+    });
 
     // set info
     portInformation[port].currentRequests[slot] = newRequest;
@@ -394,22 +433,26 @@ void AHCI::handleInterrupt() {
         // normal command
         else {
             
-            // TODO: do error checking!
-
-            // fire callbacks of all completed commands
-            for(usz j = 0; j < 32; j++) {
-
-                // command completed
-                if(!(abar->ports[i].commandIssue & (1 << j)) && (portInformation[i].commandsInUse & (1 << j))) {
-
-                    // clear command in use
-                    portInformation[i].commandsInUse &= ~(1 << j);
-
-                    // fire callback
-                    portInformation[i].currentRequests[j].handler(portInformation[i].currentRequests[j].handlerData);
-
-                }
+            // commands which left command issue register finished successfully
+            u32 issued = abar->ports[i].commandIssue;
+            u32 completed = portInformation[i].commandsInUse & ~issued & ~portInformation[i].completedCommands;
+
+            // on error port stops processing commands, so all still issued ones fail (including the failing one)
+            u32 interruptStatus = abar->ports[i].interruptStatus;
+            if(interruptStatus & portErrorInterrupts) {
+                Logger::printFormat("[ahci] error on port %d (interrupt status: 0x%x, task file: 0x%x, sata error: 0x%x), restarting it\n", i, static_cast<u64>(interruptStatus), static_cast<u64>(abar->ports[i].taskFileData), static_cast<u64>(abar->ports[i].sataError));
+                u32 failed = portInformation[i].commandsInUse & issued & ~portInformation[i].completedCommands;
+                portInformation[i].failedCommands |= failed;
+                completed |= failed;
+                restartPort(i);
+            }
 
+            // hand completed commands over to worker thread (so callbacks may block), before workqueues exist to softirq
+            if(completed != 0) {
+                portInformation[i].completedCommands |= completed;
+                Workqueue *queue = Workqueue::getSystemQueue();
+                if(queue != nullptr) queue->queue(portInformation[i].completionQueueWork);
+                else SoftIRQ::schedule(&portInformation[i].completionWork);
             }
 
         }
@@ -425,14 +468,54 @@ void AHCI::handleInterrupt() {
 
 }
 
+void AHCI::restartPort(u8 port) {
+
+    // stop processing commands, controller clears command issue register once command list is not running
+    abar->ports[port].commandAndStatus = abar->ports[port].commandAndStatus & ~portCommandStart;
+    for(usz i = 0; i < portStopSpinCount && (abar->ports[port].commandAndStatus & portCommandListRunning); i++) CPU::pause();
+
+    // clear errors and start the port again
+    abar->ports[port].sataError = 0xffffffff;
+    abar->ports[port].interruptStatus = 0xffffffff;
+    abar->ports[port].commandAndStatus = abar->ports[port].commandAndStatus | portCommandStart;
+
+}
+
+void AHCI::completeRequests(void *portInfo) {
+
+    // take completed requests one by one (so that only single one is copied onto the stack), its slot is free from now on
+    PortInfo *port = reinterpret_cast<PortInfo*>(portInfo);
+    for(;;) {
+        BlockRequestHandler handler = nullptr;
+        void *handlerData = nullptr;
+        bool success = false;
+        {
+            ScopedSpinlock lock(port->portSpinlock);
+            if(port->completedCommands == 0) return;
+            u32 slot = __builtin_ctz(port->completedCommands);
+            u32 bit = 1u << slot;
+            handler = port->currentRequests[slot].handler;
+            handlerData = port->currentRequests[slot].handlerData;
+            success = !(port->failedCommands & bit);
+            port->completedCommands &= ~bit;
+            port->failedCommands &= ~bit;
+            port->commandsInUse &= ~bit;
+        }
+
+        // fire callback without holding the lock, so it may issue new commands
+        handler(handlerData, success);
+    }
+
+}
+
 void AHCI::initialize() {
 
     // create list of all AHCI devices
-    devices = new List<AHCI*>();
-    blockDevices = new List<IBlockDevice*>();
+    devices = new Vector<AHCI*>();
+    RCU::assign(blockDevices, new Vector<IBlockDevice*>());
 
     // find all PCI devices with relevant IDs
-    List<PCIDevice*> *ahciPCIDevices = new List<PCIDevice*>();
+    Vector<PCIDevice*> *ahciPCIDevices = new Vector<PCIDevice*>();
     PCIe::getDevicesByClassCodes(ahciPCIDevices, 0x01, 0x06, 0x01);
 
     // check whether any AHCI devices were found
@@ -442,11 +525,15 @@ void AHCI::initialize() {
     }
     Logger::printFormat("[ahci] AHCI devices count: %u\n", ahciPCIDevices->size());
 
-    // initialize all of found AHCIs
+    // initialize all of found AHCIs, controllers are independent, so they are initialized concurrently during boot
+    ControllerInitialization *initializations = new ControllerInitialization[ahciPCIDevices->size()];
     for(usz i = 0; i < ahciPCIDevices->size(); i++) {
 
         // get accompanied PCI device
         PCIDevice *pciDevice = ahciPCIDevices->get(i);
+        initializations[i].pciDevice = pciDevice;
+        initializations[i].ahci = nullptr;
+        initializations[i].task = BootGraph::noTask;
 
         // check whether AHCI supports MSI
         if(!pciDevice->supportsMSI()) {
@@ -456,18 +543,54 @@ void AHCI::initialize() {
 
         // create AHCI for it
         Logger::printFormat("[ahci] trying to initialize AHCI number %u\n", i);
-        AHCI *ahci = new AHCI(pciDevice);
+        initializations[i].task = BootGraph::spawn("ahci controller", &AHCI::initializeController, &initializations[i]);
+
+    }
+    for(usz i = 0; i < ahciPCIDevices->size(); i++) {
+
+        // keep controllers which were initialized correctly
+        BootGraph::waitFor(initializations[i].task);
+        AHCI *ahci = initializations[i].ahci;
+        if(ahci == nullptr) continue;
         if(ahci->initializedCorrectly()) devices->appendBack(ahci);
         else delete ahci;
 
     }
 
     // destroy the list of found AHCIs
+    delete[] initializations;
     delete ahciPCIDevices;
 
 }
 
-List<IBlockDevice*> *AHCI::getBlockDevices() { return blockDevices; }
+void AHCI::initializeController(void *initialization) {
+
+    ControllerInitialization *controllerInitialization = reinterpret_cast<ControllerInitialization*>(initialization);
+    controllerInitialization->ahci = new AHCI(controllerInitialization->pciDevice);
+
+}
+
+void AHCI::initializePortTask(void *initialization) {
+
+    PortInitialization *portInitialization = reinterpret_cast<PortInitialization*>(initialization);
+    portInitialization->initialized = portInitialization->ahci->initializePort(portInitialization->portNumber);
+
+}
+
+Vector<IBlockDevice*> *AHCI::getBlockDevices() { return RCU::dereference(blockDevices); }
+
+void AHCI::registerBlockDevice(IBlockDevice *device) {
+
+    // copy the list with new device appended, readers may still use the old one until grace period ends
+    ScopedRawSpinlock lock(blockDevicesSpinlock);
+    Vector<IBlockDevice*> *oldBlockDevices = blockDevices;
+    Vector<IBlockDevice*> *newBlockDevices = new Vector<IBlockDevice*>(oldBlockDevices->size() + 1);
+    oldBlockDevices->forEach([&](IBlockDevice *existing) { newBlockDevices->appendBack(existing); });
+    newBlockDevices->appendBack(device);
+    RCU::assign(blockDevices, newBlockDevices);
+    RCU::free(oldBlockDevices);
+
+}
 
 void AHCI::interruptHandler(void *data, u32) {
 
@@ -487,10 +610,14 @@ usz AHCIBlockDevice::sectorCount() {
     return ahci->getSectorCount(port);
 }
 
-bool AHCIBlockDevice::read(usz sector, usz count, VirtualMemoryObject *buffer, EventHandler handler, void *handlerData) {
+usz AHCIBlockDevice::sectorSize() {
+    return ahci->getSectorSize(port);
+}
+
+bool AHCIBlockDevice::read(usz sector, usz count, VirtualMemoryObject *buffer, BlockRequestHandler handler, void *handlerData) {
     return ahci->readSectors(port, sector, count, buffer, handler, handlerData);
 }
 
-bool AHCIBlockDevice::write(usz, usz, VirtualMemoryObject *, EventHandler, void *) {
+bool AHCIBlockDevice::write(usz, usz, VirtualMemoryObject *, BlockRequestHandler, void *) {
     return false;
 }
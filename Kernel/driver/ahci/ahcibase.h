@@ -2,6 +2,10 @@
 #include <driver/bus/pcie/pcie.h>
 #include <driver/iface/blockdevice.h>
 #include <mem/vas.h>
+#include <sched/workqueue.h>
+#include <util/list.h>
+#include <util/rcu.h>
+#include <util/softirq.h>
 #include <util/timer.h>
 #include <util/types.h>
 
@@ -33,17 +37,24 @@ public:
      */
     usz getSectorCount(u8 port);
 
+    /**
+     * @brief Gives information about sector size of device attached at specific port of AHCI device
+     * @param port Number of port (0-31)
+     * @return Sector size of specific device in bytes
+     */
+    usz getSectorSize(u8 port);
+
     /**
      * @brief Reads sectors from specific device
      * @param port Number of port (0-31)
      * @param sectorStart Starting sector of media access
      * @param sectorCount Count of sectors to be read
      * @param buffer Buffer, to which the data will be trasferred
-     * @param handler Callback which is called after reading
+     * @param handler Callback which is called after reading (with result of the read)
      * @param handlerData Data to be passed to callback function
      * @return true if request was successfully sent to device, false otherwise
      */
-    bool readSectors(u8 port, usz sectorStart, usz sectorCount, VirtualMemoryObject *buffer, EventHandler handler, void *handlerData);
+    bool readSectors(u8 port, usz sectorStart, usz sectorCount, VirtualMemoryObject *buffer, BlockRequestHandler handler, void *handlerData);
 
     /**
      * @brief Initialize all AHCI devices found in a system
@@ -52,9 +63,9 @@ public:
 
     /**
      * @brief Returns list of all SATA block devices found in the system in operational state
-     * @return List of IBlockDevice objects representing attached SATA block devices
+     * @return List of IBlockDevice objects representing attached SATA block devices (valid only inside of RCU read-side section)
      */
-    static List<IBlockDevice*> *getBlockDevices();
+    static Vector<IBlockDevice*> *getBlockDevices();
 
 private:
 
@@ -121,6 +132,9 @@ private:
         u32 reserved2[4];
     } __attribute__((packed));
 
+    static constexpr usz maxPRDByteCount = 4 * 1024 * 1024;
+    static constexpr usz maxPRDTLength = 128;
+
     struct PhysicalRegionDescriptor {
         u32 dataBaseAddress;
         u32 dataBaseAddressUpper;
@@ -141,7 +155,7 @@ private:
         usz sector;
         usz count;
         bool write;
-        EventHandler handler;
+        BlockRequestHandler handler;
         void *handlerData;
     };
 
@@ -156,10 +170,14 @@ private:
         MemoryBackedVirtualMemoryObject *identifyObject;
         void *mappedIdentifyData;
         
-        Spinlock portSpinlock;
+        Spinlock portSpinlock{"ahci port"};
         bool identified = false;
         u32 commandsInUse = 0;
+        u32 completedCommands = 0;
+        u32 failedCommands = 0;
         Request currentRequests[32];
+        WorkItem completionWork;
+        Work completionQueueWork;
         List<Request> queuedReads;
         usz sectorSize;
         usz sectorCount;
@@ -187,24 +205,47 @@ private:
         u32 reserved2;
     } __attribute__((packed));
 
+    struct ControllerInitialization {
+        PCIDevice *pciDevice;
+        AHCI *ahci;
+        usz task;
+    };
+
+    struct PortInitialization {
+        AHCI *ahci;
+        u8 portNumber;
+        bool initialized;
+        usz task;
+    };
+
     static constexpr u8 ataCommandIdentify = 0xec;
     static constexpr u8 ataCommandReadDMAEx = 0x25;
+    static constexpr u32 portCommandStart = (1 << 0);
+    static constexpr u32 portCommandListRunning = (1 << 15);
+    static constexpr u32 portErrorInterrupts = (1 << 30) | (1 << 29) | (1 << 28) | (1 << 27); // TFES, HBFS, HBDS, IFS
+    static constexpr usz portStopSpinCount = 1000000;
 
+    static void initializeController(void *initialization);
+    static void initializePortTask(void *initialization);
     bool initializePort(u8 portNumber);
     void identifyDevices();
-    bool issueCommand(u8 port, u8 command, u16 transferSectors, usz accessSector, bool mediaAccess, bool write, VirtualMemoryObject *data, EventHandler handler, void *handlerData);
+    bool issueCommand(u8 port, u8 command, u16 transferSectors, usz accessSector, bool mediaAccess, bool write, VirtualMemoryObject *data, BlockRequestHandler handler, void *handlerData);
     void handleInterrupt();
+    void restartPort(u8 port);
+    static void completeRequests(void *portInfo);
+    static void registerBlockDevice(IBlockDevice *device);
 
     static void interruptHandler(void *data, u32);
 
-    static inline List<AHCI*> *devices = nullptr;
-    static inline List<IBlockDevice*> *blockDevices = nullptr; 
+    static inline Vector<AHCI*> *devices = nullptr;
+    static inline Vector<IBlockDevice*> *blockDevices = nullptr;
+    static inline RawSpinlock blockDevicesSpinlock;
 
     PCIDevice *pciDevice;
     MMIOVirtualMemoryObject *vmObject = nullptr;
     ABAR volatile *abar = nullptr;
     PortInfo *portInformation = nullptr;
-    List<PortInfo*> *drives = nullptr;
+    Vector<PortInfo*> *drives = nullptr;
 
     u8 numberOfPorts = 0;
     u8 numberOfCommandSlots = 0;
@@ -223,8 +264,9 @@ public:
 
     bool isWriteable() override;
     usz sectorCount() override;
-    bool read(usz sector, usz count, VirtualMemoryObject *buffer, EventHandler handler, void *handlerData) override;
-    bool write(usz sector, usz count, VirtualMemoryObject *buffer, EventHandler handler, void *handlerData) override;
+    usz sectorSize() override;
+    bool read(usz sector, usz count, VirtualMemoryObject *buffer, BlockRequestHandler handler, void *handlerData) override;
+    bool write(usz sector, usz count, VirtualMemoryObject *buffer, BlockRequestHandler handler, void *handlerData) override;
 
 private:
     AHCI *ahci;
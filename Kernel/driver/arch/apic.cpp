@@ -1,4 +1,6 @@
 #include "driver/arch/apic.h"
+#include "driver/arch/hpet.h"
+#include "util/bootboot.h"
 
 void LAPIC::initializeCoreLAPIC() {
 
@@ -8,8 +10,9 @@ void LAPIC::initializeCoreLAPIC() {
     // enable LAPIC
     write(spuriousInterruptVectorOffset, 0x1ff); // spurious interrupt is 0xff, enable APIC
 
-    // log core info
+    // log core info, core accepts IPIs from now on
     Logger::printFormat("[apic] core %d - lapic initialized\n", apicID);
+    __atomic_fetch_or(&onlineCores, 1ull << apicID, __ATOMIC_RELEASE);
 
     // send EOI after initializing LAPIC (discard any pending interrupts in IOAPICS)
     sendEOI();
@@ -40,6 +43,89 @@ void LAPIC::sendEOI() {
 
 }
 
+void LAPIC::sendIPI(u8 apicID, u8 vector) {
+
+    // send fixed, edge-triggered IPI with physical destination mode
+    sendCommand(apicID, static_cast<u32>(vector) | commandLevelAssert);
+
+}
+
+void LAPIC::sendIPIToMask(u64 cores, u8 vector) {
+
+    // mask covering all other cores needs just one command (only once all of them are online, shorthand would reach
+    // cores which did not initialize their LAPIC yet as well)
+    u8 self = CPU::getCoreAPICID();
+    u64 online = getOnlineCores();
+    cores &= ~(1ull << self);
+    if(cores != 0 && cores == (online & ~(1ull << self)) && CPU::countCores(online) == BootBoot::getStructure().coreCount) {
+        sendIPIToAllButSelf(vector);
+        return;
+    }
+
+    // physical destination mode addresses single core, so others get their own commands
+    for(u32 i = 0; i < CPU::maxCoreCount; i++) if(cores & (1ull << i)) sendIPI(static_cast<u8>(i), vector);
+
+}
+
+void LAPIC::sendIPIToAllButSelf(u8 vector) {
+
+    // destination shorthand ignores destination field
+    sendCommand(0, static_cast<u32>(vector) | commandLevelAssert | commandAllButSelf);
+
+}
+
+u64 LAPIC::getOnlineCores() { return __atomic_load_n(&onlineCores, __ATOMIC_ACQUIRE); }
+
+void LAPIC::startPeriodicTimer(u8 vector, u64 periodMicroseconds) {
+
+    // timers of all cores tick at the same rate, so it is measured only once
+    if(timerTicksPerMillisecond == 0) calibrateTimer();
+
+    // program periodic mode first, counting starts with write of initial count
+    u64 initialCount = (timerTicksPerMillisecond * periodMicroseconds) / 1000;
+    if(initialCount == 0) initialCount = 1;
+    if(initialCount > 0xffffffff) initialCount = 0xffffffff;
+    write(divideConfigurationOffset, timerDivideBy16);
+    write(timerOffset, static_cast<u32>(vector) | timerPeriodicMode);
+    write(initialCountOffset, static_cast<u32>(initialCount));
+
+}
+
+void LAPIC::calibrateTimer() {
+
+    // let the timer count down from maximum value (masked, one shot) for known time measured by HPET
+    write(divideConfigurationOffset, timerDivideBy16);
+    write(timerOffset, (1 << 16));
+    write(initialCountOffset, 0xffffffff);
+    u64 start = HPET::getNanoseconds();
+    while(HPET::getNanoseconds() - start < timerCalibrationNanoseconds) CPU::pause();
+    u32 elapsedTicks = 0xffffffff - read(currentCountOffset);
+    write(initialCountOffset, 0);
+
+    timerTicksPerMillisecond = (static_cast<u64>(elapsedTicks) * 1000000) / timerCalibrationNanoseconds;
+    Logger::printFormat("[apic] lapic timer runs at %u ticks per millisecond\n", timerTicksPerMillisecond);
+
+}
+
+void LAPIC::sendCommand(u8 apicID, u32 command) {
+
+    // disable interrupts, so the ICR write pair is not interleaved with another IPI sent from interrupt handler
+    bool interruptState = CPU::enterCritical();
+
+    // wait until previous IPI was delivered
+    while(read(interruptCommandOffset) & commandDeliveryPending) CPU::pause();
+
+    // set destination, writing low half sends the IPI
+    write(interruptCommandHighOffset, static_cast<u32>(apicID) << 24);
+    write(interruptCommandOffset, command);
+
+    // wait until IPI was delivered
+    while(read(interruptCommandOffset) & commandDeliveryPending) CPU::pause();
+
+    CPU::exitCritical(interruptState);
+
+}
+
 u32 LAPIC::read(u32 offset) {
 
     // check bounds
@@ -72,7 +158,7 @@ void IOAPIC::initialize(MMIOVirtualMemoryObject *mmioObject, void *mappedAddress
     }
 
     // set available pins
-    availablePins = new List<u8>();
+    availablePins = new Vector<u8>();
 
     // set values 
     object = mmioObject;
@@ -1,5 +1,5 @@
 #pragma once
-#include <util/list.h>
+#include <util/vector.h>
 #include <util/types.h>
 #include <driver/acpi/acpibase.h>
 #include <driver/arch/portio.h>
@@ -29,6 +29,39 @@ public:
      */
     static void sendEOI();
 
+    /**
+     * @brief Sends fixed inter-processor interrupt to specified core
+     * @param apicID LAPIC ID of destination core
+     * @param vector Vector of interrupt to be raised on destination core
+     */
+    static void sendIPI(u8 apicID, u8 vector);
+
+    /**
+     * @brief Sends fixed inter-processor interrupt to every core in the mask
+     * @param cores Bitmask of destination cores, indexed by LAPIC ID
+     * @param vector Vector of interrupt to be raised on destination cores
+     */
+    static void sendIPIToMask(u64 cores, u8 vector);
+
+    /**
+     * @brief Sends fixed inter-processor interrupt to all cores other than currently executing one (with single ICR write)
+     * @param vector Vector of interrupt to be raised on destination cores
+     */
+    static void sendIPIToAllButSelf(u8 vector);
+
+    /**
+     * @brief Returns cores whose LAPIC was initialized (so that they accept inter-processor interrupts)
+     * @return Bitmask of online cores, indexed by LAPIC ID
+     */
+    static u64 getOnlineCores();
+
+    /**
+     * @brief Starts periodic LAPIC timer of currently executing core, timer is calibrated against HPET on first use
+     * @param vector Vector of interrupt raised on every period
+     * @param periodMicroseconds Period of the timer
+     */
+    static void startPeriodicTimer(u8 vector, u64 periodMicroseconds);
+
 private:
 
     static constexpr u32 lapicIDOffset = 0x020;
@@ -47,6 +80,7 @@ private:
     static constexpr u32 errorStatusOffset = 0x280;
     static constexpr u32 correctedMachineCheckOffset = 0x2f0;
     static constexpr u32 interruptCommandOffset = 0x300;
+    static constexpr u32 interruptCommandHighOffset = 0x310;
     static constexpr u32 timerOffset = 0x320;
     static constexpr u32 thermalSensorOffset = 0x330;
     static constexpr u32 performanceMonitoringOffset = 0x340;
@@ -57,8 +91,21 @@ private:
     static constexpr u32 currentCountOffset = 0x390;
     static constexpr u32 divideConfigurationOffset = 0x3e0;
 
+    static constexpr u32 commandDeliveryPending = (1 << 12);
+    static constexpr u32 commandLevelAssert = (1 << 14);
+    static constexpr u32 commandAllButSelf = (0b11 << 18);
+
+    static constexpr u32 timerDivideBy16 = 0b0011;
+    static constexpr u32 timerPeriodicMode = (1 << 17);
+    static constexpr u64 timerCalibrationNanoseconds = 10000000;
+
     static u32 read(u32 offset);
     static void write(u32 offset, u32 value);
+    static void calibrateTimer();
+    static void sendCommand(u8 apicID, u32 command);
+
+    static inline u64 timerTicksPerMillisecond = 0;
+    static inline u64 onlineCores = 0;
 
 };
 
@@ -101,7 +148,7 @@ private:
     static inline u32 globalSystemInterrupt = 0;
     static inline usz redirectionEntryCount = 0;
     static inline bool initialized = false;
-    static inline List<u8> *availablePins;
+    static inline Vector<u8> *availablePins;
 
 };
 
@@ -2,19 +2,61 @@
 #include "cpu.h"
 
 
-CPU::CPUID CPU::getCPUID(u32 leaf) {
+CPU::CPUID CPU::getCPUID(u32 leaf, u32 subleaf) {
     
     CPUID cpuid;
     cpuid.leaf = leaf;
-    __get_cpuid(leaf, &cpuid.aRegister, &cpuid.bRegister, &cpuid.cRegister, &cpuid.dRegister);
+    __get_cpuid_count(leaf, subleaf, &cpuid.aRegister, &cpuid.bRegister, &cpuid.cRegister, &cpuid.dRegister);
     return cpuid;
 
 }
 
+void CPU::initializeCoreData() {
+
+    // this is the only place where CPUID is asked for LAPIC ID, everything else reads it from the data block
+    u8 apicID = static_cast<u8>(getCPUID(1).bRegister >> 24);
+
+    // per-core data, per-core instances and core masks are indexed by LAPIC ID, so core beyond them cannot run
+    // NOTE: the core cannot even log, as logger uses per-core data
+    if(apicID >= maxCoreCount) {
+        for(;;); // TODO: panic!
+    }
+    CoreData& data = coreData[apicID];
+    data.self = &data;
+    data.apicID = apicID;
+
+    // prefer WRGSBASE, if CPU has it (it is not serializing, unlike MSR write)
+    // NOTE: kernel does not run user code yet, so GS base is never swapped (swapgs will be needed on entries from user mode)
+    if((getCPUID(7, 0).bRegister & cpuidFSGSBaseBit) != 0) {
+        writeCR4(readCR4() | cr4FSGSBaseBit);
+        __atomic_store_n(&fsgsBase, true, __ATOMIC_RELAXED);
+    }
+    writeGSBase(reinterpret_cast<u64>(&data));
+
+}
+
+CPU::CoreData *CPU::getCoreData() {
+
+    CoreData *data;
+    asm volatile ("mov %%gs:0, %0" : "=r"(data));
+    return data;
+
+}
+
 u8 CPU::getCoreAPICID() {
 
-    CPUID cpuid = getCPUID(1);
-    return static_cast<u8>(cpuid.bRegister >> 24);
+    u8 apicID;
+    asm volatile ("movb %%gs:%c1, %0" : "=r"(apicID) : "i"(__builtin_offsetof(CoreData, apicID)));
+    return apicID;
+
+}
+
+u32 CPU::countCores(u64 cores) {
+
+    // clear lowest set bit until nothing is left
+    u32 count = 0;
+    for(; cores != 0; cores &= cores - 1) count++;
+    return count;
 
 }
 
@@ -70,11 +112,16 @@ void CPU::loadCodeSegment(u16 segment) {
 
 void CPU::loadDataSegments(u16 segment) {
 
+    // loading GS selector resets GS base, so data block of the core has to be pointed to again
+    bool interruptState = enterCritical();
+    u64 gsBase = readGSBase();
     asm volatile("mov %0, %%ds" : : "a"(segment));
     asm volatile("mov %0, %%ss" : : "a"(segment));
     asm volatile("mov %0, %%es" : : "a"(segment));
     asm volatile("mov %0, %%fs" : : "a"(segment));
     asm volatile("mov %0, %%gs" : : "a"(segment));
+    writeGSBase(gsBase);
+    exitCritical(interruptState);
 
 }
 
@@ -86,6 +133,14 @@ u64 CPU::readEFLAGS() {
 
 }
 
+u64 CPU::readCR2() {
+
+    u64 value;
+    asm volatile ("mov %%cr2, %0" : "=r"(value));
+    return value;
+
+}
+
 u64 CPU::readCR3() {
 
     u64 value;
@@ -100,12 +155,77 @@ void CPU::writeCR3(u64 value) {
     
 }
 
+u64 CPU::readCR4() {
+
+    u64 value;
+    asm volatile ("mov %%cr4, %0" : "=r"(value));
+    return value;
+
+}
+
+void CPU::writeCR4(u64 value) {
+
+    asm volatile ("mov %0, %%cr4" : : "r"(value) : "memory");
+
+}
+
 void CPU::invalidatePagingEntry(void *address) {
 
     asm volatile ("invlpg (%0)" : : "b"(address) : "memory");
 
 }
 
+void CPU::flushTLB() {
+
+    // NOTE: with PCIDs enabled, this flushes only entries of current PCID
+    writeCR3(readCR3());
+
+}
+
+void CPU::flushGlobalTLB() {
+
+    // toggling global pages bit flushes whole TLB
+    u64 value = readCR4();
+    writeCR4(value ^ cr4GlobalPagesBit);
+    writeCR4(value);
+
+}
+
+u64 CPU::readTimestampCounter() {
+
+    u32 lower, higher;
+    asm volatile ("rdtsc" : "=a"(lower), "=d"(higher));
+    return (static_cast<u64>(higher) << 32) | lower;
+
+}
+
+void CPU::pause() {
+
+    asm volatile ("pause" : : : "memory");
+
+}
+
+void CPU::halt(bool enableInterrupts) {
+
+    if(enableInterrupts) asm volatile ("sti ; hlt" : : : "memory");
+    else asm volatile ("hlt" : : : "memory");
+
+}
+
+void CPU::monitor(const void *address) {
+
+    asm volatile ("monitor" : : "a"(address), "c"(0), "d"(0) : "memory");
+
+}
+
+void CPU::monitorWait(bool enableInterrupts) {
+
+    // NOTE: no hints are given (C1 is requested), deeper states would need per-model knowledge of their latencies
+    if(enableInterrupts) asm volatile ("sti ; mwait" : : "a"(0), "c"(0) : "memory");
+    else asm volatile ("mwait" : : "a"(0), "c"(0) : "memory");
+
+}
+
 u64 CPU::readMSR(u32 msr) {
 
     u32 lower, higher;
@@ -134,4 +254,67 @@ void CPU::enableSystemCallExtensions() {
 
 }
 
+void CPU::enableGlobalPages() {
+
+    writeCR4(readCR4() | cr4GlobalPagesBit);
+
+}
+
+bool CPU::enableProcessContextIdentifiers() {
+
+    // check support, PCIDs can be enabled only when current PCID is 0
+    if((getCPUID(1).cRegister & cpuidProcessContextIdentifiersBit) == 0) return false;
+    if((readCR3() & 0xfff) != 0) return false;
+
+    writeCR4(readCR4() | cr4ProcessContextIdentifiersBit);
+    processContextIdentifiers = true;
+    return true;
+
+}
+
+bool CPU::initializePAT() {
+
+    // check support
+    if((getCPUID(1).dRegister & cpuidPageAttributeTableBit) == 0) return false;
+
+    // NOTE: first four entries keep their power-on values, so PWT/PCD combinations select the same types as before
+    // caches and TLB are flushed around the change, as lines cached with previous type could otherwise survive it
+    bool interruptState = enterCritical();
+    asm volatile("wbinvd" : : : "memory");
+    flushGlobalTLB();
+    writeMSR(patMSRAddress, patValue);
+    asm volatile("wbinvd" : : : "memory");
+    flushGlobalTLB();
+    exitCritical(interruptState);
+    pageAttributeTable = true;
+    return true;
+
+}
+
+bool CPU::supportsHugePages() { return (getCPUID(0x80000001).dRegister & cpuidHugePagesBit) != 0; }
+
+bool CPU::supportsMonitorWait() { return (getCPUID(1).cRegister & cpuidMonitorWaitBit) != 0; }
+
+bool CPU::processContextIdentifiersEnabled() { return processContextIdentifiers; }
+
+bool CPU::pageAttributeTableEnabled() { return pageAttributeTable; }
+
+bool CPU::fsgsBaseEnabled() { return fsgsBase; }
+
+void CPU::writeGSBase(u64 value) {
+
+    if(fsgsBase) asm volatile ("wrgsbase %0" : : "r"(value) : "memory");
+    else writeMSR(gsBaseMSRAddress, value);
+
+}
+
+u64 CPU::readGSBase() {
+
+    u64 value;
+    if(fsgsBase) asm volatile ("rdgsbase %0" : "=r"(value));
+    else value = readMSR(gsBaseMSRAddress);
+    return value;
+
+}
+
 
@@ -13,6 +13,27 @@ public:
 	 */
 	static constexpr u64 pagingBase = 0xffff800000000000;
 
+	/**
+	 * @brief Maximum count of cores supported by the kernel (cores are indexed by their LAPIC ID)
+	 * NOTE: core with LAPIC ID not below this value stops in initializeCoreData
+	 */
+	static constexpr u32 maxCoreCount = 64;
+
+	/**
+	 * @brief Size of cache line, structures written by different cores are padded to it to avoid false sharing
+	 */
+	static constexpr usz cacheLineSize = 64;
+
+	/**
+	 * @brief CR3 bit preserving TLB entries of loaded PCID when switching address spaces
+	 */
+	static constexpr u64 preserveTLBBit = (1ull << 63);
+
+	/**
+	 * @brief Highest process context identifier supported by the CPU
+	 */
+	static constexpr u16 maxProcessContextIdentifier = 4095;
+
 	/**
 	 * @brief Structure containing all values returned by CPU after CPUID query
 	 */
@@ -31,20 +52,50 @@ public:
 		u16 size;
 		u64 address;
 	} __attribute__((packed));
+
+	/**
+	 * @brief Data block of single core, GS base of every core points to its own block, so that it is reached by single
+	 *        GS-relative load (instead of CPUID, which is serializing and traps to the hypervisor in VMs)
+	 */
+	struct alignas(cacheLineSize) CoreData {
+		CoreData *self;
+		u8 apicID;
+	};
 	
 	/**
 	 * @brief Returns information about CPU from sepcified "leaf"
 	 * @param leaf Leaf of info to be returned
+	 * @param subleaf Subleaf of info to be returned (for leaves which have them)
 	 * @return Corresponding data returned by CPU
 	 */
-	static CPUID getCPUID(u32 leaf);
+	static CPUID getCPUID(u32 leaf, u32 subleaf = 0);
 
 	/**
-	 * @brief Returns LAPIC ID of currently executing processor
+	 * @brief Points GS base of currently executing core to its data block, has to be called by every core before
+	 *        anything else (all per-core accessors read through GS)
+	 */
+	static void initializeCoreData();
+
+	/**
+	 * @brief Returns data block of currently executing core
+	 * @return Data block of current core
+	 * NOTE: result is meaningful only as long as the caller cannot move to other core (interrupts or preemption disabled)
+	 */
+	static CoreData *getCoreData();
+
+	/**
+	 * @brief Returns LAPIC ID of currently executing processor (read from data block of the core)
 	 * @return LAPIC ID of current processor
 	 */
 	static u8 getCoreAPICID();
 
+	/**
+	 * @brief Returns count of cores in the mask (kernel is not linked with libgcc, so popcount builtin cannot be used)
+	 * @param cores Bitmask of cores, indexed by LAPIC ID
+	 * @return Count of set bits
+	 */
+	static u32 countCores(u64 cores);
+
 	/**
 	 * @brief Enables or disables servicing of interrupts
 	 * @param interruptState true if interrupts should be enabled, false otherwise
@@ -99,6 +150,12 @@ public:
 	 */
 	static u64 readEFLAGS();
 
+	/**
+	 * @brief Returns current CR2 contents
+	 * @return Linear address which caused last page fault
+	 */
+	static u64 readCR2();
+
 	/**
 	 * @brief Returns current CR3 contents
 	 * @return Current CR3 register contents
@@ -111,12 +168,64 @@ public:
 	 */
 	static void writeCR3(u64 value);
 
+	/**
+	 * @brief Returns current CR4 contents
+	 * @return Current CR4 register contents
+	 */
+	static u64 readCR4();
+
+	/**
+	 * @brief Writes CR4 contents
+	 * @param value CR4 register contents to be written
+	 */
+	static void writeCR4(u64 value);
+
 	/**
 	 * @brief Invalidates TLB entry
 	 * @param address Address to be invalidated
 	 */
 	static void invalidatePagingEntry(void *address);
 
+	/**
+	 * @brief Invalidates all non-global TLB entries of currently executing core
+	 */
+	static void flushTLB();
+
+	/**
+	 * @brief Invalidates all TLB entries of currently executing core, including global ones and those of other PCIDs
+	 */
+	static void flushGlobalTLB();
+
+	/**
+	 * @brief Returns current value of time stamp counter
+	 * @return Current time stamp counter value
+	 */
+	static u64 readTimestampCounter();
+
+	/**
+	 * @brief Hints the CPU that the code is executing spin-wait loop
+	 */
+	static void pause();
+
+	/**
+	 * @brief Stops the core until next interrupt
+	 * @param enableInterrupts Whether to enable interrupts right before halting (STI takes effect only after HLT, so
+	 *        that interrupt coming in between cannot be missed)
+	 */
+	static void halt(bool enableInterrupts);
+
+	/**
+	 * @brief Arms address monitoring hardware, following monitorWait returns once the cache line is written
+	 * @param address Address to be monitored
+	 */
+	static void monitor(const void *address);
+
+	/**
+	 * @brief Stops the core until monitored cache line is written or interrupt comes
+	 * @param enableInterrupts Whether to enable interrupts right before waiting (the same way as with halt)
+	 */
+	static void monitorWait(bool enableInterrupts);
+
 	/**
 	 * @brief Reads model specific register of CPU
 	 * @param msr MSR address from where the data should be read
@@ -141,8 +250,74 @@ public:
 	 */
 	static void enableSystemCallExtensions();
 
+	/**
+	 * @brief Enables global pages, which are not flushed on address space switch
+	 */
+	static void enableGlobalPages();
+
+	/**
+	 * @brief Enables process context identifiers (tagging of TLB entries) if CPU supports them
+	 * @return true if PCIDs were enabled, false otherwise
+	 */
+	static bool enableProcessContextIdentifiers();
+
+	/**
+	 * @brief Programs page attribute table, so that write-combining and write-protected memory types are selectable by mappings
+	 * @return true if PAT was programmed, false if CPU does not support it
+	 */
+	static bool initializePAT();
+
+	/**
+	 * @brief Returns whether CPU supports 1GiB pages
+	 * @return true if 1GiB pages are supported, false otherwise
+	 */
+	static bool supportsHugePages();
+
+	/**
+	 * @brief Returns whether CPU supports MONITOR and MWAIT instructions
+	 * @return true if MONITOR/MWAIT are supported, false otherwise
+	 */
+	static bool supportsMonitorWait();
+
+	/**
+	 * @brief Returns whether process context identifiers are used
+	 * @return true if PCIDs are enabled, false otherwise
+	 */
+	static bool processContextIdentifiersEnabled();
+
+	/**
+	 * @brief Returns whether page attribute table was programmed with extended memory types
+	 * @return true if PAT was programmed, false otherwise
+	 */
+	static bool pageAttributeTableEnabled();
+
+	/**
+	 * @brief Returns whether GS base is written with WRGSBASE instruction (instead of MSR write)
+	 * @return true if FSGSBASE instructions are enabled, false otherwise
+	 */
+	static bool fsgsBaseEnabled();
+
 
 private:
 	static constexpr u32 eferMSRAddress = 0xc0000080;
+	static constexpr u32 gsBaseMSRAddress = 0xc0000101;
+	static constexpr u32 patMSRAddress = 0x277;
+	static constexpr u64 patValue = 0x0007050100070406ull; // WB, WT, UC-, UC, WC, WP, UC-, UC
+	static constexpr u64 cr4GlobalPagesBit = (1ull << 7);
+	static constexpr u64 cr4ProcessContextIdentifiersBit = (1ull << 17);
+	static constexpr u32 cpuidProcessContextIdentifiersBit = (1u << 17);
+	static constexpr u32 cpuidPageAttributeTableBit = (1u << 16);
+	static constexpr u32 cpuidHugePagesBit = (1u << 26);
+	static constexpr u32 cpuidMonitorWaitBit = (1u << 3);
+	static constexpr u64 cr4FSGSBaseBit = (1ull << 16);
+	static constexpr u32 cpuidFSGSBaseBit = (1u << 0);
+
+	static void writeGSBase(u64 value);
+	static u64 readGSBase();
+
+	static inline bool processContextIdentifiers = false;
+	static inline bool pageAttributeTable = false;
+	static inline bool fsgsBase = false;
+	static inline CoreData coreData[maxCoreCount] = {};
 
 };
\ No newline at end of file
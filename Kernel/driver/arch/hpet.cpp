@@ -46,8 +46,8 @@ void HPET::initialize() {
         }
     }
 
-    // create event queue
-    eventQueue = new List<TimedEvent*>();
+    // create map of events by their IDs
+    eventsByID = new HashMap<usz, TimedEvent*>();
 
     // check if any timer supports periodic mode
     if(!periodicSupported) {
@@ -99,24 +99,12 @@ usz HPET::createTimedEvent(u64 milliseconds, EventHandler handler, void *handler
     ScopedSpinlock lock(eventQueueSpinlock);
 
     // decrement all timed events by current count and zero it
-    for(usz i = 0; i < eventQueue->size(); i++) {
-        TimedEvent *event = eventQueue->get(i);
-        event->tickCount -= currentTickCount;
-    }
+    eventQueue.forEach([](TimedEvent *event) { event->tickCount -= currentTickCount; });
     currentTickCount = 0;
 
-    // iterate and check where insertion is needed
-    usz position = 0;
-    bool inTheMiddle = false;
-    for(usz i = 0; i < eventQueue->size(); i++) {
-        TimedEvent *event = eventQueue->get(i);
-        if(milliseconds <= event->tickCount) {
-            inTheMiddle = true;
-            break;
-        }
-        position = i;
-    }
-    if(!inTheMiddle) position++;
+    // find first event which fires later, new one will be inserted before it
+    TimedEvent *position = eventQueue.getFirst();
+    while(position != nullptr && milliseconds > position->tickCount) position = eventQueue.getNext(position);
 
     // create new event
     usz id = currentID++;
@@ -127,26 +115,43 @@ usz HPET::createTimedEvent(u64 milliseconds, EventHandler handler, void *handler
     event->id = id;
 
     // insert event
-    eventQueue->insertAt(event, position);
+    eventQueue.insertBefore(event, position);
+    eventsByID->insert(id, event);
 
     // return id
     return id;
 
 }
 
-void HPET::removeTimedEvent(usz id) {
+bool HPET::removeTimedEvent(usz id) {
 
     // lock spinlock
     ScopedSpinlock lock(eventQueueSpinlock);
 
-    // iterate and remove if still in the list
-    for(usz i = 0; i < eventQueue->size(); i++) {
-        TimedEvent *event = eventQueue->get(i);
-        if(event->id == id) {
-            eventQueue->remove(i);
-            break;
-        }
-    }
+    // look the event up and remove it if it is still queued
+    TimedEvent **event = eventsByID->find(id);
+    if(event == nullptr) return false;
+    TimedEvent *removedEvent = *event;
+    eventsByID->remove(id);
+    eventQueue.remove(removedEvent);
+    delete removedEvent;
+    return true;
+}
+
+void HPET::runTimedEvent(void *event) {
+
+    // fire event and delete its object
+    TimedEvent *firedEvent = reinterpret_cast<TimedEvent*>(event);
+    firedEvent->handler(firedEvent->handlerData);
+    delete firedEvent;
+
+}
+
+u64 HPET::getNanoseconds() {
+
+    // convert femtosecond ticks, splitting the counter to avoid overflow
+    u64 counter = registers->mainCounterValue;
+    return (counter / 1000000) * clockPeriod + ((counter % 1000000) * clockPeriod) / 1000000;
 
 }
 
@@ -167,10 +172,24 @@ void HPET::setupOneShotMillisecond() {
 
 }
 
+u64 HPET::getMilliseconds() {
+    return clockState.read().ticks;
+}
+
+u64 HPET::getCoarseNanoseconds() {
+    return clockState.read().tickNanoseconds;
+}
+
 void HPET::oneShotInterruptHandler(void *, u32) {
 
+    // advance clock state, readers see both fields updated at once
+    ClockState clock = clockState.read();
+    clock.ticks++;
+    clock.tickNanoseconds = getNanoseconds();
+    clockState.write(clock);
+
     // check if any events are pending
-    if(eventQueue->size() == 0) {
+    if(eventQueue.isEmpty()) {
         setupOneShotMillisecond();
         currentTickCount = 0;
         return;
@@ -183,28 +202,26 @@ void HPET::oneShotInterruptHandler(void *, u32) {
     ScopedSpinlock lock(eventQueueSpinlock);
 
     // compare current tick count
-    TimedEvent *firstEvent = eventQueue->get(0);
+    TimedEvent *firstEvent = eventQueue.getFirst();
     if(currentTickCount >= firstEvent->tickCount) {
 
         // subtract current count from all queued events
-        for(usz i = 0; i < eventQueue->size(); i++) {
-            TimedEvent *event = eventQueue->get(i);
+        eventQueue.forEach([](TimedEvent *event) {
             event->tickCount -= (currentTickCount > event->tickCount) ? event->tickCount : currentTickCount;
-        }
+        });
 
         // fire all events that have count 0
-        TimedEvent *currentEvent = eventQueue->get(0);
-        while(currentEvent->tickCount == 0) {
+        TimedEvent *currentEvent = eventQueue.getFirst();
+        while(currentEvent != nullptr && currentEvent->tickCount == 0) {
             
-            // fire event
-            currentEvent->handler(currentEvent->handlerData);
-
-            // delete event object and remove it from the list
-            delete currentEvent;
-            eventQueue->remove(0);
-
-            if(eventQueue->size() == 0) break;
-            else currentEvent = eventQueue->get(0);
+            // remove event from the list and defer its handler to softirq, which deletes the event afterwards
+            eventQueue.remove(currentEvent);
+            eventsByID->remove(currentEvent->id);
+            currentEvent->work.function = &HPET::runTimedEvent;
+            currentEvent->work.data = currentEvent;
+            SoftIRQ::schedule(&currentEvent->work);
+
+            currentEvent = eventQueue.getFirst();
         }
 
         // zero-out current tick count
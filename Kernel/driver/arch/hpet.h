@@ -3,6 +3,10 @@
 #include <driver/acpi/acpibase.h>
 #include <driver/arch/ints.h>
 #include <mem/vas.h>
+#include <util/hashmap.h>
+#include <util/intrusivelist.h>
+#include <util/softirq.h>
+#include <util/seqlock.h>
 
 /**
  * @brief Class for managin High Precision Event Timer
@@ -28,8 +32,27 @@ public:
     /** 
      * @brief Removes created timed event
      * @param id ID of event to be removed
+     * @return true if event was removed, false if it already fired (its handler may be still running)
      */
-    static void removeTimedEvent(usz id);
+    static bool removeTimedEvent(usz id);
+
+    /**
+     * @brief Returns time elapsed since HPET was enabled
+     * @return Time in nanoseconds
+     */
+    static u64 getNanoseconds();
+
+    /**
+     * @brief Returns count of one shot timer ticks since HPET was initialized, without touching HPET registers
+     * @return Time in milliseconds (coarse, as ticks are rearmed from the interrupt handler)
+     */
+    static u64 getMilliseconds();
+
+    /**
+     * @brief Returns time of the last one shot timer tick, which is much cheaper than reading the main counter
+     * @return Time in nanoseconds with millisecond granularity
+     */
+    static u64 getCoarseNanoseconds();
 
 private:
 
@@ -66,18 +89,28 @@ private:
         EventHandler handler;
         void *handlerData;
         usz id = 0;
+        IntrusiveLink<TimedEvent> link;
+        WorkItem work;
+    };
+
+    struct ClockState {
+        u64 ticks;
+        u64 tickNanoseconds;
     };
 
     static constexpr usz femtosecondPerMillisecond = 1000000000000ull;
 
     static void setupOneShotMillisecond();
     static void oneShotInterruptHandler(void *, u32);
+    static void runTimedEvent(void *event);
 
     static inline volatile RegisterSpace *registers = nullptr;
     static inline u32 clockPeriod = 0;
     static inline u8 numberOfTimers = 0;
-    static inline List<TimedEvent*> *eventQueue = nullptr;
-    static inline Spinlock eventQueueSpinlock;
+    static inline IntrusiveList<TimedEvent, &TimedEvent::link> eventQueue;
+    static inline HashMap<usz, TimedEvent*> *eventsByID = nullptr;
+    static inline Spinlock eventQueueSpinlock{"hpet event queue"};
+    static inline SeqLocked<ClockState> clockState;
     static inline usz currentTickCount = 0;
     static inline u8 oneShotTimer = 0xff;
     static inline u8 oneShotRouting = 0xff;
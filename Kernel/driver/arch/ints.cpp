@@ -3,9 +3,11 @@
 CPU::Pointer __attribute__((aligned(16))) idtPointer;
 
 struct InterruptFrame {
-    u64 values[1];
+    u64 values[5]; // rip, cs, rflags, rsp, ss
 };
 
+static constexpr u64 interruptFlag = (1 << 9);
+
 static usz spuriousInterruptCount = 0;
 
 __attribute__((interrupt))
@@ -24,6 +26,12 @@ static void interruptHandler(InterruptFrame *) {
         // send EOI
         LAPIC::sendEOI();
 
+        // run work deferred by handlers, with interrupts enabled
+        SoftIRQ::run();
+
+        // switch threads if time slice of current one ended
+        Scheduler::preemptIfNeeded();
+
     }
 
     else {
@@ -53,6 +61,19 @@ static void generalProtectionFault(InterruptFrame *frame, unsigned long int code
 
 }
 
+__attribute__((interrupt))
+static void pageFault(InterruptFrame *frame, unsigned long int code) {
+
+    // try to resolve the fault (e.g. first access to demand paged object), it may wait only if interrupted code could
+    u64 address = CPU::readCR2();
+    if(VirtualAddressSpace::handlePageFault(reinterpret_cast<void*>(address), code, (frame->values[2] & interruptFlag) != 0)) return;
+
+    // fault could not be resolved, print some data
+    Logger::printFormat("[ints] page fault at 0x%x, code: 0x%x, rip = 0x%x\n", address, static_cast<u64>(code), frame->values[0]);
+    for(;;);
+
+}
+
 void Interrupts::initialize() {
 
     // create IDT
@@ -60,11 +81,9 @@ void Interrupts::initialize() {
     void *idtAddress = reinterpret_cast<IDTEntry*>(reinterpret_cast<usz>(idtPhysicalAddress) + CPU::pagingBase);
     idt = reinterpret_cast<IDTEntry*>(idtAddress);
 
-    // create interrupt handlers tables
-    interruptHandlers = new InterruptHandler[256];
+    // create interrupt handlers table, handler and its data are published together as single entry
+    interruptHandlers = new HandlerEntry*[256];
     for(usz i = 0; i < 256; i++) interruptHandlers[i] = nullptr;
-    interruptHandlersData = new usz[256];
-    for(usz i = 0; i < 256; i++) interruptHandlersData[i] = 0;
 
     // zero-out IDT
     u64 *page = reinterpret_cast<u64*>(idtAddress);
@@ -75,6 +94,7 @@ void Interrupts::initialize() {
     // if(i == 8 || i == 10 || i == 11 || i == 12 || i == 13 || i == 14 || i == 17 || i == 30) setEntry(i, true);
 
     setEntry(13, true, reinterpret_cast<void*>(&generalProtectionFault));
+    setEntry(14, true, reinterpret_cast<void*>(&pageFault));
 
     // fill other IDT entries (everything other than, first 32 vectors)
     for(usz i = 32; i < 256; i++) { setEntry(i); }
@@ -94,12 +114,19 @@ void Interrupts::loadIDT() {
 
 u8 Interrupts::reserveMSIVector(InterruptHandler handler, void *data) {
 
+    // writers are serialized, dispatching cores read the table without locking
+    ScopedRawSpinlock lock(interruptHandlersSpinlock);
+
     // check if vectors are available
     if(maxInterrupt - minInterrupt == 0) return 0; 
 
-    // register handler for that
-    interruptHandlers[minInterrupt] = handler;
-    interruptHandlersData[minInterrupt] = reinterpret_cast<usz>(data);
+    // register handler for that, replaced entry may still be used by dispatching cores
+    HandlerEntry *entry = new HandlerEntry;
+    entry->handler = handler;
+    entry->data = data;
+    HandlerEntry *oldEntry = interruptHandlers[minInterrupt];
+    RCU::assign(interruptHandlers[minInterrupt], entry);
+    if(oldEntry != nullptr) RCU::free(oldEntry);
 
     // return vectors
     u8 vector = minInterrupt;
@@ -142,8 +169,10 @@ u16 Interrupts::getMSIData(u8 vector) {
 
 void Interrupts::fireInterruptHandler(u8 vector) {
 
-    // just call the function with according data
-    interruptHandlers[vector](reinterpret_cast<void*>(interruptHandlersData[vector]), 0);
+    // call the function with according data, entry is read under RCU, so no lock is needed
+    ScopedRCURead read;
+    HandlerEntry *entry = RCU::dereference(interruptHandlers[vector]);
+    if(entry != nullptr) entry->handler(entry->data, 0);
 
 }
 
@@ -3,8 +3,13 @@
 #include <driver/arch/apic.h>
 #include <util/types.h>
 #include <util/logger.h>
+#include <util/rcu.h>
+#include <util/softirq.h>
+#include <util/spinlock.h>
 #include <util/critical.h>
 #include <mem/physalloc.h>
+#include <mem/vas.h>
+#include <sched/scheduler.h>
 
 /**
  * @brief Class for managing interrupts of a system
@@ -60,6 +65,11 @@ public:
 
 private:
 
+    struct HandlerEntry {
+        InterruptHandler handler;
+        void *data;
+    };
+
     static void setEntry(u8 entry, bool errorCode = false, void *handler = nullptr);
 
     struct IDTEntry {
@@ -74,8 +84,8 @@ private:
 
     static inline void *idtPhysicalAddress = nullptr;
     static inline IDTEntry *idt = nullptr;
-    static inline InterruptHandler *interruptHandlers = nullptr;
-    static inline usz *interruptHandlersData = nullptr;
+    static inline HandlerEntry **interruptHandlers = nullptr;
+    static inline RawSpinlock interruptHandlersSpinlock;
     static inline usz maxInterrupt = 0xfe;
     static inline usz minInterrupt = 0x20;
 
@@ -0,0 +1,200 @@
+#include "driver/arch/ipi.h"
+#include "driver/arch/apic.h"
+#include "driver/arch/ints.h"
+#include "util/logger.h"
+
+RemoteCall::RemoteCall(EventHandler function, void *data, EventHandler completion) : function(function), data(data), completion(completion) {}
+
+RemoteCall::~RemoteCall() {
+
+    // remote cores still reference the call until they finish
+    wait();
+
+}
+
+bool RemoteCall::completed() { return __atomic_load_n(&finished, __ATOMIC_ACQUIRE); }
+
+void RemoteCall::wait() {
+
+    // service own queue while waiting, other core could be waiting for us with interrupts disabled
+    while(!completed()) {
+        IPI::processPendingCalls();
+        CPU::pause();
+    }
+
+}
+
+void IPI::initialize() {
+
+    // reserve vector for remote call IPIs
+    u8 reservedVector = Interrupts::reserveVector(&IPI::interruptHandler, nullptr);
+    if(reservedVector == 0) {
+        Logger::printFormat("[ipi] could not reserve interrupt vector for remote calls, aborting...\n");
+        for(;;); // TODO: panic!
+    }
+    __atomic_store_n(&vector, reservedVector, __ATOMIC_RELEASE);
+
+    Logger::printFormat("[ipi] remote calls will use vector 0x%x\n", vector);
+
+}
+
+bool IPI::isInitialized() { return __atomic_load_n(&vector, __ATOMIC_ACQUIRE) != 0; }
+
+void IPI::runOnCPU(u8 core, EventHandler function, void *data) {
+
+    RemoteCall call(function, data);
+    runOnCores(1ull << core, call);
+    call.wait();
+
+}
+
+void IPI::runOnAll(EventHandler function, void *data, bool includeSelf) {
+
+    // current core cannot change between reading its ID and posting the call
+    RemoteCall call(function, data);
+    bool interruptState = CPU::enterCritical();
+    u64 cores = LAPIC::getOnlineCores();
+    if(!includeSelf) cores &= ~(1ull << CPU::getCoreAPICID());
+    runOnCores(cores, call);
+    CPU::exitCritical(interruptState);
+    call.wait();
+
+}
+
+usz IPI::runOnCores(u64 cores, RemoteCall& call) {
+
+    // keep current core fixed while posting, offline cores would never run the call
+    bool interruptState = CPU::enterCritical();
+    u64 selfBit = 1ull << CPU::getCoreAPICID();
+    cores &= LAPIC::getOnlineCores() | selfBit;
+    if(!isInitialized()) cores &= selfBit;
+
+    // call without targets is completed right away
+    call.finished = false;
+    if(cores == 0) {
+        finish(&call);
+        CPU::exitCritical(interruptState);
+        return 0;
+    }
+
+    // count cores before posting anything, as the counter is decremented by them
+    __atomic_store_n(&call.pendingCores, CPU::countCores(cores), __ATOMIC_RELEASE);
+
+    // queue the call, core needs an IPI only if its queue was empty (otherwise it is going to take the queue anyway)
+    u64 interruptedCores = 0;
+    for(u32 i = 0; i < CPU::maxCoreCount; i++) {
+        u64 bit = 1ull << i;
+        if(!(cores & bit) || bit == selfBit) continue;
+        RemoteCall::Entry *entry = allocateEntry();
+        entry->call = &call;
+        if(queues[static_cast<u8>(i)].push(entry)) interruptedCores |= bit;
+        else coalescedCount.add();
+    }
+    if(interruptedCores != 0) LAPIC::sendIPIToMask(interruptedCores, vector);
+    usz ipisSent = CPU::countCores(interruptedCores);
+    ipiCount.add(ipisSent);
+
+    // run the call locally meanwhile, in the same conditions as remote cores do (with interrupts disabled)
+    if(cores & selfBit) runCall(&call);
+    CPU::exitCritical(interruptState);
+    return ipisSent;
+
+}
+
+void IPI::postToCPU(u8 core, EventHandler function, void *data) {
+
+    // nobody waits for the call, the core which runs it frees it
+    RemoteCall *call = new RemoteCall(function, data);
+    call->owned = true;
+    runOnCores(1ull << core, *call);
+
+}
+
+void IPI::processPendingCalls() {
+
+    // take whole queue of this core (consumer must not move to other core meanwhile)
+    bool interruptState = CPU::enterCritical();
+    RemoteCall::Entry *entry = queues.get().takeAll();
+    while(entry != nullptr) {
+
+        // entry may be gone once its call finishes, so the next one is read before
+        RemoteCall::Entry *next = CallQueue::getNext(entry);
+        runEntry(entry);
+        entry = next;
+
+    }
+    CPU::exitCritical(interruptState);
+
+}
+
+IPI::Statistics IPI::getStatistics() {
+
+    Statistics snapshot;
+    snapshot.calls = callCount.sum();
+    snapshot.ipisSent = ipiCount.sum();
+    snapshot.coalescedCalls = coalescedCount.sum();
+    return snapshot;
+
+}
+
+RemoteCall::Entry *IPI::allocateEntry() {
+
+    // called with interrupts disabled, so only remote cores (returning entries) change the pool meanwhile
+    EntryPool& pool = entryPools.get();
+    for(;;) {
+
+        // take free entry, if there is none, service own queue until remote cores return some
+        u64 freeEntries = ~__atomic_load_n(&pool.usedEntries, __ATOMIC_ACQUIRE);
+        if(freeEntries == 0) {
+            processPendingCalls();
+            CPU::pause();
+            continue;
+        }
+        usz index = __builtin_ctzll(freeEntries);
+        __atomic_fetch_or(&pool.usedEntries, 1ull << index, __ATOMIC_ACQ_REL);
+        RemoteCall::Entry *entry = &pool.entries[index];
+        entry->ownerCore = CPU::getCoreAPICID();
+        return entry;
+
+    }
+
+}
+
+void IPI::runEntry(RemoteCall::Entry *entry) {
+
+    // entry is not needed once its call is known, return it to pool of posting core right away
+    RemoteCall *call = entry->call;
+    EntryPool& pool = entryPools[entry->ownerCore];
+    __atomic_fetch_and(&pool.usedEntries, ~(1ull << (entry - pool.entries)), __ATOMIC_RELEASE);
+    runCall(call);
+
+}
+
+void IPI::runCall(RemoteCall *call) {
+
+    // run the function and acknowledge, last core finishes the call
+    call->function(call->data);
+    callCount.add();
+    if(__atomic_sub_fetch(&call->pendingCores, 1, __ATOMIC_ACQ_REL) == 0) finish(call);
+
+}
+
+void IPI::finish(RemoteCall *call) {
+
+    // completion runs before the call is marked finished, as the owner may destroy it right after
+    if(call->completion != nullptr) call->completion(call->data);
+    if(call->owned) {
+        call->finished = true;
+        delete call;
+        return;
+    }
+    __atomic_store_n(&call->finished, true, __ATOMIC_RELEASE);
+
+}
+
+void IPI::interruptHandler(void *, u32) {
+
+    // just service the queue
+    processPendingCalls();
+
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include <driver/arch/cpu.h>
+#include <util/mpsc.h>
+#include <util/percpu.h>
+#include <util/types.h>
+
+/**
+ * @brief Request of running function on other cores (in their interrupt context), it has to stay alive until it
+ *        completes and it can be posted again only after that
+ */
+class RemoteCall {
+
+public:
+
+    /**
+     * @brief Constructor
+     * @param function Function run on every target core
+     * @param data Data passed to the function
+     * @param completion Function run (with the same data) by core which finishes last, nullptr if not needed
+     */
+    RemoteCall(EventHandler function, void *data, EventHandler completion = nullptr);
+    RemoteCall(const RemoteCall &) = delete;
+    RemoteCall(RemoteCall &&) = delete;
+
+    /**
+     * @brief Destructor - waits until all target cores ran the function
+     */
+    ~RemoteCall();
+
+    /**
+     * @brief Returns whether all target cores ran the function
+     * @return true if call was completed, false otherwise
+     */
+    bool completed();
+
+    /**
+     * @brief Waits until all target cores ran the function, calls queued for current core are run meanwhile
+     */
+    void wait();
+
+private:
+
+    friend class IPI;
+
+    struct Entry {
+        MPSCLink<Entry> link;
+        RemoteCall *call = nullptr;
+        u8 ownerCore = 0;
+    };
+
+    EventHandler function;
+    void *data;
+    EventHandler completion;
+    u64 pendingCores = 0;
+    bool finished = true;
+    bool owned = false;
+
+};
+
+/**
+ * @brief Class running functions on other cores - every core has lock-free queue of calls, IPI is sent only when the
+ *        queue was empty (so that calls posted in bursts share single interrupt)
+ */
+class IPI {
+
+public:
+
+    /**
+     * @brief Statistics of remote calls
+     */
+    struct Statistics {
+        u64 calls;
+        u64 ipisSent;
+        u64 coalescedCalls;
+    };
+
+    /**
+     * @brief Reserves vector of remote call IPIs, has to be called once (by BSP) after interrupts are initialized
+     */
+    static void initialize();
+
+    /**
+     * @brief Returns whether remote calls can be used
+     * @return true if IPI vector was reserved, false otherwise
+     */
+    static bool isInitialized();
+
+    /**
+     * @brief Runs function on given core and waits until it returns
+     * @param core LAPIC ID of the core (function is run directly, with interrupts disabled, if it is the current one)
+     * @param function Function to be run
+     * @param data Data passed to the function
+     */
+    static void runOnCPU(u8 core, EventHandler function, void *data);
+
+    /**
+     * @brief Runs function on all online cores and waits until all of them returned
+     * @param function Function to be run
+     * @param data Data passed to the function
+     * @param includeSelf Whether function should be run on current core as well
+     */
+    static void runOnAll(EventHandler function, void *data, bool includeSelf = true);
+
+    /**
+     * @brief Posts call to given cores without waiting, completion is checked or awaited on the call itself
+     * @param cores Bitmask of target cores, indexed by LAPIC ID (cores which are not online are skipped)
+     * @param call Call to be run, it must not be pending already
+     * @return Count of IPIs sent
+     */
+    static usz runOnCores(u64 cores, RemoteCall& call);
+
+    /**
+     * @brief Posts function to given core without waiting for it or keeping any handle (call is freed by the core)
+     * @param core LAPIC ID of the core
+     * @param function Function to be run
+     * @param data Data passed to the function
+     */
+    static void postToCPU(u8 core, EventHandler function, void *data);
+
+    /**
+     * @brief Runs all calls queued for currently executing core
+     */
+    static void processPendingCalls();
+
+    /**
+     * @brief Returns snapshot of remote call statistics
+     * @return Current statistics
+     */
+    static Statistics getStatistics();
+
+private:
+
+    using CallQueue = MPSCQueue<RemoteCall::Entry, &RemoteCall::Entry::link>;
+
+    // queue entries are taken from pool of posting core (not from the call), so that calls are small enough for stack
+    struct EntryPool {
+        RemoteCall::Entry entries[64];
+        u64 usedEntries;
+    };
+
+    static RemoteCall::Entry *allocateEntry();
+    static void runEntry(RemoteCall::Entry *entry);
+    static void runCall(RemoteCall *call);
+    static void finish(RemoteCall *call);
+    static void interruptHandler(void *, u32);
+
+    static inline PerCPU<CallQueue> queues;
+    static inline PerCPU<EntryPool> entryPools;
+    static inline u8 vector = 0;
+    static inline PerCPUCounter callCount;
+    static inline PerCPUCounter ipiCount;
+    static inline PerCPUCounter coalescedCount;
+
+};
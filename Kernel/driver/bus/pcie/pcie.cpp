@@ -1,10 +1,10 @@
 #include "driver/bus/pcie/pcie.h"
+#include "sched/bootgraph.h"
 
 void PCIe::initialize() {
 
-    // create descriptors and devices list
-    segments = new List<PCIeBusSegment*>();
-    devices = new List<PCIDevice*>();
+    // create descriptors list
+    segments = new Vector<PCIeBusSegment*>();
 
     // get MCFG table
     void *mcfg = ACPI::getTableBySignature("MCFG");
@@ -44,65 +44,83 @@ void PCIe::initialize() {
 
     // enumerate devices
     Logger::printFormat("[pcie] enumerating all devices...\n");
-    enumerateDevices();
+    Registry *newRegistry = new Registry;
+    enumerateDevices(newRegistry);
 
-}
-
-void PCIe::getDevicesByClassCodes(List<PCIDevice*> *list, u8 classCode, u8 subclassCode, u8 interface) {
-
-    // iterate through all registered devices and get relevant ones
-    for(usz i = 0; i < devices->size(); i++) {
+    // publish complete registry, lookups read it under RCU without locking
+    RCU::assign(registry, newRegistry);
 
-        // get device
-        PCIDevice *device = devices->get(i);
+}
 
-        // check device's class codes
-        if(device->getClassCode() == classCode && device->getSubclassCode() == subclassCode && device->getProgrammingInterface() == interface) {
-            list->appendBack(device);
-        }
+void PCIe::getDevicesByClassCodes(Vector<PCIDevice*> *list, u8 classCode, u8 subclassCode, u8 interface) {
 
-    }
+    // look up devices with given class codes, they were grouped during enumeration
+    ScopedRCURead read;
+    Registry *currentRegistry = RCU::dereference(registry);
+    if(currentRegistry == nullptr) return;
+    Vector<PCIDevice*> **matching = currentRegistry->devicesByClass.find(classCodesKey(classCode, subclassCode, interface));
+    if(matching == nullptr) return;
+    (*matching)->forEach([&](PCIDevice *device) { list->appendBack(device); });
 
 }
 
-void PCIe::enumerateDevices() {
+void PCIe::enumerateDevices(Registry *newRegistry) {
 
-    // brute force enumaration
+    // brute force enumaration, segments are independent, so they are enumerated concurrently during boot
     
     Logger::printFormat("[pcie] segments count: %u\n", segments->size());
 
+    SegmentEnumeration *enumerations = new SegmentEnumeration[segments->size()];
     for(usz segment = 0; segment < segments->size(); segment++) {
+        enumerations[segment].segment = segments->get(segment);
+        enumerations[segment].task = BootGraph::spawn("pcie segment", &PCIe::enumerateSegment, &enumerations[segment]);
+    }
 
-        PCIeBusSegment *busSegment = segments->get(segment);
+    // add found devices to the registry and group them by their class codes (in order of segments)
+    for(usz segment = 0; segment < segments->size(); segment++) {
+        BootGraph::waitFor(enumerations[segment].task);
+        enumerations[segment].devices.forEach([&](PCIDevice *foundDevice) {
+            newRegistry->devices.appendBack(foundDevice);
+            u32 key = classCodesKey(foundDevice->getClassCode(), foundDevice->getSubclassCode(), foundDevice->getProgrammingInterface());
+            Vector<PCIDevice*> **group = newRegistry->devicesByClass.find(key);
+            if(group == nullptr) group = newRegistry->devicesByClass.insert(key, new Vector<PCIDevice*>());
+            (*group)->appendBack(foundDevice);
+        });
+    }
+    delete[] enumerations;
 
-        // for every segment enumerate all buses
-        for(u16 bus = busSegment->pciBusNumberStart; bus <= busSegment->pciBusNumberEnd; bus++) {
+}
 
-            // for every bus, enumerate all devices
-            for(u8 device = 0; device < 32; device++) {
+void PCIe::enumerateSegment(void *enumeration) {
 
-                // for every device enumerate all functions
-                for(u8 function = 0; function < 8; function++) {
+    // for every segment enumerate all buses
+    SegmentEnumeration *segmentEnumeration = reinterpret_cast<SegmentEnumeration*>(enumeration);
+    PCIeBusSegment *busSegment = segmentEnumeration->segment;
+    for(u16 bus = busSegment->pciBusNumberStart; bus <= busSegment->pciBusNumberEnd; bus++) {
 
-                    // read word and check
-                    u32 identification = busSegment->read(bus, device, function, 0);
-                    if((identification & 0xffff) != 0xffff) {
+        // for every bus, enumerate all devices
+        for(u8 device = 0; device < 32; device++) {
 
-                        // found a device, create object of it
-                        PCIDevice *foundDevice = new PCIDevice(busSegment, static_cast<u8>(bus), device, function);
-                        Logger::printFormat("[pcie]   - at %u:%u:%u:%u - 0x%x:0x%x, class: %u, subclass: %u, prog if: %u (header type: %u)\n",
-                                            busSegment->groupNumber, bus, device, function,
-                                            foundDevice->getVendorID(), foundDevice->getDeviceID(),
-                                            foundDevice->getClassCode(), foundDevice->getSubclassCode(),
-                                            foundDevice->getProgrammingInterface(), foundDevice->getHeaderType());
-                        
-                        // dump capabilities of found device
-                        foundDevice->dumpCapabilities();
+            // for every device enumerate all functions
+            for(u8 function = 0; function < 8; function++) {
 
-                        // add newly found device to devices list
-                        devices->appendBack(foundDevice);
+                // read word and check
+                u32 identification = busSegment->read(bus, device, function, 0);
+                if((identification & 0xffff) != 0xffff) {
 
-                    }
+                    // found a device, create object of it
+                    PCIDevice *foundDevice = new PCIDevice(busSegment, static_cast<u8>(bus), device, function);
+                    Logger::printFormat("[pcie]   - at %u:%u:%u:%u - 0x%x:0x%x, class: %u, subclass: %u, prog if: %u (header type: %u)\n",
+                                        busSegment->groupNumber, bus, device, function,
+                                        foundDevice->getVendorID(), foundDevice->getDeviceID(),
+                                        foundDevice->getClassCode(), foundDevice->getSubclassCode(),
+                                        foundDevice->getProgrammingInterface(), foundDevice->getHeaderType());
+                    
+                    // dump capabilities of found device
+                    foundDevice->dumpCapabilities();
+
+                    // add newly found device to devices of the segment, registry is built once all segments are done
+                    segmentEnumeration->devices.appendBack(foundDevice);
 
                 }
 
@@ -114,6 +132,13 @@ void PCIe::enumerateDevices() {
 
 }
 
+u32 PCIe::classCodesKey(u8 classCode, u8 subclassCode, u8 interface) {
+
+    // same layout as in class codes register, without revision ID
+    return static_cast<u32>(classCode) << 16 | static_cast<u32>(subclassCode) << 8 | interface;
+
+}
+
 u32 PCIeBusSegment::read(u8 bus, u8 device, u8 function, u16 offset) {
 
     // check bounds
@@ -149,7 +174,7 @@ PCIDevice::PCIDevice(PCIeBusSegment *busSegment, u8 bus, u8 device, u8 function)
     : segment(busSegment), busNumber(bus), deviceNumber(device), functionNumber(function) {
     
     // create capability list
-    capabilities = new List<Capability>();
+    capabilities = new Vector<Capability>();
 
     // get basic info about pci device in question, start with vendor and device ids
     u32 identification = read(identificationOffset);
@@ -220,6 +245,14 @@ u32 PCIDevice::getBARValue(u8 barNumber) {
 
 }
 
+bool PCIDevice::isBARPrefetchable(u8 barNumber) {
+
+    // only memory BARs can be prefetchable
+    u32 value = getBARValue(barNumber);
+    return !(value & barIOSpaceBit) && (value & barPrefetchableBit);
+
+}
+
 bool PCIDevice::supportsMSI() { return msiSupported; }
 
 void PCIDevice::enableMSI(u8 vector) {
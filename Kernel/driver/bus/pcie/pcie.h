@@ -1,6 +1,8 @@
 #pragma once
 #include <util/types.h>
-#include <util/list.h>
+#include <util/hashmap.h>
+#include <util/rcu.h>
+#include <util/vector.h>
 #include <driver/acpi/acpibase.h>
 #include <driver/arch/ints.h>
 #include <mem/vas.h>
@@ -78,7 +80,7 @@ public:
      * @param subclassCode Subclass Code of searched devices
      * @param interface Interface value of searched devices
      */
-    static void getDevicesByClassCodes(List<PCIDevice*> *list, u8 classCode, u8 subclassCode, u8 interface);
+    static void getDevicesByClassCodes(Vector<PCIDevice*> *list, u8 classCode, u8 subclassCode, u8 interface);
 
 private:
     
@@ -95,11 +97,24 @@ private:
         PCIeSegmentDescriptor decriptors[1];
     } __attribute__((packed));
 
-    static void enumerateDevices();
+    struct Registry {
+        Vector<PCIDevice*> devices;
+        HashMap<u32, Vector<PCIDevice*>*> devicesByClass;
+    };
+
+    struct SegmentEnumeration {
+        PCIeBusSegment *segment;
+        Vector<PCIDevice*> devices;
+        usz task;
+    };
+
+    static void enumerateDevices(Registry *newRegistry);
+    static void enumerateSegment(void *enumeration);
+    static u32 classCodesKey(u8 classCode, u8 subclassCode, u8 interface);
 
     static inline MCFG *mcfgTable = nullptr;
-    static inline List<PCIeBusSegment*> *segments = nullptr;
-    static inline List<PCIDevice*> *devices = nullptr;
+    static inline Vector<PCIeBusSegment*> *segments = nullptr;
+    static inline Registry *registry = nullptr;
 
 };
 
@@ -168,6 +183,13 @@ public:
      */
     u32 getBARValue(u8 barNumber);
 
+    /**
+     * @brief Returns whether BAR describes prefetchable memory (which may be mapped as write-combining)
+     * @param barNumber Number of the BAR in question (0-5)
+     * @return true if BAR is prefetchable memory BAR, false otherwise
+     */
+    bool isBARPrefetchable(u8 barNumber);
+
     /**
      * @brief Returns whether device supports MSI operation
      * @return true if MSI is supported by the device, false otherwise
@@ -209,6 +231,9 @@ private:
     static constexpr u16 barOffset = 0x10;
     static constexpr u16 capabilityOffset = 0x34;
 
+    static constexpr u32 barIOSpaceBit = (1u << 0);
+    static constexpr u32 barPrefetchableBit = (1u << 3);
+
     static constexpr u8 msiCapabilityID = 0x05;
 
     static const char *getCapabilityReadableString(u8 capabilityID);
@@ -229,7 +254,7 @@ private:
     u8 revisionID;
     u8 headerType;
 
-    List<Capability> *capabilities = nullptr;
+    Vector<Capability> *capabilities = nullptr;
     bool msiSupported = false;
     Capability msiCapability;
 
@@ -2,6 +2,13 @@
 #include <util/types.h>
 #include <mem/vas.h>
 
+/**
+ * @brief Callback called once request of block device finished
+ * @param data Data passed along with the request
+ * @param success Whether all sectors of the request were transferred
+ */
+using BlockRequestHandler = void (*)(void *data, bool success);
+
 /**
  * @brief Interface encapsulating block device
  */
@@ -20,26 +27,32 @@ public:
      */
     virtual usz sectorCount() = 0;
 
+    /**
+     * @brief Returns sector size of the device
+     * @return Size of single sector in bytes
+     */
+    virtual usz sectorSize() = 0;
+
     /**
      * @brief Reads specified sectors from block device
      * @param sector Sector to start disk access
      * @param count How many sectors to read
      * @param buffer Buffer where the data should be read
-     * @param handler Callback to be called after reading
+     * @param handler Callback to be called after reading (with result of the read)
      * @param handlerData Data to passed to callback function
      * @return true if request was successfully sent, false otherwise
      */
-    virtual bool read(usz sector, usz count, VirtualMemoryObject *buffer, EventHandler handler, void *handlerData) = 0;
+    virtual bool read(usz sector, usz count, VirtualMemoryObject *buffer, BlockRequestHandler handler, void *handlerData) = 0;
 
     /**
      * @brief Writes specified sectors to block device
      * @param sector Sector to start disk access
      * @param count How many sectors to write
      * @param buffer Buffer from where the data should be written
-     * @param handler Callback to be called after writing
+     * @param handler Callback to be called after writing (with result of the write)
      * @param handlerData Data to passed to callback function
      * @return true if request was successfully sent, false otherwise
      */
-    virtual bool write(usz sector, usz count, VirtualMemoryObject *buffer, EventHandler handler, void *handlerData) = 0;
+    virtual bool write(usz sector, usz count, VirtualMemoryObject *buffer, BlockRequestHandler handler, void *handlerData) = 0;
 
 };
\ No newline at end of file
@@ -1,26 +1,35 @@
+#include <bench/bench.h>
 #include <driver/acpi/acpibase.h>
 #include <driver/ahci/ahcibase.h>
 #include <driver/arch/cpu.h>
 #include <driver/arch/apic.h>
 #include <driver/arch/gdt.h>
 #include <driver/arch/ints.h>
+#include <driver/arch/ipi.h>
 #include <driver/arch/hpet.h>
 #include <driver/bus/pcie/pcie.h>
 #include <driver/text/serial.h>
 #include <driver/text/graphicsterm.h>
 #include <mem/heap.h>
+#include <mem/kmap.h>
 #include <mem/physalloc.h>
+#include <mem/tlb.h>
 #include <mem/vas.h>
+#include <sched/bootgraph.h>
+#include <sched/idle.h>
+#include <sched/scheduler.h>
+#include <sched/workqueue.h>
 #include <util/bootboot.h>
+#include <util/lockstat.h>
 #include <util/logger.h>
 #include <util/spinlock.h>
-#include <util/list.h>
+#include <util/vector.h>
 #include <util/timer.h>
 
 extern BootBoot::Structure bootboot;
 extern u8 fb;
 
-int kernelInitializationStage = 0;
+u32 kernelInitializationStage = 0;
 
 extern "C"
 void kernelMain() {
@@ -28,18 +37,24 @@ void kernelMain() {
     // disable interrupts if they are for some reason enabled
     // CPU::setInterruptState(false);
 
+    // point GS base to data block of this core first, all per-core accessors depend on it
+    CPU::initializeCoreData();
+
     // activate all needed CPU extensions
     CPU::enableNXBit();
     CPU::enableSystemCallExtensions();
+    CPU::enableGlobalPages();
+    CPU::enableProcessContextIdentifiers();
+    CPU::initializePAT();
 
     // wait with other cores than BSP until main system parts are initialized
     if(CPU::getCoreAPICID() != bootboot.bspID) {
 
-        // wait until BSP completed basic setup of kernel
-        while(kernelInitializationStage == 0);
+        // wait until BSP completed basic setup of kernel (interrupts cannot be used yet, so the core sleeps on the stage itself if possible)
+        Idle::waitWhileEqual(&kernelInitializationStage, 0);
 
         // reload virtual address space
-        CPU::writeCR3(reinterpret_cast<u64>(VirtualAddressSpace::getKernelVirtualAddressSpace()->getCR3()));
+        VirtualAddressSpace::getKernelVirtualAddressSpace()->activate();
 
         // load GDT and IDT
         GDT::switchKernelSegments();
@@ -48,11 +63,28 @@ void kernelMain() {
         // if kernel initialized enough, initialize APICs of other cores
         LAPIC::initializeCoreLAPIC();
 
-        // enable interrupts on other cores
-        // CPU::setInterruptState(true);
+        // drop entries cached before the core could receive shootdowns
+        CPU::flushGlobalTLB();
+
+        // enable interrupts on other cores (needed to service TLB shootdowns)
+        CPU::setInterruptState(true);
+
+        // sleep until scheduler is initialized, BSP wakes the core when stage changes
+        while(__atomic_load_n(&kernelInitializationStage, __ATOMIC_ACQUIRE) == 1) {
+
+            // take part in boot stages which can run concurrently (readying a stage wakes the core)
+            BootGraph::serviceSecondaryCore();
 
-        // wait a bunch of time until scheduler is initialized
-        while(kernelInitializationStage == 1);
+#ifdef KERNEL_BENCHMARKS
+            // take part in benchmarks running on all cores (posting a job wakes the core)
+            Benchmarks::serviceSecondaryCore();
+#endif
+            Idle::wait();
+        }
+
+        // start scheduling on this core, boot context is not needed anymore (idle thread of the core takes over)
+        Scheduler::initializeCore("boot");
+        Scheduler::exit();
         
     }
 
@@ -65,6 +97,7 @@ void kernelMain() {
     // print some crucial information
     Logger::printFormat("[main] bootstrap processor id: %u\n", bootboot.bspID);
     Logger::printFormat("[main] core count: %u\n", bootboot.coreCount);
+    Logger::printFormat("[main] per-core data reached through GS base, FSGSBASE instructions used?: %b\n", CPU::fsgsBaseEnabled());
 
     // switch to higher half entirely
     VirtualAddressSpace::adjustKernelMemory();
@@ -93,33 +126,74 @@ void kernelMain() {
     Interrupts::loadIDT();
     CPU::setInterruptState(true);
 
+    // initialize remote calls (used by TLB shootdowns) and temporary kernel mappings
+    IPI::initialize();
+    KernelMap::initialize();
+
+    // initialize sleeping of idle cores
+    Idle::initialize();
+
     // initialize HPET subsystem
     HPET::initialize();
 
+    // progress other cores, they help with boot stages from now on
+    Logger::printFormat("[main] progressing cores other than BSP...\n");
+    __atomic_store_n(&kernelInitializationStage, 1, __ATOMIC_RELEASE);
+
+    // map framebuffer as write-combining, so that pixel stores are merged into bursts
+    void *framebuffer = reinterpret_cast<void*>(&fb);
+    if(CPU::pageAttributeTableEnabled()) {
+        usz framebufferPhysical = bootboot.framebufferPointer - CPU::pagingBase;
+        MMIOVirtualMemoryObject *framebufferObject = new MMIOVirtualMemoryObject(reinterpret_cast<void*>(framebufferPhysical), static_cast<usz>(bootboot.framebufferScanline) * bootboot.framebufferHeight);
+        framebufferObject->setCacheMode(VirtualMemoryObject::CacheMode::WriteCombining);
+        framebuffer = VirtualAddressSpace::getKernelVirtualAddressSpace()->mapObject(framebufferObject);
+    }
+
     // initialize graphics terminal
-    GraphicsTerminal *terminal = new GraphicsTerminal(reinterpret_cast<void*>(&fb), bootboot.framebufferWidth, bootboot.framebufferHeight, bootboot.framebufferScanline, bootboot.framebufferType);
+    GraphicsTerminal *terminal = new GraphicsTerminal(framebuffer, bootboot.framebufferWidth, bootboot.framebufferHeight, bootboot.framebufferScanline, bootboot.framebufferType);
     Logger::setBackingDevice(terminal);
 
-    // initialize PCIe subsystem
-    PCIe::initialize();
-
-    // initialize AHCI subsystem
-    AHCI::initialize();
-    List<IBlockDevice*> *blockDevices = AHCI::getBlockDevices();
-    for(usz i = 0; i < blockDevices->size(); i++) {
-        IBlockDevice *device = blockDevices->get(i);
-        Logger::printFormat("[main] found block device of size 0x%x sectors, writeable?: %b\n", device->sectorCount(), device->isWriteable());
+    // initialize PCIe and AHCI subsystems, they split their work (segments, controllers and ports) between all cores
+    usz pcieStage = BootGraph::addTask("pcie", [](void *) { PCIe::initialize(); });
+    usz ahciStage = BootGraph::addTask("ahci", [](void *) { AHCI::initialize(); });
+    BootGraph::addDependency(ahciStage, pcieStage);
+    BootGraph::run();
+    {
+        ScopedRCURead read;
+        Vector<IBlockDevice*> *blockDevices = AHCI::getBlockDevices();
+        for(usz i = 0; i < blockDevices->size(); i++) {
+            IBlockDevice *device = blockDevices->get(i);
+            Logger::printFormat("[main] found block device of size 0x%x sectors, writeable?: %b\n", device->sectorCount(), device->isWriteable());
+        }
     }
 
-    // progress other cores
-    Logger::printFormat("[main] progressing cores other than BSP...\n");
-    kernelInitializationStage = 1;
+#ifdef KERNEL_BENCHMARKS
+    // run microbenchmarks of kernel subsystems (some of them use other cores, so they are run after their startup)
+    Benchmarks::runAll();
+#endif
+
+    // start scheduling, this context continues as the main thread and other cores join
+    Scheduler::initialize();
+    Scheduler::initializeCore("main");
+    Workqueue::initialize();
+    __atomic_store_n(&kernelInitializationStage, 2, __ATOMIC_RELEASE);
+    Idle::wakeAll();
+
+#ifdef KERNEL_BENCHMARKS
+    // run benchmarks of the scheduler, which need all cores scheduling
+    Benchmarks::runScheduled();
+#endif
+
+#ifdef KERNEL_LOCKSTAT
+    // show which locks were contended during initialization
+    LockStatistics::dump();
+#endif
 
     // show welcome message
     Logger::printFormat("[main] welcome to con64OS\n");
     Logger::printFormat("[main] kernel initialized successfully...\n");
 
-    for(;;);
-    return;
+    // main thread is done, its core continues with other threads
+    Scheduler::exit();
 
 }
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "mem/extents.h"
+
+ExtentList::~ExtentList() {
+
+    delete[] extents;
+
+}
+
+void ExtentList::append(void *page, usz pageSize) {
+
+    appendRun(page, 1, pageSize);
+
+}
+
+void ExtentList::appendRun(void *address, usz pageCount, usz pageSize) {
+
+    if(pageCount == 0) return;
+
+    // extend last extent if the run continues it
+    usz physical = reinterpret_cast<usz>(address);
+    if(count > 0) {
+        Extent& last = extents[count - 1];
+        if(last.pageSize == pageSize && last.address + last.pageCount * last.pageSize == physical) {
+            last.pageCount += pageCount;
+            pages += pageCount;
+            bytes += pageCount * pageSize;
+            return;
+        }
+    }
+
+    // grow the array if needed (objects usually have single or few extents)
+    if(count == capacity) {
+        usz newCapacity = (capacity == 0) ? 4 : capacity * 2;
+        Extent *newExtents = new Extent[newCapacity];
+        for(usz i = 0; i < count; i++) newExtents[i] = extents[i];
+        delete[] extents;
+        extents = newExtents;
+        capacity = newCapacity;
+    }
+
+    // add new extent
+    extents[count++] = Extent { physical, pageCount, pageSize, pages, bytes };
+    pages += pageCount;
+    bytes += pageCount * pageSize;
+
+}
+
+usz ExtentList::extentCount() { return count; }
+const Extent& ExtentList::getExtent(usz index) { return extents[index]; }
+usz ExtentList::pageCount() { return pages; }
+usz ExtentList::size() { return bytes; }
+
+void *ExtentList::getPage(usz index) {
+
+    if(index >= pages) return nullptr;
+    Extent& extent = extents[findExtent(index, false)];
+    return reinterpret_cast<void*>(extent.address + (index - extent.firstPage) * extent.pageSize);
+
+}
+
+void *ExtentList::getPhysicalAddress(usz offset) {
+
+    if(offset >= bytes) return nullptr;
+    Extent& extent = extents[findExtent(offset, true)];
+    return reinterpret_cast<void*>(extent.address + (offset - extent.offset));
+
+}
+
+const Extent& ExtentList::getExtentAt(usz offset) { return extents[findExtent(offset, true)]; }
+
+usz ExtentList::findExtent(usz value, bool byOffset) {
+
+    // binary search for last extent starting at or before the value
+    usz low = 0, high = count;
+    while(high - low > 1) {
+        usz middle = (low + high) / 2;
+        usz start = byOffset ? extents[middle].offset : extents[middle].firstPage;
+        if(start <= value) low = middle;
+        else high = middle;
+    }
+    return low;
+
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <mem/physalloc.h>
+#include <util/types.h>
+
+/**
+ * @brief Structure describing run of physically contiguous pages of the same size
+ */
+struct Extent {
+    usz address;
+    usz pageCount;
+    usz pageSize;
+    usz firstPage;
+    usz offset;
+};
+
+/**
+ * @brief Class encapsulating compact array of physical extents, describing pages of memory object
+ */
+class ExtentList {
+
+public:
+
+    ExtentList() = default;
+    ExtentList(const ExtentList &) = delete;
+    ExtentList(ExtentList &&) = delete;
+
+    /**
+     * @brief Destructor - frees the array (pages themselves are not freed)
+     */
+    ~ExtentList();
+
+    /**
+     * @brief Appends page at the end, it is merged into last extent if it is physically contiguous with it
+     * @param page Physical address of page
+     * @param pageSize Size of the page
+     */
+    void append(void *page, usz pageSize = PhysicalAllocator::pageSize);
+
+    /**
+     * @brief Appends run of physically contiguous pages at the end
+     * @param address Physical address of first page
+     * @param pageCount Count of pages in run
+     * @param pageSize Size of every page in run
+     */
+    void appendRun(void *address, usz pageCount, usz pageSize = PhysicalAllocator::pageSize);
+
+    /**
+     * @brief Returns count of extents
+     * @return Count of extents
+     */
+    usz extentCount();
+
+    /**
+     * @brief Returns extent by its index
+     * @param index Index of extent
+     * @return Reference to extent
+     */
+    const Extent& getExtent(usz index);
+
+    /**
+     * @brief Returns count of pages (of any size) described by all extents
+     * @return Count of pages
+     */
+    usz pageCount();
+
+    /**
+     * @brief Returns count of bytes described by all extents
+     * @return Size in bytes
+     */
+    usz size();
+
+    /**
+     * @brief Returns page by its index in O(log n)
+     * @param index Index of page (pages of different sizes count as one)
+     * @return Physical address of page, nullptr if index is out of bounds
+     */
+    void *getPage(usz index);
+
+    /**
+     * @brief Returns physical address of byte at given offset in O(log n)
+     * @param offset Offset from the beginning of first extent
+     * @return Physical address, nullptr if offset is out of bounds
+     */
+    void *getPhysicalAddress(usz offset);
+
+    /**
+     * @brief Returns extent containing byte at given offset in O(log n)
+     * @param offset Offset from the beginning of first extent (has to be in bounds)
+     * @return Reference to extent
+     */
+    const Extent& getExtentAt(usz offset);
+
+    /**
+     * @brief Calls function for every extent
+     * @param function Function taking reference to extent
+     */
+    template<typename F>
+    void forEach(F function) {
+        for(usz i = 0; i < count; i++) function(extents[i]);
+    }
+
+private:
+
+    usz findExtent(usz value, bool byOffset);
+
+    Extent *extents = nullptr;
+    usz count = 0;
+    usz capacity = 0;
+    usz pages = 0;
+    usz bytes = 0;
+
+};
@@ -13,7 +13,7 @@ void Heap::initialize() {
 void *Heap::allocate(usz size) {
 
     // lock spinlock
-    ScopedSpinlock lock(heapSpinlock);
+    ScopedMCSLock lock(heapSpinlock);
 
     // adjust allocation size
     usz adjusted = ((size + (allocationAlignment - 1)) / allocationAlignment) * allocationAlignment;
@@ -48,7 +48,7 @@ void *Heap::allocate(usz size) {
 void Heap::free(void *address) {
 
     // lock spinlock
-    ScopedSpinlock lock(heapSpinlock);
+    ScopedMCSLock lock(heapSpinlock);
 
     // get addresses to AllocationDescriptor and ChunkInfoBlock
     ChunkInfoBlock *chunk = reinterpret_cast<ChunkInfoBlock*>(reinterpret_cast<u64>(address) & ~0x1fffff);
@@ -55,7 +55,7 @@ private:
 	static inline ChunkInfoBlock *chunkListFirst = nullptr;
 	static inline ChunkInfoBlock *chunkListLast = nullptr;
 	static inline usz chunkListLength = 0;
-	static inline Spinlock heapSpinlock;
+	static inline MCSLock heapSpinlock{"heap"};
 
 	static ChunkInfoBlock *allocateAndAppendNewChunk();
 	static void freeAndRemoveChunk(ChunkInfoBlock *chunk);
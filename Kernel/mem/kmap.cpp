@@ -0,0 +1,76 @@
+#include "mem/kmap.h"
+
+void KernelMap::initialize() {
+
+    // reserve window with slots of all cores
+    VirtualAddressSpace *kernelSpace = VirtualAddressSpace::getKernelVirtualAddressSpace();
+    usz slotCount = CPU::maxCoreCount * slotsPerCore;
+    windowAddress = reinterpret_cast<usz>(kernelSpace->mapObject(new ReservedVirtualMemoryObject(slotCount * PhysicalAllocator::pageSize)));
+    if(windowAddress == 0) {
+        Logger::printFormat("[kmap] could not reserve window for temporary mappings, aborting...\n");
+        for(;;); // TODO: panic!
+    }
+
+    // create page tables of the window upfront and remember its entries, so mapping is single store
+    entries = new u64[slotCount];
+    {
+        ScopedSpinlock lock(kernelSpace->spinlock);
+        for(usz i = 0; i < slotCount; i++) {
+            void *entry = kernelSpace->getMappingEntry(reinterpret_cast<void*>(windowAddress + i * PhysicalAllocator::pageSize), PhysicalAllocator::pageSize, true);
+            entries[i] = reinterpret_cast<u64>(entry);
+        }
+    }
+
+    Logger::printFormat("[kmap] %u slots per core reserved at 0x%x\n", slotsPerCore, windowAddress);
+
+}
+
+void *KernelMap::map(void *physicalAddress, VirtualMemoryObject::CacheMode mode, bool write) {
+
+    // claim free slot of this core (interrupts are disabled only to not race with handlers using slots too), thread
+    // stays on the core until the slot is unmapped
+    Scheduler::disablePreemption();
+    bool interruptState = CPU::enterCritical();
+    u8 core = CPU::getCoreAPICID();
+    u64 freeSlots = ~usedSlots[core] & ((1ull << slotsPerCore) - 1);
+    if(freeSlots == 0) {
+        CPU::exitCritical(interruptState);
+        Scheduler::enablePreemption();
+        return nullptr;
+    }
+    usz slot = __builtin_ctzll(freeSlots);
+    usedSlots[core] |= (1ull << slot);
+    CPU::exitCritical(interruptState);
+
+    // fill the entry, entry was not present, so there is nothing to invalidate
+    usz index = core * slotsPerCore + slot;
+    u8 flags = (write ? VirtualMemoryObject::writeable : 0) | (static_cast<u8>(mode) << VirtualMemoryObject::cacheModeShift);
+    u64 value = (reinterpret_cast<u64>(physicalAddress) & ~0xfffull) | VirtualAddressSpace::entryPresent | VirtualAddressSpace::entryExecutionDisable | VirtualAddressSpace::entryGlobal;
+    if(write) value |= VirtualAddressSpace::entryWriteEnable;
+    value |= VirtualAddressSpace::cacheModeBits(flags, PhysicalAllocator::pageSize);
+    __atomic_store_n(reinterpret_cast<u64*>(entries[index]), value, __ATOMIC_RELEASE);
+    return reinterpret_cast<void*>(windowAddress + index * PhysicalAllocator::pageSize);
+
+}
+
+void KernelMap::unmap(void *address) {
+
+    // find slot, it has to belong to this core
+    usz index = (reinterpret_cast<usz>(address) - windowAddress) / PhysicalAllocator::pageSize;
+    u8 core = CPU::getCoreAPICID();
+    if(index / slotsPerCore != core) {
+        Logger::printFormat("[kmap] slot 0x%x unmapped by core %u which does not own it, aborting...\n", reinterpret_cast<usz>(address), core);
+        for(;;); // TODO: panic!
+    }
+
+    // clear the entry and invalidate it locally, no other core could have used it
+    __atomic_store_n(reinterpret_cast<u64*>(entries[index]), 0ull, __ATOMIC_RELEASE);
+    CPU::invalidatePagingEntry(reinterpret_cast<void*>(windowAddress + index * PhysicalAllocator::pageSize));
+
+    // free the slot
+    bool interruptState = CPU::enterCritical();
+    usedSlots[core] &= ~(1ull << (index % slotsPerCore));
+    CPU::exitCritical(interruptState);
+    Scheduler::enablePreemption();
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <driver/arch/cpu.h>
+#include <mem/physalloc.h>
+#include <mem/vas.h>
+#include <sched/scheduler.h>
+#include <util/logger.h>
+#include <util/types.h>
+
+/**
+ * @brief Class managing per-core slots for short-lived kernel mappings of single pages
+ * @note Mappings are private to the core which created them (entries are invalidated only locally), so they cannot be passed to other cores
+ */
+class KernelMap {
+
+public:
+
+    /**
+     * @brief Count of slots available to every core
+     */
+    static constexpr usz slotsPerCore = 16;
+
+    /**
+     * @brief Reserves window of slots in kernel address space and prepares its page tables
+     */
+    static void initialize();
+
+    /**
+     * @brief Maps physical page into free slot of currently executing core (without locks and heap allocations)
+     * @param physicalAddress Address of page to be mapped
+     * @param mode Memory type of the mapping
+     * @param write Whether mapping should be writeable
+     * @return Virtual address of mapped page, nullptr if all slots of the core are in use
+     */
+    static void *map(void *physicalAddress, VirtualMemoryObject::CacheMode mode = VirtualMemoryObject::CacheMode::WriteBack, bool write = true);
+
+    /**
+     * @brief Removes mapping created by map on the same core and frees its slot
+     * @param address Address returned by map
+     */
+    static void unmap(void *address);
+
+private:
+
+    static inline usz windowAddress = 0;
+    static inline u64 *entries = nullptr;
+    static inline u64 usedSlots[CPU::maxCoreCount] = {};
+
+};
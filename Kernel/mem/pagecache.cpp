@@ -0,0 +1,156 @@
+#include "mem/pagecache.h"
+
+static void *allocateZeroedPage() {
+
+    // allocate page and zero it using direct mapping
+    void *page = PhysicalAllocator::allocatePage(kernelPID);
+    usz *array = reinterpret_cast<usz*>(reinterpret_cast<usz>(page) + CPU::pagingBase);
+    for(usz i = 0; i < PhysicalAllocator::pageSize / sizeof(usz); i++) array[i] = 0ull;
+    return page;
+
+}
+
+void *PageCache::getPage(IBlockDevice *device, usz pageIndex) {
+
+    // page has to consist of whole sectors, cache of device is created by the first read
+    if(device->sectorSize() > PhysicalAllocator::pageSize) return nullptr;
+    DeviceCache *cache = getDeviceCache(device, false);
+    if(cache == nullptr) return reinterpret_cast<void*>(VirtualMemoryObject::faultRetry);
+    if(pageIndex >= cache->pageCount) return nullptr;
+
+    // only look the page up, read is started by the waiter (without locks of the caller held)
+    ScopedSpinlock lock(cache->spinlock);
+    void **slot = cache->slots.findSlot(pageIndex);
+    usz current = (slot != nullptr) ? reinterpret_cast<usz>(*slot) : 0;
+    if(current == 0 || (current & readInProgress)) return reinterpret_cast<void*>(VirtualMemoryObject::faultRetry);
+    return reinterpret_cast<void*>(current);
+
+}
+
+bool PageCache::waitForPage(IBlockDevice *device, usz pageIndex) {
+
+    // find cache of the device and check bounds
+    usz sectorSize = device->sectorSize();
+    if(sectorSize > PhysicalAllocator::pageSize) return false;
+    DeviceCache *cache = getDeviceCache(device, true);
+    if(pageIndex >= cache->pageCount) return false;
+
+    // prepare the read upfront, so that nothing is allocated under the lock
+    usz sectorsPerPage = PhysicalAllocator::pageSize / sectorSize;
+    usz firstSector = pageIndex * sectorsPerPage;
+    usz sectorCount = device->sectorCount() - firstSector;
+    if(sectorCount > sectorsPerPage) sectorCount = sectorsPerPage;
+    PendingRead *read = new PendingRead;
+    read->cache = cache;
+    read->slot = nullptr;
+    read->frame = nullptr;
+    read->buffer = nullptr;
+
+    // join read in progress, or reserve the slot for new read (the slot points to pending read meanwhile)
+    ReadWaiter waiter;
+    waiter.thread = Scheduler::getCurrentThread();
+    waiter.done = false;
+    waiter.failed = false;
+    bool start = false;
+    {
+        ScopedSpinlock lock(cache->spinlock);
+        void **slot = cache->slots.getSlot(pageIndex);
+        usz current = reinterpret_cast<usz>(*slot);
+        if(current != 0 && !(current & readInProgress)) {
+            delete read;
+            return true;
+        }
+        if(current & readInProgress) {
+            delete read;
+            read = reinterpret_cast<PendingRead*>(current & ~readInProgress);
+        }
+        else {
+            read->slot = slot;
+            *slot = reinterpret_cast<void*>(reinterpret_cast<usz>(read) | readInProgress);
+            start = true;
+        }
+        read->waiters.appendBack(&waiter);
+    }
+
+    // read sectors of the page directly into the frame (outside of the lock, as device takes its own locks)
+    if(start) {
+
+        // frame is zeroed, as the last page of the device may be read only partially
+        read->frame = allocateZeroedPage();
+        read->buffer = new MMIOVirtualMemoryObject(read->frame, PhysicalAllocator::pageSize);
+
+        // if device cannot accept the request now, drop it without failing the waiters, so that they request the page again
+        if(!device->read(firstSector, sectorCount, read->buffer, &PageCache::readCompleted, read)) {
+            finishRead(read, false, false);
+            if(waiter.thread != nullptr) Scheduler::yield();
+            return true;
+        }
+
+    }
+
+    // done flag is set together with the wakeup under the lock, so waiter cannot leave before it is woken
+    for(;;) {
+        {
+            ScopedSpinlock lock(cache->spinlock);
+            if(waiter.done) return !waiter.failed;
+        }
+        if(waiter.thread != nullptr) Scheduler::block();
+        else {
+
+            // without scheduler, interrupt completing the read has to be able to come in
+            bool interruptState = CPU::getInterruptState();
+            CPU::setInterruptState(true);
+            CPU::pause();
+            CPU::setInterruptState(interruptState);
+
+        }
+    }
+
+}
+
+usz PageCache::cachedPageCount() { return __atomic_load_n(&cachedPages, __ATOMIC_RELAXED); }
+
+PageCache::DeviceCache *PageCache::getDeviceCache(IBlockDevice *device, bool create) {
+
+    ScopedSpinlock lock(spinlock);
+
+    // find existing cache
+    if(deviceCaches == nullptr) {
+        if(!create) return nullptr;
+        deviceCaches = new HashMap<IBlockDevice*, DeviceCache*>();
+    }
+    DeviceCache **existing = deviceCaches->find(device);
+    if(existing != nullptr) return *existing;
+    if(!create) return nullptr;
+
+    // create new one, slots of pages are created in radix tree as they are accessed
+    DeviceCache *cache = new DeviceCache;
+    cache->device = device;
+    cache->pageCount = (device->sectorCount() * device->sectorSize() + (PhysicalAllocator::pageSize - 1)) / PhysicalAllocator::pageSize;
+    deviceCaches->insert(device, cache);
+    return cache;
+
+}
+
+void PageCache::readCompleted(void *data, bool success) { finishRead(reinterpret_cast<PendingRead*>(data), success, !success); }
+
+void PageCache::finishRead(PendingRead *read, bool success, bool failed) {
+
+    // publish the frame, otherwise release the slot, so that next access tries to read the page again
+    {
+        ScopedSpinlock lock(read->cache->spinlock);
+        *read->slot = success ? read->frame : nullptr;
+        read->waiters.forEach([read, failed](ReadWaiter *waiter) {
+            read->waiters.remove(waiter);
+            waiter->failed = failed;
+            waiter->done = true;
+            if(waiter->thread != nullptr) Scheduler::wakeUp(waiter->thread);
+        });
+    }
+
+    if(success) __atomic_fetch_add(&cachedPages, 1, __ATOMIC_RELAXED);
+    else PhysicalAllocator::freePage(read->frame);
+    delete read->buffer;
+    delete read;
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <driver/iface/blockdevice.h>
+#include <mem/physalloc.h>
+#include <mem/vas.h>
+#include <sched/scheduler.h>
+#include <util/hashmap.h>
+#include <util/intrusivelist.h>
+#include <util/radixtree.h>
+#include <util/spinlock.h>
+#include <util/types.h>
+
+/**
+ * @brief Class caching pages of block devices, so that every block is kept in memory only once and shared by all its users
+ */
+class PageCache {
+
+public:
+
+    /**
+     * @brief Returns cached page of block device, it does not allocate nor start any read, so it may be called under locks
+     * @param device Block device
+     * @param pageIndex Index of page on the device (in 4KiB units)
+     * @return Physical address of page, VirtualMemoryObject::faultRetry if page is not cached yet, nullptr if page lies beyond the device
+     * NOTE: devices with sectors larger than the page are not cached, so nullptr is returned for them
+     */
+    static void *getPage(IBlockDevice *device, usz pageIndex);
+
+    /**
+     * @brief Starts asynchronous read of page of block device (if it is not cached or being read yet) and waits until it
+     *        finishes - current thread is blocked, if there is none, it spins with interrupts enabled
+     * @param device Block device
+     * @param pageIndex Index of page on the device (in 4KiB units)
+     * @return true if page is cached or it may be requested again (device was busy), false if read of the page failed
+     * NOTE: has to be called with interrupts enabled (or from handler of exception raised with them enabled) and
+     *       without locks held, as it allocates memory and the read is completed by interrupt
+     */
+    static bool waitForPage(IBlockDevice *device, usz pageIndex);
+
+    /**
+     * @brief Returns count of pages held by the cache
+     * @return Count of cached pages
+     */
+    static usz cachedPageCount();
+
+private:
+
+    struct DeviceCache {
+        IBlockDevice *device;
+        usz pageCount;
+        RadixTree<void*> slots;
+        Spinlock spinlock{"page cache device"};
+    };
+
+    struct ReadWaiter {
+        Thread *thread;
+        bool done;
+        bool failed;
+        IntrusiveLink<ReadWaiter> link;
+    };
+
+    struct PendingRead {
+        DeviceCache *cache;
+        void **slot;
+        void *frame;
+        VirtualMemoryObject *buffer;
+        IntrusiveList<ReadWaiter, &ReadWaiter::link> waiters;
+    };
+
+    static constexpr usz readInProgress = 1;
+
+    static DeviceCache *getDeviceCache(IBlockDevice *device, bool create);
+    static void readCompleted(void *data, bool success);
+    static void finishRead(PendingRead *read, bool success, bool failed);
+
+    static inline HashMap<IBlockDevice*, DeviceCache*> *deviceCaches = nullptr;
+    static inline Spinlock spinlock{"page cache"};
+    static inline usz cachedPages = 0;
+
+};
@@ -99,143 +99,148 @@ void PhysicalAllocator::initialize()
 void *PhysicalAllocator::allocatePage(u32 pid, bool large) {
 
     // ensure mutual exclusion
-    ScopedSpinlock lock(allocatorSpinlock);
+    ScopedMCSLock lock(allocatorSpinlock);
 
     // allocate "small" page
-    if(!large) {
+    if(!large) return allocateSmallPage(pid);
+
+    // allocate large page, panic if there is no page to be allocated
+    if(freeLargePagesCount == 0) {
+        Logger::printFormat("[physalloc] could not allocate page (no large pages left), aborting...\n");
+        for(;;); // TODO: panic!
+    }
+
+    for(u64 i = 1; i < maxLargePage; i++) {
         
-        // check if any page is available
-        if(freePagesCount == 0) {
-            Logger::printFormat("[physalloc] could not allocate page (no pages left), aborting...\n");
-            for(;;); // TODO: panic!
-        }
+        // get entry type
+        BriefBitmapEntryType type = getBriefBitmapEntry(i);
 
-        // iterate and find partially free page or totally free page
-        u64 firstFreePage = 0;
-        u64 partiallyFreePage = 0;
-        bool foundPartiallyFreePage = false;
-        for(u64 i = 1; i < maxLargePage; i++) {
+        // if there is free page, allocate it
+        if(type == BriefBitmapEntryType::FullyFree) {
             
-            // get entry type
-            BriefBitmapEntryType type = getBriefBitmapEntry(i);
-
-            // if there is free page and it's first, save it if needed later
-            if(type == BriefBitmapEntryType::FullyFree && firstFreePage == 0) firstFreePage = i;
-            if(type == BriefBitmapEntryType::PartiallyFree) {
-                partiallyFreePage = i;
-                foundPartiallyFreePage = true;
-                break;
-            }
-
-        }
+            // Logger::printFormat("[physalloc] allocating large page in page 0x%x\n", i);
 
-        // if partially allocated page was found, allocate page in it
-        if(foundPartiallyFreePage) {
+            // mark page as used and set info
+            setBriefBitmapEntry(i, BriefBitmapEntryType::FullySingleAllocated);
+            setLargePageBitmapEntry(i, pid, static_cast<u8>(AllocationBitmapEntryFlags::Allocated));
+            freeLargePagesCount--;
 
-            // Logger::printFormat("[physalloc] allocating page in partially allocated large page 0x%x\n", partiallyFreePage);
+            // return page
+            return reinterpret_cast<void*>(i * largePageSize);
 
-            // get the pointer to allocation bitmap
-            LargePageAllocationBitmap *bitmap = reinterpret_cast<LargePageAllocationBitmap*>(partiallyFreePage * largePageSize + CPU::pagingBase);
+        }
 
-            // find free space
-            for(u64 i = 0; i < 511; i++) {
+    }
 
-                if((bitmap->AllocationEntries[i].Flags & static_cast<u8>(AllocationBitmapEntryFlags::Allocated)) == 0) {
+    // this should not happen
+    Logger::printFormat("[physalloc] could not allocate page (large page loop overrun), aborting...\n");
+    for(;;); // TODO: panic!
 
-                    // mark as used
-                    bitmap->AllocationEntries[i].Flags = static_cast<u8>(AllocationBitmapEntryFlags::Allocated);
-                    bitmap->AllocationEntries[i].ProcessID = pid;
-                    bitmap->FreePages--;
-                    freePagesCount--;
+}
 
-                    // if all pages are allocated, propagate this info to brief allocation bitmap
-                    if(bitmap->FreePages == 0) setBriefBitmapEntry(partiallyFreePage, BriefBitmapEntryType::FullyPageAllocated);
+void PhysicalAllocator::allocatePages(u32 pid, void **pages, usz count) {
 
-                    // return page address
-                    return reinterpret_cast<void*>(partiallyFreePage * largePageSize + (i + 1) * pageSize);
+    // allocate all pages under single lock
+    ScopedMCSLock lock(allocatorSpinlock);
+    for(usz i = 0; i < count; i++) pages[i] = allocateSmallPage(pid);
 
-                }
+}
 
-            }
+void *PhysicalAllocator::allocateSmallPage(u32 pid) {
 
-            // this should not happen
-            Logger::printFormat("[physalloc] could not allocate page (loop overrun), aborting...\n");
-            for(;;); // TODO: panic!
+    // NOTE: allocator spinlock has to be held by the caller
+    // check if any page is available
+    if(freePagesCount == 0) {
+        Logger::printFormat("[physalloc] could not allocate page (no pages left), aborting...\n");
+        for(;;); // TODO: panic!
+    }
 
+    // iterate and find partially free page or totally free page
+    u64 firstFreePage = 0;
+    u64 partiallyFreePage = 0;
+    bool foundPartiallyFreePage = false;
+    for(u64 i = 1; i < maxLargePage; i++) {
+        
+        // get entry type
+        BriefBitmapEntryType type = getBriefBitmapEntry(i);
+
+        // if there is free page and it's first, save it if needed later
+        if(type == BriefBitmapEntryType::FullyFree && firstFreePage == 0) firstFreePage = i;
+        if(type == BriefBitmapEntryType::PartiallyFree) {
+            partiallyFreePage = i;
+            foundPartiallyFreePage = true;
+            break;
         }
 
-        // no partially allocated page was found, allocate new
-        else {
-
-            // panic if no free large page was found
-            if(firstFreePage == 0) {
-                Logger::printFormat("[physalloc] could not allocate page (no large pages available), aborting...\n");
-                for(;;); // TODO: panic!
-            }
-
-            // Logger::printFormat("[physalloc] allocating page in newly allocated large page 0x%x\n", firstFreePage);
-
-            // otherwise, allocate new allocation bitmap
-            LargePageAllocationBitmap *newBitmap = reinterpret_cast<LargePageAllocationBitmap*>(firstFreePage * largePageSize + CPU::pagingBase);
-            for(u64 i = 1; i < 511; i++) newBitmap->AllocationEntries[i].Flags = 0;
-            newBitmap->FreePages = 510;
-            newBitmap->AllocationEntries[0].Flags = static_cast<u8>(AllocationBitmapEntryFlags::Allocated);
-            newBitmap->AllocationEntries[0].ProcessID = pid;
-            setBriefBitmapEntry(firstFreePage, BriefBitmapEntryType::PartiallyFree);
-            freePagesCount--;
-            freeLargePagesCount--;
-            return reinterpret_cast<void*>(partiallyFreePage * largePageSize + pageSize);
+    }
 
-        }
+    // if partially allocated page was found, allocate page in it
+    if(foundPartiallyFreePage) {
 
-    }
+        // Logger::printFormat("[physalloc] allocating page in partially allocated large page 0x%x\n", partiallyFreePage);
 
-    // allocate large page
-    else {
+        // get the pointer to allocation bitmap
+        LargePageAllocationBitmap *bitmap = reinterpret_cast<LargePageAllocationBitmap*>(partiallyFreePage * largePageSize + CPU::pagingBase);
 
-        // panic if there is no page to be allocated
-        if(freeLargePagesCount == 0) {
-            Logger::printFormat("[physalloc] could not allocate page (no large pages left), aborting...\n");
-            for(;;); // TODO: panic!
-        }
+        // find free space
+        for(u64 i = 0; i < 511; i++) {
 
-        for(u64 i = 1; i < maxLargePage; i++) {
-            
-            // get entry type
-            BriefBitmapEntryType type = getBriefBitmapEntry(i);
+            if((bitmap->AllocationEntries[i].Flags & static_cast<u8>(AllocationBitmapEntryFlags::Allocated)) == 0) {
 
-            // if there is free page, allocate it
-            if(type == BriefBitmapEntryType::FullyFree) {
-                
-                // Logger::printFormat("[physalloc] allocating large page in page 0x%x\n", i);
+                // mark as used
+                bitmap->AllocationEntries[i].Flags = static_cast<u8>(AllocationBitmapEntryFlags::Allocated);
+                bitmap->AllocationEntries[i].ProcessID = pid;
+                bitmap->ReferenceCounts[i] = 1;
+                bitmap->FreePages--;
+                freePagesCount--;
 
-                // mark page as used and set info
-                setBriefBitmapEntry(i, BriefBitmapEntryType::FullySingleAllocated);
-                setLargePageBitmapEntry(i, pid, static_cast<u8>(AllocationBitmapEntryFlags::Allocated));
-                freeLargePagesCount--;
+                // if all pages are allocated, propagate this info to brief allocation bitmap
+                if(bitmap->FreePages == 0) setBriefBitmapEntry(partiallyFreePage, BriefBitmapEntryType::FullyPageAllocated);
 
-                // return page
-                return reinterpret_cast<void*>(i * largePageSize);
+                // return page address
+                return reinterpret_cast<void*>(partiallyFreePage * largePageSize + (i + 1) * pageSize);
 
             }
 
         }
 
         // this should not happen
-        Logger::printFormat("[physalloc] could not allocate page (large page loop overrun), aborting...\n");
+        Logger::printFormat("[physalloc] could not allocate page (loop overrun), aborting...\n");
         for(;;); // TODO: panic!
 
     }
 
-    // execution will not get here
-    return nullptr;
+    // no partially allocated page was found, allocate new
+    else {
+
+        // panic if no free large page was found
+        if(firstFreePage == 0) {
+            Logger::printFormat("[physalloc] could not allocate page (no large pages available), aborting...\n");
+            for(;;); // TODO: panic!
+        }
+
+        // Logger::printFormat("[physalloc] allocating page in newly allocated large page 0x%x\n", firstFreePage);
+
+        // otherwise, allocate new allocation bitmap
+        LargePageAllocationBitmap *newBitmap = reinterpret_cast<LargePageAllocationBitmap*>(firstFreePage * largePageSize + CPU::pagingBase);
+        for(u64 i = 1; i < 511; i++) newBitmap->AllocationEntries[i].Flags = 0;
+        newBitmap->FreePages = 510;
+        newBitmap->AllocationEntries[0].Flags = static_cast<u8>(AllocationBitmapEntryFlags::Allocated);
+        newBitmap->AllocationEntries[0].ProcessID = pid;
+        newBitmap->ReferenceCounts[0] = 1;
+        setBriefBitmapEntry(firstFreePage, BriefBitmapEntryType::PartiallyFree);
+        freePagesCount--;
+        freeLargePagesCount--;
+        return reinterpret_cast<void*>(firstFreePage * largePageSize + pageSize);
+
+    }
 
 }
 
 void PhysicalAllocator::freePage(void *address) {
 
     // ensure mutual exclusion
-    ScopedSpinlock lock(allocatorSpinlock);
+    ScopedMCSLock lock(allocatorSpinlock);
 
     // convert pointer to value
     u64 convertedAddress = reinterpret_cast<u64>(address);
@@ -272,9 +277,19 @@ void PhysicalAllocator::freePage(void *address) {
         BriefBitmapEntryType type = getBriefBitmapEntry(index);
         if(type != BriefBitmapEntryType::FullyPageAllocated && type != BriefBitmapEntryType::PartiallyFree) return;
 
-        // get bitmap address and offset
+        // get bitmap address and offset (entry 0 describes first page after the bitmap itself)
         LargePageAllocationBitmap *bitmap = reinterpret_cast<LargePageAllocationBitmap*>(index * largePageSize + CPU::pagingBase);
-        u64 offset = (convertedAddress - (index * largePageSize)) / pageSize;
+        u64 offset = (convertedAddress - (index * largePageSize)) / pageSize - 1;
+        if((bitmap->AllocationEntries[offset].Flags & static_cast<u8>(AllocationBitmapEntryFlags::Allocated)) == 0) return;
+
+        // shared page is freed only by its last owner, saturated count does not know how many owners are left
+        if(bitmap->ReferenceCounts[offset] == maxReferenceCount) return;
+        if(bitmap->ReferenceCounts[offset] > 1) {
+            bitmap->ReferenceCounts[offset]--;
+            return;
+        }
+
+        bitmap->ReferenceCounts[offset] = 0;
         bitmap->AllocationEntries[offset].ProcessID = 0;
         bitmap->AllocationEntries[offset].Flags = 0;
         bitmap->FreePages++;
@@ -291,6 +306,50 @@ void PhysicalAllocator::freePage(void *address) {
 
 }
 
+void PhysicalAllocator::referencePage(void *address) {
+
+    // ensure mutual exclusion
+    ScopedMCSLock lock(allocatorSpinlock);
+
+    // get bitmap of the page, sharing of large pages is not supported
+    LargePageAllocationBitmap *bitmap = getPageBitmap(address);
+    if(bitmap == nullptr) return;
+
+    // add reference, count which would wrap around stays saturated
+    u64 offset = (reinterpret_cast<u64>(address) % largePageSize) / pageSize - 1;
+    if((bitmap->AllocationEntries[offset].Flags & static_cast<u8>(AllocationBitmapEntryFlags::Allocated)) == 0) return;
+    if(bitmap->ReferenceCounts[offset] != maxReferenceCount) bitmap->ReferenceCounts[offset]++;
+
+}
+
+usz PhysicalAllocator::getPageReferenceCount(void *address) {
+
+    // ensure mutual exclusion
+    ScopedMCSLock lock(allocatorSpinlock);
+
+    // get bitmap of the page
+    LargePageAllocationBitmap *bitmap = getPageBitmap(address);
+    if(bitmap == nullptr) return 0;
+
+    // return count of references
+    u64 offset = (reinterpret_cast<u64>(address) % largePageSize) / pageSize - 1;
+    if((bitmap->AllocationEntries[offset].Flags & static_cast<u8>(AllocationBitmapEntryFlags::Allocated)) == 0) return 0;
+    return bitmap->ReferenceCounts[offset];
+
+}
+
+PhysicalAllocator::LargePageAllocationBitmap *PhysicalAllocator::getPageBitmap(void *address) {
+
+    // only 4KiB pages in page allocated regions have bitmaps
+    u64 convertedAddress = reinterpret_cast<u64>(address);
+    if(convertedAddress >= maxLargePage * largePageSize || convertedAddress % largePageSize == 0) return nullptr;
+    u64 index = convertedAddress / largePageSize;
+    BriefBitmapEntryType type = getBriefBitmapEntry(index);
+    if(type != BriefBitmapEntryType::FullyPageAllocated && type != BriefBitmapEntryType::PartiallyFree) return nullptr;
+    return reinterpret_cast<LargePageAllocationBitmap*>(index * largePageSize + CPU::pagingBase);
+
+}
+
 void PhysicalAllocator::setBriefBitmapEntry(u64 pageIndex, BriefBitmapEntryType type) {
     
     // panic on too big page index
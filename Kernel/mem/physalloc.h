@@ -27,12 +27,34 @@ public:
      */
     static void *allocatePage(u32 pid, bool large = false);
 
+    /**
+     * @brief Allocates multiple 4KiB pages at once
+     * @param pid PID of process for which the pages are allocated
+     * @param pages Array to be filled with addresses of allocated pages
+     * @param count Count of pages to be allocated
+     */
+    static void allocatePages(u32 pid, void **pages, usz count);
+
     /**
      * @brief Frees allocated page
      * @param address Address of page to be freed
      */
     static void freePage(void * address);
 
+    /**
+     * @brief Adds reference to allocated 4KiB page, so it is freed after every owner freed it
+     * @param address Address of shared page
+     * NOTE: count saturates, page which reached the limit is never freed (leaking it is safer than freeing it while mapped)
+     */
+    static void referencePage(void *address);
+
+    /**
+     * @brief Returns how many owners share allocated 4KiB page
+     * @param address Address of page in question
+     * @return Count of references to the page (0 if page is not allocated)
+     */
+    static usz getPageReferenceCount(void *address);
+
 private:
 
     // only allow allocation of first 16GiB of physical memory
@@ -42,6 +64,7 @@ private:
     static constexpr u64 largePageBitmapPages = briefBitmapPages * 16;
     static constexpr u64 maxLargePage = largePageBitmapPages * 1024 / 2;
     static constexpr u32 reservedProcessID = 0xffffff;
+    static constexpr u16 maxReferenceCount = 0xffff;
 
     enum class BriefBitmapEntryType : u8 {
 		FullyFree = 0b00,
@@ -63,6 +86,7 @@ private:
     struct LargePageAllocationBitmap {
         u32 FreePages;
         AllocationBitmapEntry AllocationEntries[511];
+        u16 ReferenceCounts[511];
     };
 
     // pointers to bitmaps
@@ -72,12 +96,14 @@ private:
     static inline u64 freeLargePagesCount = 0;
 
     // spinlock to ensure mutual exclusion
-    static inline Spinlock allocatorSpinlock;
+    static inline MCSLock allocatorSpinlock{"physical allocator"};
 
     static void setBriefBitmapEntry(u64 pageIndex, BriefBitmapEntryType type);
     static void setLargePageBitmapEntry(u64 pageIndex, u32 pid, u8 flags);
     static BriefBitmapEntryType getBriefBitmapEntry(u64 pageIndex);
     static AllocationBitmapEntry getLargePageBitmapEntry(u64 pageIndex);
+    static LargePageAllocationBitmap *getPageBitmap(void *address);
+    static void *allocateSmallPage(u32 pid);
 
 };
 
@@ -0,0 +1,174 @@
+#include "mem/tlb.h"
+
+TLBShootdown::TLBShootdown(VirtualAddressSpace *space) : space(space), call(&TLBShootdown::remoteInvalidate, this, &TLBShootdown::remoteCompleted) {}
+
+TLBShootdown::~TLBShootdown() {
+
+    // never leave stale entries behind - flush if it was forgotten and wait for remote cores
+    if(!flushed) flush(true);
+    else wait();
+
+}
+
+void TLBShootdown::addRange(void *address, usz pageCount, bool large) {
+
+    // ignore ranges added after flushing and empty ones
+    if(flushed || pageCount == 0) return;
+
+    // account pages for threshold check
+    usz pageSize = large ? PhysicalAllocator::largePageSize : PhysicalAllocator::pageSize;
+    usz convertedAddress = reinterpret_cast<usz>(address);
+    this->pageCount += pageCount;
+    if(fullFlush) return;
+
+    // try to extend last range, as callers usually invalidate pages one by one
+    if(rangeCount > 0) {
+        Range& last = ranges[rangeCount - 1];
+        if(last.pageSize == pageSize && last.address + last.pageCount * last.pageSize == convertedAddress) {
+            last.pageCount += pageCount;
+            return;
+        }
+    }
+
+    // if there is no place for new range, fallback to full flush
+    if(rangeCount == maxRanges) {
+        fullFlush = true;
+        return;
+    }
+
+    // add new range
+    ranges[rangeCount].address = convertedAddress;
+    ranges[rangeCount].pageCount = pageCount;
+    ranges[rangeCount].pageSize = pageSize;
+    rangeCount++;
+
+}
+
+void TLBShootdown::addFullFlush() {
+
+    if(!flushed) fullFlush = true;
+
+}
+
+void TLBShootdown::flush(bool synchronous) {
+
+    // flush only once and only if there is anything to invalidate
+    if(flushed) return;
+    flushed = true;
+    if(rangeCount == 0 && !fullFlush) return;
+
+    // switch to full flush if invalidating page by page would be slower
+    if(pageCount > TLB::fullFlushThreshold) fullFlush = true;
+
+    // invalidate entries of current core and find out which cores could have cached the mapping
+    bool interruptState = CPU::enterCritical();
+    u8 self = CPU::getCoreAPICID();
+    u64 selfBit = 1ull << self;
+    invalidateLocally();
+    u64 targets = space->getActiveCores() & ~selfBit;
+
+    // cores which do not use user space now may still cache its entries under its PCID, so they flush them on next switch
+    // NOTE: active cores are read again, as core which was switching meanwhile could miss the stale mark
+    if(space != VirtualAddressSpace::getKernelVirtualAddressSpace()) {
+        space->markStale(~(targets | selfBit));
+        targets |= space->getActiveCores() & ~selfBit;
+    }
+    if(!IPI::isInitialized()) targets = 0;
+    CPU::exitCritical(interruptState);
+
+    // update statistics
+    __atomic_fetch_add(&TLB::statistics.pagesInvalidated, fullFlush ? 0 : pageCount, __ATOMIC_RELAXED);
+    if(fullFlush) __atomic_fetch_add(&TLB::statistics.fullFlushes, 1, __ATOMIC_RELAXED);
+
+    // if no other core uses the space, we are done
+    if(targets == 0) {
+        __atomic_fetch_add(&TLB::statistics.localOnlyFlushes, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    // post invalidation to every target core, cores which still have older requests queued share their IPI
+    startTimestamp = CPU::readTimestampCounter();
+    usz ipisSent = IPI::runOnCores(targets, call);
+    __atomic_fetch_add(&TLB::statistics.shootdowns, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&TLB::statistics.ipisSent, ipisSent, __ATOMIC_RELAXED);
+
+    // wait for completion if requested
+    if(synchronous) wait();
+
+}
+
+bool TLBShootdown::completed() { return call.completed(); }
+
+void TLBShootdown::wait() { call.wait(); }
+
+void TLBShootdown::invalidateLocally() {
+
+    // entries of inactive space may be kept under its PCID, flush them when it is loaded again
+    VirtualAddressSpace *kernelSpace = VirtualAddressSpace::getKernelVirtualAddressSpace();
+    if(space != kernelSpace && space != VirtualAddressSpace::getCurrentVirtualAddressSpace()) {
+        space->markStale(1ull << CPU::getCoreAPICID());
+        return;
+    }
+
+    // invalidate whole TLB or page by page (kernel entries are global, invlpg removes them from every PCID)
+    if(fullFlush) {
+        if(space == kernelSpace) CPU::flushGlobalTLB();
+        else CPU::flushTLB();
+        return;
+    }
+    for(usz i = 0; i < rangeCount; i++) {
+        for(usz j = 0; j < ranges[i].pageCount; j++) {
+            CPU::invalidatePagingEntry(reinterpret_cast<void*>(ranges[i].address + j * ranges[i].pageSize));
+        }
+    }
+
+}
+
+void TLBShootdown::remoteInvalidate(void *request) {
+
+    reinterpret_cast<TLBShootdown*>(request)->invalidateLocally();
+
+}
+
+void TLBShootdown::remoteCompleted(void *request) {
+
+    // run by the last acknowledging core, request is still alive here
+    TLB::recordLatency(CPU::readTimestampCounter() - reinterpret_cast<TLBShootdown*>(request)->startTimestamp);
+
+}
+
+void TLB::setFullFlushThreshold(usz pages) { fullFlushThreshold = pages; }
+
+TLB::Statistics TLB::getStatistics() {
+
+    // copy all counters atomically one by one
+    Statistics snapshot;
+    snapshot.shootdowns = __atomic_load_n(&statistics.shootdowns, __ATOMIC_RELAXED);
+    snapshot.localOnlyFlushes = __atomic_load_n(&statistics.localOnlyFlushes, __ATOMIC_RELAXED);
+    snapshot.ipisSent = __atomic_load_n(&statistics.ipisSent, __ATOMIC_RELAXED);
+    snapshot.pagesInvalidated = __atomic_load_n(&statistics.pagesInvalidated, __ATOMIC_RELAXED);
+    snapshot.fullFlushes = __atomic_load_n(&statistics.fullFlushes, __ATOMIC_RELAXED);
+    snapshot.totalLatencyCycles = __atomic_load_n(&statistics.totalLatencyCycles, __ATOMIC_RELAXED);
+    snapshot.maxLatencyCycles = __atomic_load_n(&statistics.maxLatencyCycles, __ATOMIC_RELAXED);
+    return snapshot;
+
+}
+
+void TLB::dumpStatistics() {
+
+    Statistics snapshot = getStatistics();
+    usz averageLatency = (snapshot.shootdowns != 0) ? snapshot.totalLatencyCycles / snapshot.shootdowns : 0;
+    Logger::printFormat("[tlb] shootdowns: %u, local only: %u, IPIs sent: %u\n", snapshot.shootdowns, snapshot.localOnlyFlushes, snapshot.ipisSent);
+    Logger::printFormat("[tlb] pages invalidated: %u, full flushes: %u (threshold: %u pages)\n", snapshot.pagesInvalidated, snapshot.fullFlushes, fullFlushThreshold);
+    Logger::printFormat("[tlb] latency: average %u cycles, max %u cycles\n", averageLatency, snapshot.maxLatencyCycles);
+
+}
+
+void TLB::recordLatency(u64 cycles) {
+
+    // update total and maximum latency
+    __atomic_fetch_add(&statistics.totalLatencyCycles, cycles, __ATOMIC_RELAXED);
+    usz currentMax = __atomic_load_n(&statistics.maxLatencyCycles, __ATOMIC_RELAXED);
+    while(cycles > currentMax && !__atomic_compare_exchange_n(&statistics.maxLatencyCycles, &currentMax, cycles, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+}
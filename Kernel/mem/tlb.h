@@ -0,0 +1,132 @@
+#pragma once
+#include <driver/arch/cpu.h>
+#include <driver/arch/ipi.h>
+#include <mem/vas.h>
+#include <util/logger.h>
+#include <util/spinlock.h>
+#include <util/types.h>
+
+/**
+ * @brief Class encapsulating batch of TLB invalidations in single address space
+ */
+class TLBShootdown {
+
+public:
+
+    /**
+     * @brief Constructor
+     * @param space Address space in which mappings were changed
+     */
+    TLBShootdown(VirtualAddressSpace *space);
+    TLBShootdown(const TLBShootdown &) = delete;
+    TLBShootdown(TLBShootdown &&) = delete;
+
+    /**
+     * @brief Destructor - flushes batch if it was not flushed and waits for its completion
+     */
+    ~TLBShootdown();
+
+    /**
+     * @brief Adds range of pages to be invalidated
+     * @param address Virtual address of first page in range
+     * @param pageCount Count of pages in range
+     * @param large Whether range consists of 2MiB pages
+     */
+    void addRange(void *address, usz pageCount = 1, bool large = false);
+
+    /**
+     * @brief Requests invalidation of all entries of the space instead of specific ranges
+     */
+    void addFullFlush();
+
+    /**
+     * @brief Invalidates batched entries locally and on all cores which may have cached them
+     * @param synchronous Whether to wait until all cores completed the invalidation
+     */
+    void flush(bool synchronous = true);
+
+    /**
+     * @brief Returns whether all cores completed the invalidation
+     * @return true if shootdown was completed, false otherwise
+     */
+    bool completed();
+
+    /**
+     * @brief Waits until all cores completed the invalidation
+     */
+    void wait();
+
+private:
+
+    friend class TLB;
+
+    struct Range {
+        usz address;
+        usz pageCount;
+        usz pageSize;
+    };
+
+    static constexpr usz maxRanges = 16;
+
+    void invalidateLocally();
+    static void remoteInvalidate(void *request);
+    static void remoteCompleted(void *request);
+
+    VirtualAddressSpace *space;
+    RemoteCall call;
+    Range ranges[maxRanges];
+    usz rangeCount = 0;
+    usz pageCount = 0;
+    bool fullFlush = false;
+    bool flushed = false;
+    u64 startTimestamp = 0;
+
+};
+
+/**
+ * @brief Class for managing cross-core TLB shootdowns (sent as remote calls, so that batches share IPIs)
+ */
+class TLB {
+
+public:
+
+    /**
+     * @brief Statistics of shootdowns, useful for tuning of thresholds
+     */
+    struct Statistics {
+        usz shootdowns;
+        usz localOnlyFlushes;
+        usz ipisSent;
+        usz pagesInvalidated;
+        usz fullFlushes;
+        usz totalLatencyCycles;
+        usz maxLatencyCycles;
+    };
+
+    /**
+     * @brief Sets page count above which single-page invalidations are replaced by full flush
+     * @param pages New threshold value
+     */
+    static void setFullFlushThreshold(usz pages);
+
+    /**
+     * @brief Returns snapshot of shootdown statistics
+     * @return Current statistics
+     */
+    static Statistics getStatistics();
+
+    /**
+     * @brief Prints shootdown statistics using kernel logger
+     */
+    static void dumpStatistics();
+
+private:
+
+    friend class TLBShootdown;
+
+    static void recordLatency(u64 cycles);
+
+    static inline usz fullFlushThreshold = 32;
+    static inline Statistics statistics = {};
+
+};
@@ -1,4 +1,5 @@
 #include "vas.h"
+#include "tlb.h"
 
 // get needed symbols of kernel to set attributes of mappings
 extern u64 kernelCodeStart;
@@ -8,9 +9,6 @@ extern u64 kernelRodataEnd;
 
 VirtualAddressSpace::VirtualAddressSpace() {
 
-    // create allocation list
-    allocationList = new List<VirtualMemoryRegion*>();
-
     // create table for PML4 entries if kernel address space was initialized (otherwise we are creating kernel address space)
     if(kernelAddressSpaceInitialized) {
 
@@ -18,6 +16,17 @@ VirtualAddressSpace::VirtualAddressSpace() {
         cr3Value = allocateZeroedPage();
         mappingStructure = reinterpret_cast<PML4Entry*>(reinterpret_cast<usz>(cr3Value) + CPU::pagingBase);
 
+        // assign own PCID, if all were used, share the last one and flush TLB on every switch (counter stops there,
+        // wrapping around would hand out PCIDs of live spaces, and of the kernel, without flushing)
+        u16 identifier = __atomic_load_n(&nextProcessContextIdentifier, __ATOMIC_RELAXED);
+        while(identifier < CPU::maxProcessContextIdentifier &&
+              !__atomic_compare_exchange_n(&nextProcessContextIdentifier, &identifier, identifier + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+        processContextIdentifier = identifier;
+        if(processContextIdentifier >= CPU::maxProcessContextIdentifier) {
+            processContextIdentifier = CPU::maxProcessContextIdentifier;
+            flushOnActivation = true;
+        }
+
         // copy kernel space PML4 entries to newly created address space
         for(usz i = 256; i < 512; i++) 
             if(kernelAddressSpace->mappingStructure[i].present == 1) 
@@ -29,7 +38,7 @@ VirtualAddressSpace::VirtualAddressSpace() {
         newRegion->size = 0x800000000000 - newRegion->address; // top of user's memory address space
         newRegion->type = VirtualMemoryRegion::Type::Free;
         newRegion->object = nullptr;
-        allocationList->appendBack(newRegion);
+        allocationList.appendBack(newRegion);
 
     }
 
@@ -40,8 +49,10 @@ VirtualAddressSpace::VirtualAddressSpace() {
         Logger::printFormat("[vas] kernel .text: 0x%x - 0x%x\n", reinterpret_cast<usz>(&kernelCodeStart), reinterpret_cast<usz>(&kernelCodeEnd));
         Logger::printFormat("[vas] kernel .rodata: 0x%x - 0x%x\n", reinterpret_cast<usz>(&kernelRodataStart), reinterpret_cast<usz>(&kernelRodataEnd));
 
-        // get cr3 value from register of CPU
-        cr3Value = reinterpret_cast<void*>(CPU::readCR3());
+        Logger::printFormat("[vas] process context identifiers used: %b\n", CPU::processContextIdentifiersEnabled());
+
+        // get cr3 value from register of CPU (kernel space uses PCID 0)
+        cr3Value = reinterpret_cast<void*>(CPU::readCR3() & ~0xfffull);
         mappingStructure = reinterpret_cast<PML4Entry*>(reinterpret_cast<usz>(cr3Value) + CPU::pagingBase);
 
         // mark first 512 GiB of kernel address space to non-executable
@@ -53,7 +64,12 @@ VirtualAddressSpace::VirtualAddressSpace() {
         newRegion->size =  0xffffff8000000000 - newRegion->address;; // -512 GiB from top of memory address space
         newRegion->type = VirtualMemoryRegion::Type::Free;
         newRegion->object = nullptr;
-        allocationList->appendBack(newRegion);
+        allocationList.appendBack(newRegion);
+
+        // bootstrap core is already using this address space
+        u8 core = CPU::getCoreAPICID();
+        activeCores = (1ull << core);
+        currentAddressSpaces[core] = this;
 
         // save address space
         kernelAddressSpace = this;
@@ -65,7 +81,8 @@ VirtualAddressSpace::VirtualAddressSpace() {
 
 void *VirtualAddressSpace::mapObject(VirtualMemoryObject *object) { 
 
-    // lock spinlock
+    // lock regions exclusively, then page tables
+    ScopedWriteLock regionsLock(regionLock);
     ScopedSpinlock lock(spinlock);
 
     // get info about object
@@ -76,17 +93,19 @@ void *VirtualAddressSpace::mapObject(VirtualMemoryObject *object) {
     if(!objectPrefferedAddress) {
 
         // iterate and find suitable chunk
-        for(usz i = 0; i < allocationList->size(); i++) {
+        for(VirtualMemoryRegion *current = allocationList.getFirst(); current != nullptr; current = allocationList.getNext(current)) {
 
-            VirtualMemoryRegion *current = allocationList->get(i);
             if(current->type != VirtualMemoryRegion::Type::Free) continue;
 
             // potentially there's suitable region, find out if alignment is needed
             usz regionSize = current->size;
             usz regionAddress = current->address;
-            if(object->largePageAligned() && (current->address % PhysicalAllocator::largePageSize) != 0) {
+            usz alignment = object->mappingAlignment();
+            usz difference = (object->mappingOffset() + alignment - (current->address % alignment)) % alignment;
+            if(difference != 0) {
 
-                usz difference = PhysicalAllocator::largePageSize - (current->address % PhysicalAllocator::largePageSize);
+                // region has to be big enough to be aligned at all
+                if(regionSize < difference) continue;
                 regionSize -= difference;
                 regionAddress += difference;
 
@@ -119,13 +138,14 @@ void *VirtualAddressSpace::mapObject(VirtualMemoryObject *object) {
                     current->type = VirtualMemoryRegion::Type::Allocated;
 
                     // if additional region after exists, add it
-                    if(additionalRegion != nullptr) allocationList->insertAt(additionalRegion, i + 1);
+                    if(additionalRegion != nullptr) allocationList.insertAfter(additionalRegion, current);
 
                     // add alignment region
-                    allocationList->insertAt(alignmentRegion, i);
+                    allocationList.insertBefore(alignmentRegion, current);
 
                     // map current region
                     doMapping(current);
+                    object->addMapping(this, current->address);
                     return reinterpret_cast<void*>(current->address);
 
                 }
@@ -157,10 +177,11 @@ void *VirtualAddressSpace::mapObject(VirtualMemoryObject *object) {
                     current->type = VirtualMemoryRegion::Type::Allocated;
 
                     // if additional region after exists, add it
-                    if(additionalRegion != nullptr) allocationList->insertAt(additionalRegion, i + 1);
+                    if(additionalRegion != nullptr) allocationList.insertAfter(additionalRegion, current);
 
                     // map current region
                     doMapping(current);
+                    object->addMapping(this, current->address);
                     return reinterpret_cast<void*>(current->address);
 
                 }
@@ -174,15 +195,66 @@ void *VirtualAddressSpace::mapObject(VirtualMemoryObject *object) {
 
     }
 
-    // TODO: not supported yet
-    else return nullptr;
+    // otherwise place object exactly where requested
+    else return mapObjectAt(object, objectPrefferedAddress);
+
+}
+
+VirtualAddressSpace *VirtualAddressSpace::clone() {
+
+    // kernel space is shared by all spaces, it cannot be cloned
+    if(this == kernelAddressSpace) return nullptr;
+
+    // take snapshot of allocated regions, as objects lock this space while being cloned
+    Vector<VirtualMemoryRegion> regions;
+    {
+        ScopedReadLock regionsLock(regionLock);
+        for(VirtualMemoryRegion *current = allocationList.getFirst(); current != nullptr; current = allocationList.getNext(current)) {
+            if(current->type == VirtualMemoryRegion::Type::Allocated && current->object != nullptr) regions.appendBack(*current);
+        }
+    }
+
+    // clone objects first, private writeable object which cannot be cloned would be shared otherwise, so cloning fails
+    Vector<VirtualMemoryObject*> objects;
+    for(usz i = 0; i < regions.size(); i++) {
+        VirtualMemoryObject *object = regions[i].object->clone();
+        if(object == nullptr) {
+            Logger::printFormat("[vas] object at 0x%x cannot be cloned\n", regions[i].address);
+            for(usz j = 0; j < objects.size(); j++) if(objects[j] != regions[j].object) objects[j]->release();
+            return nullptr;
+        }
+        objects.appendBack(object);
+    }
+
+    // map clones at the same addresses, objects meant to be shared are mapped themselves
+    VirtualAddressSpace *newSpace = new VirtualAddressSpace();
+    for(usz i = 0; i < regions.size(); i++) {
+
+        VirtualMemoryObject *object = objects[i];
+        bool cloned = object != regions[i].object;
+
+        {
+            ScopedWriteLock regionsLock(newSpace->regionLock);
+            ScopedSpinlock lock(newSpace->spinlock);
+            if(newSpace->mapObjectAt(object, regions[i].address) == nullptr) {
+                Logger::printFormat("[vas] could not map cloned object at 0x%x, aborting...\n", regions[i].address);
+                for(;;); // TODO: panic!
+            }
+        }
+
+        // clone is owned only by its mapping
+        if(cloned) object->release();
+
+    }
+
+    return newSpace;
 
 }
 
 void VirtualAddressSpace::adjustKernelMemory() {
 
     // get paging structure
-    PML4Entry *pml4 = reinterpret_cast<PML4Entry*>(CPU::readCR3());
+    PML4Entry *pml4 = reinterpret_cast<PML4Entry*>(CPU::readCR3() & ~0xfffull);
 
     // move 0th PML4 entry to 256th
     pml4[256].value = pml4[0].value;
@@ -214,7 +286,59 @@ void *VirtualAddressSpace::allocateZeroedPage() {
 
 void *VirtualAddressSpace::getCR3() { return cr3Value; }
 
-void *VirtualAddressSpace::getMappingEntry(void *address, bool large, bool create) {
+void VirtualAddressSpace::activate() {
+
+    // disable interrupts, so the core is not interrupted in the middle of a switch
+    bool interruptState = CPU::enterCritical();
+    u8 core = CPU::getCoreAPICID();
+    u64 coreBit = 1ull << core;
+
+    // mark core as using this space (and kernel space, as its entries are shared by every space)
+    __atomic_fetch_or(&activeCores, coreBit, __ATOMIC_SEQ_CST);
+    if(this != kernelAddressSpace) __atomic_fetch_or(&kernelAddressSpace->activeCores, coreBit, __ATOMIC_SEQ_CST);
+
+    // load paging structure, keeping entries tagged with its PCID unless they may be stale
+    // NOTE: core is marked active before checking staleness, so shootdowns either reach it or mark it stale
+    VirtualAddressSpace *previous = currentAddressSpaces[core];
+    currentAddressSpaces[core] = this;
+    bool stale = (__atomic_fetch_and(&staleCores, ~coreBit, __ATOMIC_SEQ_CST) & coreBit) != 0;
+    u64 cr3 = reinterpret_cast<u64>(cr3Value);
+    if(CPU::processContextIdentifiersEnabled()) {
+        cr3 |= processContextIdentifier;
+        if(!stale && !flushOnActivation) cr3 |= CPU::preserveTLBBit;
+    }
+    CPU::writeCR3(cr3);
+
+    // previous space does not need shootdowns of this core anymore (they mark it stale instead)
+    if(previous != nullptr && previous != this && previous != kernelAddressSpace) 
+        __atomic_fetch_and(&previous->activeCores, ~coreBit, __ATOMIC_SEQ_CST);
+
+    CPU::exitCritical(interruptState);
+
+}
+
+u64 VirtualAddressSpace::getActiveCores() { return __atomic_load_n(&activeCores, __ATOMIC_ACQUIRE); }
+
+void VirtualAddressSpace::markStale(u64 cores) { __atomic_fetch_or(&staleCores, cores, __ATOMIC_SEQ_CST); }
+
+bool VirtualAddressSpace::handlePageFault(void *address, u64 errorCode, bool interruptsEnabled) {
+
+    // higher half belongs to the kernel, lower half to the space loaded on the core
+    VirtualAddressSpace *space = (reinterpret_cast<usz>(address) >= CPU::pagingBase) ? kernelAddressSpace : getCurrentVirtualAddressSpace();
+    if(space == nullptr) return false;
+    return space->resolvePageFault(address, errorCode, interruptsEnabled);
+
+}
+
+VirtualAddressSpace *VirtualAddressSpace::getCurrentVirtualAddressSpace() {
+
+    // if core did not load any space yet, it uses kernel one
+    VirtualAddressSpace *current = currentAddressSpaces[CPU::getCoreAPICID()];
+    return (current != nullptr) ? current : kernelAddressSpace;
+
+}
+
+void *VirtualAddressSpace::getMappingEntry(void *address, usz pageSize, bool create) {
 
     // firstly, split address into pieces
     usz convertedAddress = reinterpret_cast<usz>(address);
@@ -238,10 +362,16 @@ void *VirtualAddressSpace::getMappingEntry(void *address, bool large, bool creat
         pml4Entry->address = reinterpret_cast<usz>(newPDPT) >> 12;
         pml4Entry->present = 1;
         pml4Entry->writeEnable = 1;
+        pml4Entry->userAccessible = (this != kernelAddressSpace) ? 1 : 0;
 
     }
 
     PDPTEntry *pdptEntry = &reinterpret_cast<PDPTEntry*>((pml4Entry->address << 12) + CPU::pagingBase)[pdptIndex];
+    if(pageSize == VirtualMemoryObject::hugePageSize) return reinterpret_cast<void*>(pdptEntry); // reference to 1GiB page entry is needed
+    if(pdptEntry->present && pdptEntry->hugePageReference.pageSize) {
+        if(!create) return nullptr; // address is covered by 1GiB page
+        splitEntry(reinterpret_cast<PTEntry*>(pdptEntry), VirtualMemoryObject::hugePageSize);
+    }
     if(!pdptEntry->present && !create) return nullptr;
     else if(!pdptEntry->present) {
 
@@ -250,11 +380,16 @@ void *VirtualAddressSpace::getMappingEntry(void *address, bool large, bool creat
         pdptEntry->address = reinterpret_cast<usz>(newPD) >> 12;
         pdptEntry->present = 1;
         pdptEntry->writeEnable = 1;
+        pdptEntry->userAccessible = (this != kernelAddressSpace) ? 1 : 0;
 
     }
 
     PDEntry *pdEntry = &reinterpret_cast<PDEntry*>((pdptEntry->address << 12) + CPU::pagingBase)[pdIndex];
-    if(large) return reinterpret_cast<void*>(pdEntry); // if the reference to large page entry is needed, return it now
+    if(pageSize == PhysicalAllocator::largePageSize) return reinterpret_cast<void*>(pdEntry); // if the reference to large page entry is needed, return it now
+    if(pdEntry->largePageReference.present && pdEntry->largePageReference.pageSize) {
+        if(!create) return nullptr; // address is covered by 2MiB page
+        splitEntry(reinterpret_cast<PTEntry*>(pdEntry), PhysicalAllocator::largePageSize);
+    }
     if(!pdEntry->ptReference.present && !create) return nullptr;
     else if(!pdEntry->ptReference.present) {
 
@@ -263,6 +398,7 @@ void *VirtualAddressSpace::getMappingEntry(void *address, bool large, bool creat
         pdEntry->ptReference.address = reinterpret_cast<usz>(newPT) >> 12;
         pdEntry->ptReference.present = 1;
         pdEntry->ptReference.writeEnable = 1;
+        pdEntry->ptReference.userAccessible = (this != kernelAddressSpace) ? 1 : 0;
 
     }
 
@@ -271,60 +407,593 @@ void *VirtualAddressSpace::getMappingEntry(void *address, bool large, bool creat
 
 }
 
+void *VirtualAddressSpace::mapObjectAt(VirtualMemoryObject *object, usz address) {
+
+    // address has to be aligned as needed by pages used by the object
+    usz objectSize = object->objectSize();
+    if(address % PhysicalAllocator::pageSize != 0 || address % object->mappingAlignment() != object->mappingOffset()) return nullptr;
+
+    // find free region containing whole requested range
+    for(VirtualMemoryRegion *current = allocationList.getFirst(); current != nullptr; current = allocationList.getNext(current)) {
+
+        if(current->type != VirtualMemoryRegion::Type::Free) continue;
+        if(address < current->address || address - current->address >= current->size) continue;
+        if(current->size - (address - current->address) < objectSize) return nullptr;
+
+        // split off free space before the object
+        if(address > current->address) {
+
+            VirtualMemoryRegion *beforeRegion = new VirtualMemoryRegion();
+            beforeRegion->address = current->address;
+            beforeRegion->size = address - current->address;
+            beforeRegion->object = nullptr;
+            beforeRegion->type = VirtualMemoryRegion::Type::Free;
+            allocationList.insertBefore(beforeRegion, current);
+            current->size -= beforeRegion->size;
+            current->address = address;
+
+        }
+
+        // split off free space after the object
+        if(current->size > objectSize) {
+
+            VirtualMemoryRegion *afterRegion = new VirtualMemoryRegion();
+            afterRegion->address = address + objectSize;
+            afterRegion->size = current->size - objectSize;
+            afterRegion->object = nullptr;
+            afterRegion->type = VirtualMemoryRegion::Type::Free;
+            allocationList.insertAfter(afterRegion, current);
+
+        }
+
+        // change current region and map it
+        current->size = objectSize;
+        current->object = object;
+        current->type = VirtualMemoryRegion::Type::Allocated;
+        doMapping(current);
+        object->addMapping(this, address);
+        return reinterpret_cast<void*>(address);
+
+    }
+
+    // requested range is not free
+    return nullptr;
+
+}
+
 void VirtualAddressSpace::doMapping(VirtualMemoryRegion *region) {
 
-    // get relevant information
+    // pages of demand paged objects are mapped on first access by page fault handler
     VirtualMemoryObject *object = region->object;
-    usz regionStart = region->address;
-    bool largePages = object->largePageAligned();
-    usz pageSize = largePages ? PhysicalAllocator::largePageSize : PhysicalAllocator::pageSize;
-    usz pageCount = region->size / pageSize;
+    if(object->demandPaged()) return;
+
+    // get relevant information
+    ExtentList *pages = object->objectPages();
     // Logger::printFormat("[vas] mapping region of size 0x%x at 0x%x\n", region->size, region->address);
-    List<void*> *pages = object->objectPages();
 
-    if(pages->size() != pageCount) {
-        Logger::printFormat("[vas] page counts do not match (%d vs %d), aborting...\n", pages->size(), pageCount);
+    if(pages->size() != region->size) {
+        Logger::printFormat("[vas] object size does not match its pages (0x%x vs 0x%x), aborting...\n", pages->size(), region->size);
         for(;;);
         // TODO: panic! 
     }
 
-    // map pages
-    u8 flags = object->objectFlags();
-    for(usz i = 0; i < pageCount; i++) {
+    // kernel mappings are global, as they are shared by every space
+    bool global = (this == kernelAddressSpace);
+    bool hugePages = CPU::supportsHugePages();
+    PagingCursor cursor(this, true);
+    usz address = region->address;
 
-        // get entry
-        void *entry = getMappingEntry(reinterpret_cast<void*>(regionStart + (i * pageSize)), largePages, true);
-        void *page = pages->get(i);
+    // maps run of physically contiguous large pages, its part congruent modulo 1GiB is promoted to huge pages
+    auto mapLargeRun = [&](usz physical, usz count, u8 flags) {
 
-        if(largePages) {
+        if(hugePages && (address - physical) % VirtualMemoryObject::hugePageSize == 0) {
 
-            // get reference to the entry
-            PDEntry *pdEntry = reinterpret_cast<PDEntry*>(entry);
+            // large pages up to 1GiB boundary
+            usz leading = ((VirtualMemoryObject::hugePageSize - (address % VirtualMemoryObject::hugePageSize)) % VirtualMemoryObject::hugePageSize) / PhysicalAllocator::largePageSize;
+            if(leading > count) leading = count;
+            mapRange(cursor, address, physical, leading, PhysicalAllocator::largePageSize, flags, global);
+            address += leading * PhysicalAllocator::largePageSize;
+            physical += leading * PhysicalAllocator::largePageSize;
+            count -= leading;
 
-            // fill entry
-            pdEntry->largePageReference.present = 1;
-            pdEntry->largePageReference.pageSize = 1;
-            pdEntry->largePageReference.writeEnable = (flags & VirtualMemoryObject::writeable) ? 1 : 0;
-            pdEntry->largePageReference.executionDisable = (flags & VirtualMemoryObject::executable) ? 0 : 1;
-            pdEntry->largePageReference.cacheDisable = (flags & VirtualMemoryObject::cacheable) ? 0 : 1;
-            pdEntry->value |= (reinterpret_cast<u64>(page) & ~(0x1ffff));
+            // huge pages
+            usz hugeCount = count / (VirtualMemoryObject::hugePageSize / PhysicalAllocator::largePageSize);
+            mapRange(cursor, address, physical, hugeCount, VirtualMemoryObject::hugePageSize, flags, global);
+            address += hugeCount * VirtualMemoryObject::hugePageSize;
+            physical += hugeCount * VirtualMemoryObject::hugePageSize;
+            count -= hugeCount * (VirtualMemoryObject::hugePageSize / PhysicalAllocator::largePageSize);
 
         }
 
-        else {
+        // the rest (or whole run) stays in large pages
+        mapRange(cursor, address, physical, count, PhysicalAllocator::largePageSize, flags, global);
+        address += count * PhysicalAllocator::largePageSize;
+
+    };
+
+    // maps run of physically contiguous pages, small pages congruent modulo 2MiB are promoted to large (or huge) pages
+    auto mapRun = [&](usz physical, usz count, usz pageSize, u8 flags) {
+
+        if(pageSize == PhysicalAllocator::largePageSize) {
+            mapLargeRun(physical, count, flags);
+            return;
+        }
+
+        constexpr usz smallPerLarge = PhysicalAllocator::largePageSize / PhysicalAllocator::pageSize;
+        if(pageSize == PhysicalAllocator::pageSize && (address - physical) % PhysicalAllocator::largePageSize == 0) {
+
+            // small pages up to 2MiB boundary, promoted only if at least one whole large page follows
+            usz leading = ((PhysicalAllocator::largePageSize - (address % PhysicalAllocator::largePageSize)) % PhysicalAllocator::largePageSize) / PhysicalAllocator::pageSize;
+            if(count >= leading + smallPerLarge) {
+                mapRange(cursor, address, physical, leading, PhysicalAllocator::pageSize, flags, global);
+                address += leading * PhysicalAllocator::pageSize;
+                physical += leading * PhysicalAllocator::pageSize;
+                count -= leading;
+
+                // large pages in the middle
+                usz largeCount = count / smallPerLarge;
+                mapLargeRun(physical, largeCount, flags);
+                physical += largeCount * PhysicalAllocator::largePageSize;
+                count -= largeCount * smallPerLarge;
+            }
+
+        }
+
+        // the rest (or whole run) is mapped with its own page size
+        mapRange(cursor, address, physical, count, pageSize, flags, global);
+        address += count * pageSize;
+
+    };
+
+    // every extent is a run, protected ranges split it, as they are mapped with other flags
+    bool protectedRanges = __atomic_load_n(&object->protections, __ATOMIC_ACQUIRE) != nullptr;
+    pages->forEach([&](const Extent& extent) {
+
+        if(!protectedRanges) {
+            mapRun(extent.address, extent.pageCount, extent.pageSize, object->objectFlags());
+            return;
+        }
+        // ranges may split large pages, so runs are described by 4KiB pages (aligned parts are promoted again)
+        usz pageCount = extent.pageCount * (extent.pageSize / PhysicalAllocator::pageSize);
+        usz index = 0;
+        while(index < pageCount) {
+            usz runLength = 0;
+            u8 flags = object->pageFlags(extent.offset / PhysicalAllocator::pageSize + index, &runLength);
+            if(runLength > pageCount - index) runLength = pageCount - index;
+            mapRun(extent.address + index * PhysicalAllocator::pageSize, runLength, PhysicalAllocator::pageSize, flags);
+            index += runLength;
+        }
+
+    });
+
+}
+
+u64 VirtualAddressSpace::cacheModeBits(u8 flags, usz pageSize) {
+
+    // cache mode is PAT index, its bits are spread over PWT, PCD and PAT bit (which moves for large and huge pages)
+    u8 index = (flags & VirtualMemoryObject::cacheModeMask) >> VirtualMemoryObject::cacheModeShift;
+    u64 bits = 0;
+    if(index & 1) bits |= entryWriteThrough;
+    if(index & 2) bits |= entryCacheDisable;
+    if(index & 4) bits |= (pageSize == PhysicalAllocator::pageSize) ? entrySmallPageAttribute : entryLargePageAttribute;
+    return bits;
+
+}
+
+void VirtualAddressSpace::mapRange(PagingCursor& cursor, usz address, usz physical, usz pageCount, usz pageSize, u8 flags, bool global) {
+
+    // prepare entry bits once, they are the same for every page
+    u64 bits = entryPresent;
+    if(flags & VirtualMemoryObject::writeable) bits |= entryWriteEnable;
+    if(!(flags & VirtualMemoryObject::executable)) bits |= entryExecutionDisable;
+    if((flags & VirtualMemoryObject::userMappable) && this != kernelAddressSpace) bits |= entryUserAccessible;
+    bits |= cacheModeBits(flags, pageSize);
+    if(global) bits |= entryGlobal;
+    if(pageSize != PhysicalAllocator::pageSize) bits |= entryPageSize;
+
+    // fill entries table by table, each run inside single table is filled in tight loop
+    usz levelShift = (pageSize == VirtualMemoryObject::hugePageSize) ? 30 : (pageSize == PhysicalAllocator::largePageSize) ? 21 : 12;
+    while(pageCount > 0) {
+
+        // get first entry of the run (entries of all levels are accessed by raw value)
+        PTEntry *entries = nullptr;
+        if(pageSize == VirtualMemoryObject::hugePageSize) entries = reinterpret_cast<PTEntry*>(cursor.getPDPTEntry(address));
+        else if(pageSize == PhysicalAllocator::largePageSize) entries = reinterpret_cast<PTEntry*>(cursor.getPDEntry(address));
+        else entries = cursor.getPTEntry(address);
+        if(entries == nullptr) {
+            Logger::printFormat("[vas] mapping at 0x%x conflicts with larger page, aborting...\n", address);
+            for(;;); // TODO: panic!
+        }
+
+        // fill entries up to the end of the table (or up to entry which still references lower table)
+        usz run = 512 - ((address >> levelShift) & 511);
+        if(run > pageCount) run = pageCount;
+        usz filled = 0;
+        auto referencesTable = [&](PTEntry& entry) {
+            return pageSize != PhysicalAllocator::pageSize && (entry.value & (entryPresent | entryPageSize)) == entryPresent;
+        };
+        while(filled < run && !referencesTable(entries[filled])) {
+            entries[filled].value = (physical + filled * pageSize) | bits;
+            filled++;
+        }
+        address += filled * pageSize;
+        physical += filled * pageSize;
+        pageCount -= filled;
+        if(filled == run) continue;
+
+        // table left behind by unmapping is kept (other cores may have it cached), the page is mapped through it with
+        // smaller pages instead of being promoted
+        usz smallerPageSize = (pageSize == VirtualMemoryObject::hugePageSize) ? PhysicalAllocator::largePageSize : PhysicalAllocator::pageSize;
+        mapRange(cursor, address, physical, pageSize / smallerPageSize, smallerPageSize, flags, global);
+        address += pageSize;
+        physical += pageSize;
+        pageCount--;
+
+    }
+
+}
+
+void VirtualAddressSpace::updateRange(usz address, usz size, u64 mask, u64 bits, TLBShootdown& shootdown) {
+
+    // walk the range without creating tables, skipping those which are not present (range is widened to whole pages,
+    // partial page would never advance the walk)
+    PagingCursor cursor(this, false);
+    usz end = (address + size + (PhysicalAllocator::pageSize - 1)) & ~(static_cast<usz>(PhysicalAllocator::pageSize) - 1);
+    address &= ~(static_cast<usz>(PhysicalAllocator::pageSize) - 1);
+    auto nextBoundary = [](usz value, usz alignment) { return (value | (alignment - 1)) + 1; };
+    auto partiallyCovered = [&](usz pageSize) { return address % pageSize != 0 || end - address < pageSize; };
+    auto update = [&](auto *entry) -> bool {
+        u64 value = (entry->value & ~mask) | bits;
+        if(value == entry->value) return false;
+        entry->value = value;
+        return true;
+    };
+
+    while(address < end) {
+
+        // 1GiB level
+        PDPTEntry *pdptEntry = cursor.getPDPTEntry(address);
+        if(pdptEntry == nullptr) {
+            address = nextBoundary(address, 512ull * VirtualMemoryObject::hugePageSize);
+            continue;
+        }
+        if(!pdptEntry->present) {
+            address = nextBoundary(address, VirtualMemoryObject::hugePageSize);
+            continue;
+        }
+        if(pdptEntry->hugePageReference.pageSize) {
+
+            // page only partially covered by the range is split, so that the rest of it keeps its attributes
+            if(!partiallyCovered(VirtualMemoryObject::hugePageSize) || ((pdptEntry->value & ~mask) | bits) == pdptEntry->value) {
+                if(update(pdptEntry)) shootdown.addRange(reinterpret_cast<void*>(address), 1, true);
+                address = nextBoundary(address, VirtualMemoryObject::hugePageSize);
+                continue;
+            }
+            splitEntry(reinterpret_cast<PTEntry*>(pdptEntry), VirtualMemoryObject::hugePageSize);
+
+        }
+
+        // 2MiB level
+        PDEntry *pdEntry = cursor.getPDEntry(address);
+        if(!pdEntry->largePageReference.present) {
+            address = nextBoundary(address, PhysicalAllocator::largePageSize);
+            continue;
+        }
+        if(pdEntry->largePageReference.pageSize) {
+            if(!partiallyCovered(PhysicalAllocator::largePageSize) || ((pdEntry->value & ~mask) | bits) == pdEntry->value) {
+                if(update(pdEntry)) shootdown.addRange(reinterpret_cast<void*>(address), 1, true);
+                address = nextBoundary(address, PhysicalAllocator::largePageSize);
+                continue;
+            }
+            splitEntry(reinterpret_cast<PTEntry*>(pdEntry), PhysicalAllocator::largePageSize);
+        }
+
+        // 4KiB level, whole run inside the table is updated at once
+        PTEntry *ptEntry = cursor.getPTEntry(address);
+        usz run = 512 - ((address >> 12) & 511);
+        if(run > (end - address) / PhysicalAllocator::pageSize) run = (end - address) / PhysicalAllocator::pageSize;
+        for(usz i = 0; i < run; i++) {
+            if(ptEntry[i].present && update(&ptEntry[i])) shootdown.addRange(reinterpret_cast<void*>(address + i * PhysicalAllocator::pageSize));
+        }
+        address += run * PhysicalAllocator::pageSize;
+
+    }
+
+}
+
+void VirtualAddressSpace::splitEntry(PTEntry *entry, usz pageSize) {
+
+    // lower table maps the same memory with the same attributes, only PAT bit moves for 4KiB pages
+    u64 value = entry->value;
+    usz smallerPageSize = (pageSize == VirtualMemoryObject::hugePageSize) ? PhysicalAllocator::largePageSize : PhysicalAllocator::pageSize;
+    u64 physical = value & 0x000ffffffffff000ull & ~(static_cast<u64>(pageSize) - 1);
+    u64 bits = value & (0xfff0000000000fffull | entryLargePageAttribute);
+    if(smallerPageSize == PhysicalAllocator::pageSize) {
+        bits &= ~(entryPageSize | entryLargePageAttribute);
+        if(value & entryLargePageAttribute) bits |= entrySmallPageAttribute;
+    }
+    void *table = allocateZeroedPage();
+    u64 *entries = reinterpret_cast<u64*>(reinterpret_cast<usz>(table) + CPU::pagingBase);
+    for(usz i = 0; i < 512; i++) entries[i] = (physical + i * smallerPageSize) | bits;
+
+    // table reference does not restrict access, rights stay in the lower entries (translation does not change, so
+    // cached entry of the large page may be used until the changed part is invalidated)
+    u64 reference = reinterpret_cast<u64>(table) | entryPresent | entryWriteEnable;
+    if(this != kernelAddressSpace) reference |= entryUserAccessible;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    entry->value = reference;
+
+}
+
+void VirtualAddressSpace::releaseRegion(VirtualMemoryRegion *region) {
+
+    // mark it free and merge it with free neighbours, region is linked into the list, so they are found in constant time
+    region->type = VirtualMemoryRegion::Type::Free;
+    region->object = nullptr;
+    VirtualMemoryRegion *next = allocationList.getNext(region);
+    if(next != nullptr && next->type == VirtualMemoryRegion::Type::Free) {
+        region->size += next->size;
+        allocationList.remove(next);
+        delete next;
+    }
+    VirtualMemoryRegion *previous = allocationList.getPrevious(region);
+    if(previous != nullptr && previous->type == VirtualMemoryRegion::Type::Free) {
+        previous->size += region->size;
+        allocationList.remove(region);
+        delete region;
+    }
+
+}
+
+void VirtualAddressSpace::changeRange(VirtualMemoryObject *object, usz mappingAddress, usz offset, usz size, u64 mask, u64 bits) {
+
+    TLBShootdown shootdown(this);
+    {
+
+        // object may have been unmapped meanwhile (and other object mapped at the same address), change only its own mapping
+        ScopedReadLock regionsLock(regionLock);
+        VirtualMemoryRegion *region = findRegion(mappingAddress);
+        if(region == nullptr || region->type != VirtualMemoryRegion::Type::Allocated || region->object != object || region->address != mappingAddress) return;
+
+        // update every mapped page in range
+        ScopedSpinlock lock(spinlock);
+        updateRange(mappingAddress + offset, size, mask, bits, shootdown);
+
+    }
+
+    // invalidate outside of spinlock
+    shootdown.flush();
+
+}
+
+bool VirtualAddressSpace::unmapObject(void *address) {
+
+    usz convertedAddress = reinterpret_cast<usz>(address);
+    VirtualMemoryObject *object = nullptr;
+    VirtualMemoryRegion *region = nullptr;
+    TLBShootdown shootdown(this);
+    {
+
+        // lock regions exclusively, then page tables
+        ScopedWriteLock regionsLock(regionLock);
+        ScopedSpinlock lock(spinlock);
+
+        // object has to be mapped exactly at given address
+        region = findRegion(convertedAddress);
+        if(region == nullptr || region->type != VirtualMemoryRegion::Type::Allocated || region->object == nullptr || region->address != convertedAddress) return false;
+
+        // remove all entries, region stays reserved (without object) until no core can use them
+        updateRange(region->address, region->size, ~0ull, 0, shootdown);
+        object = region->object;
+        region->object = nullptr;
+
+    }
+
+    // invalidate outside of spinlock, then release the region
+    shootdown.flush();
+    {
+        ScopedWriteLock regionsLock(regionLock);
+        releaseRegion(region);
+    }
+
+    // object does not have to update this mapping anymore
+    object->removeMapping(this, convertedAddress);
+    return true;
+
+}
+
+VirtualAddressSpace::PagingCursor::PagingCursor(VirtualAddressSpace *space, bool create) : space(space), create(create) {}
+
+VirtualAddressSpace::PagingCursor::~PagingCursor() {
+
+    // return tables which were allocated in batch, but not used
+    for(usz i = 0; i < tablesLeft; i++) PhysicalAllocator::freePage(tableBatch[i]);
+
+}
 
-            // get reference to the entry
-            PTEntry *ptEntry = reinterpret_cast<PTEntry*>(entry);
+VirtualAddressSpace::PDPTEntry *VirtualAddressSpace::PagingCursor::getPDPTEntry(usz address) {
 
-            // fill entry
-            ptEntry->present = 1;
-            ptEntry->writeEnable = (flags & VirtualMemoryObject::writeable) ? 1 : 0;
-            ptEntry->executionDisable = (flags & VirtualMemoryObject::executable) ? 0 : 1;
-            ptEntry->cacheDisable = (flags & VirtualMemoryObject::cacheable) ? 0 : 1;
-            ptEntry->value |= (reinterpret_cast<u64>(page) & ~(0xfff));
+    // look up PDPT only if address is outside of the cached one
+    usz key = address >> 39;
+    if(key != pdptKey) {
 
+        PML4Entry *pml4Entry = &space->mappingStructure[key & 511];
+        if(!pml4Entry->present) {
+            if(!create) return nullptr;
+            pml4Entry->address = reinterpret_cast<usz>(allocateTable()) >> 12;
+            pml4Entry->present = 1;
+            pml4Entry->writeEnable = 1;
+            pml4Entry->userAccessible = (space != kernelAddressSpace) ? 1 : 0;
         }
+        pdptTable = reinterpret_cast<PDPTEntry*>((pml4Entry->address << 12) + CPU::pagingBase);
+        pdptKey = key;
 
     }
 
-}
\ No newline at end of file
+    return &pdptTable[(address >> 30) & 511];
+
+}
+
+VirtualAddressSpace::PDEntry *VirtualAddressSpace::PagingCursor::getPDEntry(usz address) {
+
+    // look up PD only if address is outside of the cached one
+    usz key = address >> 30;
+    if(key != pdKey) {
+
+        PDPTEntry *pdptEntry = getPDPTEntry(address);
+        if(pdptEntry == nullptr || (pdptEntry->present && pdptEntry->hugePageReference.pageSize)) return nullptr;
+        if(!pdptEntry->present) {
+            if(!create) return nullptr;
+            pdptEntry->address = reinterpret_cast<usz>(allocateTable()) >> 12;
+            pdptEntry->present = 1;
+            pdptEntry->writeEnable = 1;
+            pdptEntry->userAccessible = (space != kernelAddressSpace) ? 1 : 0;
+        }
+        pdTable = reinterpret_cast<PDEntry*>((pdptEntry->address << 12) + CPU::pagingBase);
+        pdKey = key;
+
+    }
+
+    return &pdTable[(address >> 21) & 511];
+
+}
+
+VirtualAddressSpace::PTEntry *VirtualAddressSpace::PagingCursor::getPTEntry(usz address) {
+
+    // look up PT only if address is outside of the cached one
+    usz key = address >> 21;
+    if(key != ptKey) {
+
+        PDEntry *pdEntry = getPDEntry(address);
+        if(pdEntry == nullptr || (pdEntry->largePageReference.present && pdEntry->largePageReference.pageSize)) return nullptr;
+        if(!pdEntry->ptReference.present) {
+            if(!create) return nullptr;
+            pdEntry->ptReference.address = reinterpret_cast<usz>(allocateTable()) >> 12;
+            pdEntry->ptReference.present = 1;
+            pdEntry->ptReference.writeEnable = 1;
+            pdEntry->ptReference.userAccessible = (space != kernelAddressSpace) ? 1 : 0;
+        }
+        ptTable = reinterpret_cast<PTEntry*>((pdEntry->ptReference.address << 12) + CPU::pagingBase);
+        ptKey = key;
+
+    }
+
+    return &ptTable[(address >> 12) & 511];
+
+}
+
+void *VirtualAddressSpace::PagingCursor::allocateTable() {
+
+    // tables are allocated in batches, as allocating them one by one is slow
+    if(tablesLeft == 0) {
+        PhysicalAllocator::allocatePages(kernelPID, tableBatch, tableBatchSize);
+        tablesLeft = tableBatchSize;
+    }
+
+    // zero-out the table
+    void *table = tableBatch[--tablesLeft];
+    usz *array = reinterpret_cast<usz*>(reinterpret_cast<usz>(table) + CPU::pagingBase);
+    for(usz i = 0; i < PhysicalAllocator::pageSize / sizeof(usz); i++) array[i] = 0ull;
+    return table;
+
+}
+
+VirtualAddressSpace::VirtualMemoryRegion *VirtualAddressSpace::findRegion(usz address) {
+
+    // iterate and find region containing address
+    for(VirtualMemoryRegion *current = allocationList.getFirst(); current != nullptr; current = allocationList.getNext(current)) {
+        if(address >= current->address && address - current->address < current->size) return current;
+    }
+
+    // address is not managed by this space
+    return nullptr;
+
+}
+
+bool VirtualAddressSpace::resolvePageFault(void *address, u64 errorCode, bool interruptsEnabled) {
+
+    usz pageAddress = reinterpret_cast<usz>(address) & ~(static_cast<usz>(PhysicalAllocator::pageSize) - 1);
+    bool write = (errorCode & pageFaultWrite) != 0;
+    bool replaced = false;
+    bool retry = false;
+    VirtualMemoryObject *object = nullptr;
+    usz regionAddress = 0;
+    usz pageIndex = 0;
+    {
+
+        // look the region up shared, so that faults on different cores do not serialize on the walk over regions
+        ScopedReadLock regionsLock(regionLock);
+
+        // only allocated regions of demand paged objects can be resolved
+        VirtualMemoryRegion *region = findRegion(pageAddress);
+        if(region == nullptr || region->type != VirtualMemoryRegion::Type::Allocated || region->object == nullptr) return false;
+        object = region->object;
+        regionAddress = region->address;
+        pageIndex = (pageAddress - regionAddress) / PhysicalAllocator::pageSize;
+        if(!object->demandPaged()) return false;
+
+        // page tables are still changed exclusively, flags are checked under the same lock as protection changes
+        ScopedSpinlock lock(spinlock);
+
+        // check whether access is allowed at all (page may be protected differently than the object)
+        u8 flags = object->pageFlags(pageIndex);
+        if(write && !(flags & VirtualMemoryObject::writeable)) return false;
+        if((errorCode & pageFaultInstructionFetch) && !(flags & VirtualMemoryObject::executable)) return false;
+
+        // let the object provide the page
+        bool mapWriteable = false;
+        void *page = object->resolveFault(pageIndex, write, &mapWriteable);
+        if(page == nullptr) return false;
+
+        // page is not available yet, it is waited for without the locks (object is kept alive meanwhile)
+        if(reinterpret_cast<usz>(page) == VirtualMemoryObject::faultRetry) {
+            object->acquire();
+            retry = true;
+        }
+
+        else {
+
+            // fill the entry (it may currently point to zero page)
+            PTEntry *ptEntry = reinterpret_cast<PTEntry*>(getMappingEntry(reinterpret_cast<void*>(pageAddress), PhysicalAllocator::pageSize, true));
+            replaced = ptEntry->present;
+            PTEntry newEntry;
+            newEntry.value = reinterpret_cast<u64>(page) & ~(0xfff);
+            newEntry.present = 1;
+            newEntry.writeEnable = (mapWriteable && (flags & VirtualMemoryObject::writeable)) ? 1 : 0;
+            newEntry.executionDisable = (flags & VirtualMemoryObject::executable) ? 0 : 1;
+            newEntry.global = (this == kernelAddressSpace) ? 1 : 0;
+            newEntry.userAccessible = ((flags & VirtualMemoryObject::userMappable) && this != kernelAddressSpace) ? 1 : 0;
+            newEntry.value |= cacheModeBits(flags, PhysicalAllocator::pageSize);
+            ptEntry->value = newEntry.value;
+            if(!replaced) CPU::invalidatePagingEntry(reinterpret_cast<void*>(pageAddress));
+
+            // object may be unmapped (and freed) once the locks are dropped, keep it alive until other mappings are updated
+            if(write) object->acquire();
+
+        }
+
+    }
+
+    // faulting access is retried once the page is available (it may fault again, if it was not mapped meanwhile)
+    if(retry) {
+        bool available = object->waitForPage(pageIndex, interruptsEnabled);
+        object->release();
+        return available;
+    }
+
+    // other cores may still read from previously mapped zero page or shared page, shoot it down (outside of spinlock)
+    if(replaced) {
+        TLBShootdown shootdown(this);
+        shootdown.addRange(reinterpret_cast<void*>(pageAddress));
+        shootdown.flush();
+    }
+
+    // write could commit or copy the page, other mappings of the object have to fault again to see it
+    if(write) {
+        if(object->mappingCount() > 1) object->invalidateMappedPage(pageIndex, this, regionAddress);
+        object->release();
+    }
+
+    return true;
+
+}
@@ -1,9 +1,18 @@
 #pragma once
 #include <driver/arch/cpu.h>
+#include <mem/extents.h>
 #include <mem/physalloc.h>
 #include <util/spinlock.h>
+#include <util/rwlock.h>
 #include <util/types.h>
-#include <util/list.h>
+#include <util/intrusivelist.h>
+#include <util/radixtree.h>
+#include <util/vector.h>
+
+class IBlockDevice;
+class KernelMap;
+class VirtualAddressSpace;
+class TLBShootdown;
 
 /**
  * Class encapsulating virtual memory object
@@ -16,6 +25,30 @@ public:
     static constexpr u8 executable = (1 << 1);
     static constexpr u8 cacheable = (1 << 2);
     static constexpr u8 userMappable = (1 << 3);
+    static constexpr u8 cacheModeShift = 4;
+    static constexpr u8 cacheModeMask = (7 << cacheModeShift);
+
+    /**
+     * @brief Memory types selectable for object mappings, values are indices of PAT entries programmed by CPU::initializePAT
+     */
+    enum class CacheMode : u8 {
+        WriteBack = 0,
+        WriteThrough = 1,
+        UncacheableMinus = 2,
+        Uncacheable = 3,
+        WriteCombining = 4,
+        WriteProtected = 5
+    };
+
+    /**
+     * @brief Value returned (as address) by resolveFault when the access has to be retried later
+     */
+    static constexpr usz faultRetry = ~0ull;
+
+    /**
+     * @brief Size of 1GiB pages, which runs of large pages are promoted to when mapping
+     */
+    static constexpr usz hugePageSize = 1024ull * 1024ull * 1024ull;
 
     /**
      * @brief Constructor
@@ -27,7 +60,7 @@ public:
     /**
      * @brief Destructor
      */
-    ~VirtualMemoryObject();
+    virtual ~VirtualMemoryObject();
     
     /**
      * @brief Returns object size
@@ -37,11 +70,29 @@ public:
     usz objectSize();
 
     /**
-     * @brief Returns whether object is large page aligned
+     * @brief Returns whether object contains large pages
      * @return true if object is large page aligned, false otherwise
      */
     bool largePageAligned();
 
+    /**
+     * @brief Returns count of large pages in the page list
+     * @return Count of large pages
+     */
+    usz largePageCount();
+
+    /**
+     * @brief Returns alignment of virtual address needed to map large pages of the object
+     * @return Alignment of mapping address
+     */
+    usz mappingAlignment();
+
+    /**
+     * @brief Returns needed remainder of mapping address divided by mapping alignment
+     * @return Offset of mapping address from aligned address
+     */
+    usz mappingOffset();
+
     /**
      * @brief Returns objects address
      * @return Object physical address
@@ -55,20 +106,148 @@ public:
     u8 objectFlags();
 
     /**
-     * @brief Returns how many pages the object is containing
-     * @return Page count of object
+     * @brief Returns memory type used for mappings of the object
+     * @return Cache mode of the object
+     */
+    CacheMode cacheMode();
+
+    /**
+     * @brief Sets memory type used for mappings of the object (existing mappings are not changed)
+     * @param mode New cache mode of the object
      */
-    List<void*> *objectPages();
+    void setCacheMode(CacheMode mode);
+
+    /**
+     * @brief Returns physical extents of pages the object is containing
+     * @return Extents of object pages
+     */
+    ExtentList *objectPages();
+
+    /**
+     * @brief Returns whether object pages are mapped on first access instead of when mapping the object
+     * @return true if object is demand paged, false otherwise
+     */
+    bool demandPaged();
+
+    /**
+     * @brief Resolves page fault inside demand paged object
+     * @param pageIndex Index of faulting page inside the object
+     * @param write Whether faulting access was a write
+     * @param mapWriteable Set to whether returned page may be mapped as writeable
+     * @return Physical address of page to be mapped, nullptr if fault cannot be resolved
+     */
+    virtual void *resolveFault(usz pageIndex, bool write, bool *mapWriteable);
+
+    /**
+     * @brief Waits until page, whose fault was resolved with faultRetry, may be provided (default does not wait)
+     * @param pageIndex Index of faulting page inside the object
+     * @param mayWait Whether faulting code ran with interrupts enabled, so that it may be blocked
+     * @return true if access may be retried, false if page cannot be provided
+     * NOTE: called without any locks of the address space held
+     */
+    virtual bool waitForPage(usz pageIndex, bool mayWait);
+
+    /**
+     * @brief Creates copy-on-write clone of the object, sharing its pages until they are written
+     * @return Newly created object, the object itself if it is meant to be shared, nullptr if object cannot be cloned
+     */
+    virtual VirtualMemoryObject *clone();
+
+    /**
+     * @brief Returns how many times the object is mapped in any address space
+     * @return Count of mappings
+     */
+    usz mappingCount();
+
+    /**
+     * @brief Allocates pages of the range upfront, so that accessing them does not need to allocate memory
+     * @param offset Page aligned offset of the range inside the object
+     * @param length Length of the range
+     * @return true if pages were committed, false if object does not support it or range is invalid
+     */
+    virtual bool commit(usz offset, usz length);
+
+    /**
+     * @brief Returns pages of the range to physical allocator, next access to them sees zeroed memory
+     * @param offset Page aligned offset of the range inside the object
+     * @param length Length of the range
+     * @return true if pages were decommitted, false if object does not support it or range is invalid
+     */
+    virtual bool decommit(usz offset, usz length);
+
+    /**
+     * @brief Changes access rights of the range in every mapping of the object (rights cannot exceed those of the object)
+     * @param offset Page aligned offset of the range inside the object
+     * @param length Length of the range
+     * @param accessParameters New access parameters (only writeable and executable flags are used)
+     * @return true if access rights were changed, false if range is invalid
+     */
+    bool protect(usz offset, usz length, u8 accessParameters);
+
+    /**
+     * @brief Returns flags of single page, which may differ from object flags after protect
+     * @param pageIndex Index of 4KiB page inside the object
+     * @param runLength If not nullptr, set to count of pages from pageIndex on, which surely have the same flags
+     * @return Access parameters of the page
+     */
+    u8 pageFlags(usz pageIndex, usz *runLength = nullptr);
+
+    /**
+     * @brief Takes additional reference to the object (creator holds first one, every mapping holds one more)
+     */
+    void acquire();
+
+    /**
+     * @brief Drops reference to the object, object (which has to be allocated on heap) is deleted when last one is dropped
+     */
+    void release();
+
+    /**
+     * @brief Returns shared, always zeroed page used to back untouched pages on read faults
+     * @return Physical address of zero page
+     */
+    static void *getZeroPage();
 
 protected:
 
-    List<void*> *pages = nullptr;
+    friend class VirtualAddressSpace;
+
+    struct Mapping {
+        VirtualAddressSpace *space;
+        usz address;
+    };
+
+    void addMapping(VirtualAddressSpace *space, usz address);
+    void removeMapping(VirtualAddressSpace *space, usz address);
+    struct Protection {
+        usz firstPage;
+        usz pageCount;
+        u8 flags;
+    };
+
+    bool validRange(usz offset, usz length);
+    usz findProtection(usz pageIndex);
+    void updateMappings(usz firstPage, usz pageCount, u64 mask, u64 bits, VirtualAddressSpace *exceptSpace = nullptr, usz exceptAddress = 0);
+    void writeProtectMappings(usz firstPage, usz pageCount);
+    void invalidateMappedPage(usz pageIndex, VirtualAddressSpace *exceptSpace, usz exceptAddress);
+
+    ExtentList *pages = nullptr;
+    Vector<Mapping> *mappings = nullptr;
+    Vector<Protection> *protections = nullptr; // sorted, non-overlapping ranges with flags differing from object flags
     u8 flags = 0;
     usz size = 0;
-    usz referenceCounter = 0;
+    usz referenceCounter = 1;
+    usz mappingCounter = 0;
+    usz mappingUpdates = 0;
     void *prefferedAddress = nullptr;
-    Spinlock spinlock;
+    Spinlock spinlock{"vm object"};
     bool largePageAlignmentNeeded = false;
+    bool pagedOnDemand = false;
+    usz largePages = 0;
+    usz alignment = PhysicalAllocator::pageSize;
+    usz alignmentOffset = 0;
+
+    static inline void *zeroPage = nullptr;
 
 };
 
@@ -79,13 +258,15 @@ class MMIOVirtualMemoryObject : public VirtualMemoryObject {
 
 public:
     /**
-     * @brief Constructor
+     * @brief Constructor - 2MiB aligned part of region is described by large pages, its edges by 4KiB pages
      * @param physicalAddress Address of memory mapped region
      * @param length Length of region
      * @param mappingAddress Address where object should be mapped
      */
     MMIOVirtualMemoryObject(void *physicalAddress, usz length, void *mappingAddress = nullptr);
 
+    VirtualMemoryObject *clone() override;
+
 };
 
 /**
@@ -95,7 +276,7 @@ class MemoryBackedVirtualMemoryObject : public VirtualMemoryObject {
 
 public:
     /**
-     * @brief Constructor
+     * @brief Constructor - if allowed, leading part of region is allocated in large pages and the rest in 4KiB pages
      * @param length Length of region
      * @param disallowLargePages Whether large pages are allowed
      * @param mappingAddress Address where object should be mapped
@@ -111,6 +292,141 @@ public:
      */
     ~MemoryBackedVirtualMemoryObject();
 
+    void *resolveFault(usz pageIndex, bool write, bool *mapWriteable) override;
+
+    /**
+     * @brief Creates copy-on-write clone of the object, sharing its 4KiB pages until they are written
+     * @return Newly created object
+     * NOTE: large pages cannot be shared, so they are copied right away
+     */
+    VirtualMemoryObject *clone() override;
+    bool commit(usz offset, usz length) override;
+
+    /**
+     * @brief Returns pages of the range to physical allocator, next access to them sees zeroed memory
+     * @param offset Page aligned offset of the range inside the object
+     * @param length Length of the range
+     * @return true if pages were decommitted, false if range is invalid
+     * NOTE: large page is released only if range covers it whole, otherwise covered part of it is just zeroed
+     */
+    bool decommit(usz offset, usz length) override;
+
+protected:
+
+    static constexpr usz decommittedPage = 1;
+
+    RadixTree<void*> replacedPages; // 4KiB pages whose frame differs from the extents - frame allocated after decommit or copy, or decommittedPage
+    usz clonesInProgress = 0;
+    u32 ownerPID;
+
+};
+
+/**
+ * @brief Class encapsulating memory object meant to be mapped into several address spaces at once (also in their user parts)
+ */
+class SharedMemoryVirtualMemoryObject : public MemoryBackedVirtualMemoryObject {
+
+public:
+    /**
+     * @brief Constructor - object stays alive as long as its creator or any mapping holds a reference
+     * @param length Length of region
+     * @param write Whether region should be writeable
+     * @param pid PID of process
+     */
+    SharedMemoryVirtualMemoryObject(usz length, bool write = true, u32 pid = kernelPID);
+
+    VirtualMemoryObject *clone() override;
+
+};
+
+/**
+ * @brief Class encapsulating memory object, which pages are allocated on first access
+ */
+class DemandPagedVirtualMemoryObject : public VirtualMemoryObject {
+
+public:
+    /**
+     * @brief Constructor - does not allocate any memory
+     * @param length Length of region
+     * @param mappingAddress Address where object should be mapped
+     * @param write Whether region should be writeable
+     * @param execute Whethter region should be executable
+     * @param cache Whethter region should be cacheable
+     * @param pid PID of process
+     */
+    DemandPagedVirtualMemoryObject(usz length, void *mappingAddress = nullptr, bool write = false, bool execute = false, bool cache = true, u32 pid = kernelPID);
+
+    /**
+     * @brief Destructor - frees committed pages
+     */
+    ~DemandPagedVirtualMemoryObject();
+
+    /**
+     * @brief Returns how many pages were actually allocated
+     * @return Count of committed pages
+     */
+    usz committedPageCount();
+
+    void *resolveFault(usz pageIndex, bool write, bool *mapWriteable) override;
+    VirtualMemoryObject *clone() override;
+    bool commit(usz offset, usz length) override;
+    bool decommit(usz offset, usz length) override;
+
+private:
+
+    static constexpr usz slotsPerTable = PhysicalAllocator::pageSize / sizeof(void*);
+
+    void **getSlot(usz pageIndex, bool create);
+    void freeTable(void **table, usz level);
+    void shareTable(void **table, usz level, usz firstPage, DemandPagedVirtualMemoryObject *target);
+
+    void **rootTable = nullptr;
+    usz tableLevels = 1;
+    usz committedPages = 0;
+    usz clonesInProgress = 0;
+    u32 ownerPID;
+
+};
+
+/**
+ * @brief Class encapsulating read-only memory object backed by range of block device, its pages are shared with other objects through page cache
+ */
+class BlockBackedVirtualMemoryObject : public VirtualMemoryObject {
+
+public:
+    /**
+     * @brief Constructor - does not read anything, pages are read asynchronously on first access
+     * @param device Block device backing the object
+     * @param firstPage Index of first device page (in 4KiB units) backing the object
+     * @param length Length of region
+     * @param mappingAddress Address where object should be mapped
+     * @param execute Whether region should be executable
+     */
+    BlockBackedVirtualMemoryObject(IBlockDevice *device, usz firstPage, usz length, void *mappingAddress = nullptr, bool execute = false);
+
+    void *resolveFault(usz pageIndex, bool write, bool *mapWriteable) override;
+    bool waitForPage(usz pageIndex, bool mayWait) override;
+
+private:
+
+    IBlockDevice *device;
+    usz firstPage;
+
+};
+
+/**
+ * @brief Class encapsulating object which only reserves virtual region, its entries are filled directly by its owner
+ */
+class ReservedVirtualMemoryObject : public VirtualMemoryObject {
+
+public:
+    /**
+     * @brief Constructor - does not allocate any memory, accesses to unfilled entries are not resolved
+     * @param length Length of region
+     * @param mappingAddress Address where object should be mapped
+     */
+    ReservedVirtualMemoryObject(usz length, void *mappingAddress = nullptr);
+
 };
 
 /**
@@ -153,12 +469,36 @@ public:
      */
     void *mapObject(VirtualMemoryObject *object);
 
+    /**
+     * @brief Unmaps object from address space and releases its virtual region
+     * @param address Address where the object was mapped
+     * @return true if object was unmapped, false if no object is mapped at the address
+     */
+    bool unmapObject(void *address);
+
+    /**
+     * @brief Creates copy-on-write clone of user part of address space
+     * @return Newly created address space, nullptr if called on kernel address space or if some writeable object cannot be cloned
+     */
+    VirtualAddressSpace *clone();
+
     /**
      * @brief Returns physical address of mapping structure
      * @return Physical address of mapping structure
      */
     void *getCR3();
 
+    /**
+     * @brief Loads address space on currently executing core
+     */
+    void activate();
+
+    /**
+     * @brief Returns mask of cores which may hold TLB entries of this address space
+     * @return Bitmask of cores, indexed by LAPIC ID
+     */
+    u64 getActiveCores();
+
     /**
      * @brief Adjusts kernel memory map to be fully higher half
      */
@@ -170,8 +510,42 @@ public:
      */
     static VirtualAddressSpace *getKernelVirtualAddressSpace();
 
+    /**
+     * @brief Returns address space loaded on currently executing core
+     * @return Object of currently loaded address space
+     */
+    static VirtualAddressSpace *getCurrentVirtualAddressSpace();
+
+    /**
+     * @brief Tries to resolve page fault in address space owning faulting address
+     * @param address Faulting address
+     * @param errorCode Error code pushed by the CPU
+     * @param interruptsEnabled Whether faulting code ran with interrupts enabled (so it may wait for page to be read)
+     * @return true if fault was resolved and access may be retried, false otherwise
+     */
+    static bool handlePageFault(void *address, u64 errorCode, bool interruptsEnabled);
+
 private:
 
+    friend class VirtualMemoryObject;
+    friend class TLBShootdown;
+    friend class KernelMap;
+
+    static constexpr u64 pageFaultPresent = (1 << 0);
+    static constexpr u64 pageFaultWrite = (1 << 1);
+    static constexpr u64 pageFaultInstructionFetch = (1 << 4);
+
+    static constexpr u64 entryPresent = (1ull << 0);
+    static constexpr u64 entryWriteEnable = (1ull << 1);
+    static constexpr u64 entryUserAccessible = (1ull << 2);
+    static constexpr u64 entryWriteThrough = (1ull << 3);
+    static constexpr u64 entryCacheDisable = (1ull << 4);
+    static constexpr u64 entryPageSize = (1ull << 7);
+    static constexpr u64 entrySmallPageAttribute = (1ull << 7);
+    static constexpr u64 entryGlobal = (1ull << 8);
+    static constexpr u64 entryLargePageAttribute = (1ull << 12);
+    static constexpr u64 entryExecutionDisable = (1ull << 63);
+
     union PML4Entry {
 
         struct {
@@ -206,6 +580,22 @@ private:
             u64 executionDisable: 1;
         };
 
+        struct {
+            u64 present : 1;
+            u64 writeEnable : 1;
+            u64 userAccessible : 1;
+            u64 writeThrough : 1;
+            u64 cacheDisable : 1;
+            u64 accessed : 1;
+            u64 dirty : 1;
+            u64 pageSize : 1;
+            u64 global : 1;
+            u64 reserved : 21;
+            u64 address : 22;
+            u64 ignored : 11;
+            u64 executionDisable: 1;
+        } hugePageReference;
+
         u64 value;
 
     } __attribute__((packed));
@@ -278,19 +668,70 @@ private:
         VirtualMemoryObject *object = nullptr;
         usz size;
         usz address;
+        IntrusiveLink<VirtualMemoryRegion> link;
+
+    };
+
+    /**
+     * Cursor walking paging structures, tables of upper levels are looked up again only when crossing their boundaries
+     */
+    class PagingCursor {
+
+    public:
+
+        PagingCursor(VirtualAddressSpace *space, bool create);
+        ~PagingCursor();
+
+        PDPTEntry *getPDPTEntry(usz address);
+        PDEntry *getPDEntry(usz address);
+        PTEntry *getPTEntry(usz address);
+
+    private:
+
+        static constexpr usz tableBatchSize = 16;
+
+        void *allocateTable();
+
+        VirtualAddressSpace *space;
+        bool create;
+        usz pdptKey = ~0ull;
+        PDPTEntry *pdptTable = nullptr;
+        usz pdKey = ~0ull;
+        PDEntry *pdTable = nullptr;
+        usz ptKey = ~0ull;
+        PTEntry *ptTable = nullptr;
+        void *tableBatch[tableBatchSize];
+        usz tablesLeft = 0;
 
     };
 
     static inline VirtualAddressSpace *kernelAddressSpace = nullptr;
     static inline bool kernelAddressSpaceInitialized = false;
+    static inline VirtualAddressSpace *currentAddressSpaces[CPU::maxCoreCount] = {};
+    static inline u16 nextProcessContextIdentifier = 1;
     static void *allocateZeroedPage();
+    static u64 cacheModeBits(u8 flags, usz pageSize);
 
-    void *getMappingEntry(void *address, bool large = false, bool create = false);
+    void *getMappingEntry(void *address, usz pageSize = PhysicalAllocator::pageSize, bool create = false);
+    void *mapObjectAt(VirtualMemoryObject *object, usz address);
     void doMapping(VirtualMemoryRegion *region);
+    void mapRange(PagingCursor& cursor, usz address, usz physical, usz pageCount, usz pageSize, u8 flags, bool global);
+    void updateRange(usz address, usz size, u64 mask, u64 bits, TLBShootdown& shootdown);
+    void splitEntry(PTEntry *entry, usz pageSize);
+    void releaseRegion(VirtualMemoryRegion *region);
+    void changeRange(VirtualMemoryObject *object, usz mappingAddress, usz offset, usz size, u64 mask, u64 bits);
+    void markStale(u64 cores);
+    VirtualMemoryRegion *findRegion(usz address);
+    bool resolvePageFault(void *address, u64 errorCode, bool interruptsEnabled);
 
     void *cr3Value = nullptr;
     PML4Entry *mappingStructure = nullptr;
-    List<VirtualMemoryRegion*> *allocationList = nullptr;
-    Spinlock spinlock;
+    IntrusiveList<VirtualMemoryRegion, &VirtualMemoryRegion::link> allocationList;
+    RWLock regionLock; // guards allocationList, taken before spinlock
+    Spinlock spinlock{"vas paging structures"}; // guards paging structures
+    u64 activeCores = 0;
+    u64 staleCores = 0;
+    u16 processContextIdentifier = 0;
+    bool flushOnActivation = false;
 
 };
\ No newline at end of file
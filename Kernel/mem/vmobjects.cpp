@@ -1,78 +1,841 @@
 #include "vas.h"
+#include "mem/pagecache.h"
+
+static void *allocateZeroedPage(u32 pid) {
+
+    // allocate page and zero it using direct mapping
+    void *page = PhysicalAllocator::allocatePage(pid);
+    usz *array = reinterpret_cast<usz*>(reinterpret_cast<usz>(page) + CPU::pagingBase);
+    for(usz i = 0; i < PhysicalAllocator::pageSize / sizeof(usz); i++) array[i] = 0ull;
+    return page;
+
+}
 
 VirtualMemoryObject::VirtualMemoryObject(u8 accessParameters, void *mappingAddress) {
 
-    // create a list of all pages contained in this object
-    pages = new List<void*>();
+    // create a list of all pages contained in this object and of its mappings
+    pages = new ExtentList();
+    mappings = new Vector<Mapping>();
 
     // set all values
-    flags = accessParameters;
+    flags = accessParameters & ~cacheModeMask;
     prefferedAddress = mappingAddress;
+
+    // non-cacheable objects keep using PCD only, which selects UC- (MTRRs may still make the region write-combining)
+    if(!(flags & cacheable)) setCacheMode(CacheMode::UncacheableMinus);
     
 }
 
 VirtualMemoryObject::~VirtualMemoryObject() {
-    // free the list
+    // free the lists
     delete pages;
+    delete mappings;
+    delete protections;
 }
 
 usz VirtualMemoryObject::objectSize() { return size; }
 bool VirtualMemoryObject::largePageAligned() {return largePageAlignmentNeeded; }
+usz VirtualMemoryObject::largePageCount() { return largePages; }
+usz VirtualMemoryObject::mappingAlignment() { return alignment; }
+usz VirtualMemoryObject::mappingOffset() { return alignmentOffset; }
 void *VirtualMemoryObject::objectAddress() { return prefferedAddress; }
 u8 VirtualMemoryObject::objectFlags() { return flags; }
-List<void*> *VirtualMemoryObject::objectPages() { return pages; }
+VirtualMemoryObject::CacheMode VirtualMemoryObject::cacheMode() { return static_cast<CacheMode>((flags & cacheModeMask) >> cacheModeShift); }
+ExtentList *VirtualMemoryObject::objectPages() { return pages; }
+bool VirtualMemoryObject::demandPaged() { return pagedOnDemand; }
+
+void *VirtualMemoryObject::resolveFault(usz, bool, bool *) {
+
+    // objects are fully mapped by default, so there is nothing to resolve
+    return nullptr;
+
+}
+
+bool VirtualMemoryObject::waitForPage(usz, bool) {
+
+    // pages are provided right away, the access is just retried
+    return true;
+
+}
+
+VirtualMemoryObject *VirtualMemoryObject::clone() {
+
+    // object which cannot be written may be shared, pages of others are not tracked by default, so they cannot be copied
+    return (flags & writeable) ? nullptr : this;
+
+}
+
+usz VirtualMemoryObject::mappingCount() { return __atomic_load_n(&mappingCounter, __ATOMIC_ACQUIRE); }
+
+void VirtualMemoryObject::acquire() { __atomic_fetch_add(&referenceCounter, 1, __ATOMIC_RELAXED); }
+
+void VirtualMemoryObject::release() {
+
+    // last reference (owner or mapping) destroys the object
+    if(__atomic_sub_fetch(&referenceCounter, 1, __ATOMIC_ACQ_REL) == 0) delete this;
+
+}
+
+void VirtualMemoryObject::addMapping(VirtualAddressSpace *space, usz address) {
+
+    // remember where object is mapped, so changes of its pages can be propagated, mapping keeps the object alive
+    acquire();
+    ScopedSpinlock lock(spinlock);
+    mappings->appendBack(Mapping { space, address });
+    __atomic_fetch_add(&mappingCounter, 1, __ATOMIC_ACQ_REL);
+
+}
+
+void VirtualMemoryObject::removeMapping(VirtualAddressSpace *space, usz address) {
+
+    // forget the mapping
+    bool found = false;
+    {
+        ScopedSpinlock lock(spinlock);
+        for(usz i = 0; i < mappings->size(); i++) {
+            if(mappings->get(i).space != space || mappings->get(i).address != address) continue;
+            mappings->remove(i);
+            __atomic_fetch_sub(&mappingCounter, 1, __ATOMIC_ACQ_REL);
+            found = true;
+            break;
+        }
+    }
+
+    // updates which took snapshot with the mapping may still use the space, wait until they are done
+    while(__atomic_load_n(&mappingUpdates, __ATOMIC_ACQUIRE) != 0) CPU::pause();
+
+    // drop reference held by the mapping (outside of spinlock, as it may destroy the object)
+    if(found) release();
+
+}
+
+void VirtualMemoryObject::updateMappings(usz firstPage, usz pageCount, u64 mask, u64 bits, VirtualAddressSpace *exceptSpace, usz exceptAddress) {
+
+    // take snapshot of mappings, as spaces cannot be locked while holding object spinlock (removeMapping waits until
+    // the update is done, so spaces of the snapshot stay alive)
+    Vector<Mapping> snapshot;
+    {
+        ScopedSpinlock lock(spinlock);
+        for(usz i = 0; i < mappings->size(); i++) snapshot.appendBack(mappings->get(i));
+        __atomic_fetch_add(&mappingUpdates, 1, __ATOMIC_ACQ_REL);
+    }
+
+    // update entries of the range in every mapping, space checks that the object is still mapped there
+    for(usz i = 0; i < snapshot.size(); i++) {
+        if(snapshot[i].space == exceptSpace && snapshot[i].address == exceptAddress) continue;
+        snapshot[i].space->changeRange(this, snapshot[i].address, firstPage * PhysicalAllocator::pageSize, pageCount * PhysicalAllocator::pageSize, mask, bits);
+    }
+    __atomic_fetch_sub(&mappingUpdates, 1, __ATOMIC_ACQ_REL);
+
+}
+
+void VirtualMemoryObject::writeProtectMappings(usz firstPage, usz pageCount) {
+
+    // remove write access to the range from every mapping
+    updateMappings(firstPage, pageCount, VirtualAddressSpace::entryWriteEnable, 0);
+
+}
+
+void VirtualMemoryObject::invalidateMappedPage(usz pageIndex, VirtualAddressSpace *exceptSpace, usz exceptAddress) {
+
+    // unmap the page everywhere else, next access will fault and map current page
+    updateMappings(pageIndex, 1, ~0ull, 0, exceptSpace, exceptAddress);
+
+}
+
+bool VirtualMemoryObject::commit(usz, usz) {
+
+    // pages of objects are allocated when they are created by default
+    return false;
+
+}
+
+bool VirtualMemoryObject::decommit(usz, usz) {
+
+    // pages of objects are not tracked by default, so they cannot be released one by one
+    return false;
+
+}
+
+bool VirtualMemoryObject::protect(usz offset, usz length, u8 accessParameters) {
+
+    if(!validRange(offset, length)) return false;
+
+    // rights of the range cannot exceed rights of the object
+    constexpr u8 protectable = writeable | executable;
+    u8 newFlags = (flags & ~protectable) | (accessParameters & flags & protectable);
+    usz firstPage = offset / PhysicalAllocator::pageSize;
+    usz pageCount = length / PhysicalAllocator::pageSize;
+    usz endPage = firstPage + pageCount;
+    {
+        ScopedSpinlock lock(spinlock);
+        if(protections == nullptr) __atomic_store_n(&protections, new Vector<Protection>(), __ATOMIC_RELEASE);
+
+        // range which starts before the new one is cut, its part after the new one (if any) is kept separately
+        usz index = findProtection(firstPage);
+        if(index < protections->size() && protections->get(index).firstPage < firstPage) {
+            Protection head = protections->get(index);
+            protections->get(index).pageCount = firstPage - head.firstPage;
+            index++;
+            if(head.firstPage + head.pageCount > endPage) protections->insertAt(Protection { endPage, head.firstPage + head.pageCount - endPage, head.flags }, index);
+        }
+
+        // ranges covered by the new one are removed, the one crossing its end is cut
+        while(index < protections->size() && protections->get(index).firstPage < endPage) {
+            Protection& current = protections->get(index);
+            usz currentEnd = current.firstPage + current.pageCount;
+            if(currentEnd > endPage) {
+                current.firstPage = endPage;
+                current.pageCount = currentEnd - endPage;
+                break;
+            }
+            protections->remove(index);
+        }
+
+        // pages with object flags are not kept, new range is merged with neighbours having the same flags
+        if(newFlags != flags) {
+            protections->insertAt(Protection { firstPage, pageCount, newFlags }, index);
+            if(index + 1 < protections->size() && protections->get(index + 1).firstPage == endPage && protections->get(index + 1).flags == newFlags) {
+                protections->get(index).pageCount += protections->get(index + 1).pageCount;
+                protections->remove(index + 1);
+            }
+            if(index > 0) {
+                Protection& previous = protections->get(index - 1);
+                if(previous.firstPage + previous.pageCount == firstPage && previous.flags == newFlags) {
+                    previous.pageCount += protections->get(index).pageCount;
+                    protections->remove(index);
+                }
+            }
+        }
+    }
+
+    // entries of demand paged objects are removed, as pages may be mapped read-only on purpose (zero page, shared pages)
+    if(pagedOnDemand) updateMappings(firstPage, pageCount, ~0ull, 0);
+    else {
+        u64 bits = (newFlags & writeable) ? VirtualAddressSpace::entryWriteEnable : 0;
+        if(!(newFlags & executable)) bits |= VirtualAddressSpace::entryExecutionDisable;
+        updateMappings(firstPage, pageCount, VirtualAddressSpace::entryWriteEnable | VirtualAddressSpace::entryExecutionDisable, bits);
+    }
+    return true;
+
+}
+
+u8 VirtualMemoryObject::pageFlags(usz pageIndex, usz *runLength) {
+
+    // most objects are never protected, do not lock them
+    usz pageCount = size / PhysicalAllocator::pageSize;
+    if(__atomic_load_n(&protections, __ATOMIC_ACQUIRE) == nullptr) {
+        if(runLength != nullptr) *runLength = (pageIndex < pageCount) ? pageCount - pageIndex : 1;
+        return flags;
+    }
+
+    // page either lies in the first range ending after it, or before it (then it has object flags)
+    ScopedSpinlock lock(spinlock);
+    usz index = findProtection(pageIndex);
+    if(index < protections->size() && protections->get(index).firstPage <= pageIndex) {
+        const Protection& protection = protections->get(index);
+        if(runLength != nullptr) *runLength = protection.firstPage + protection.pageCount - pageIndex;
+        return protection.flags;
+    }
+    if(runLength != nullptr) {
+        usz runEnd = (index < protections->size()) ? protections->get(index).firstPage : pageCount;
+        *runLength = (runEnd > pageIndex) ? runEnd - pageIndex : 1;
+    }
+    return flags;
+
+}
+
+usz VirtualMemoryObject::findProtection(usz pageIndex) {
+
+    // binary search for the first range ending after the page, ranges do not overlap, so their ends are sorted too
+    usz low = 0;
+    usz high = protections->size();
+    while(low < high) {
+        usz middle = low + (high - low) / 2;
+        const Protection& protection = protections->get(middle);
+        if(protection.firstPage + protection.pageCount <= pageIndex) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+
+}
+
+bool VirtualMemoryObject::validRange(usz offset, usz length) {
+
+    // range has to be page aligned, non-empty and inside the object
+    if(offset % PhysicalAllocator::pageSize != 0 || length % PhysicalAllocator::pageSize != 0 || length == 0) return false;
+    return offset < size && length <= size - offset;
+
+}
+
+void *VirtualMemoryObject::getZeroPage() {
+
+    // return zero page if it was already allocated
+    void *page = __atomic_load_n(&zeroPage, __ATOMIC_ACQUIRE);
+    if(page != nullptr) return page;
+
+    // otherwise allocate it, if other core was faster, use its page
+    void *newPage = allocateZeroedPage(kernelPID);
+    void *expected = nullptr;
+    if(!__atomic_compare_exchange_n(&zeroPage, &expected, newPage, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        PhysicalAllocator::freePage(newPage);
+        return expected;
+    }
+    return newPage;
+
+}
+
+void VirtualMemoryObject::setCacheMode(CacheMode mode) {
+
+    // cacheable flag keeps meaning write-back, so it is updated together with the mode
+    flags = (flags & ~(cacheModeMask | cacheable)) | (static_cast<u8>(mode) << cacheModeShift);
+    if(mode == CacheMode::WriteBack) flags |= cacheable;
+
+}
 
 MMIOVirtualMemoryObject::MMIOVirtualMemoryObject(void *physicalAddress, usz length, void *mappingAddress) 
     : VirtualMemoryObject(writeable, mappingAddress) {
     
     // NOTE: physical address should always be page aligned to page size when calling this function
     // calculate all needed values
-    bool largePages = (length > PhysicalAllocator::largePageSize);
-    usz pageSize = largePages ? PhysicalAllocator::largePageSize : PhysicalAllocator::pageSize;
-    usz pageCount = (length + (pageSize - 1)) / pageSize;
     usz startingAddress = reinterpret_cast<usz>(physicalAddress);
+    usz endingAddress = startingAddress + ((length + (PhysicalAllocator::pageSize - 1)) & ~(static_cast<usz>(PhysicalAllocator::pageSize) - 1));
+    usz largeStart = (startingAddress + (PhysicalAllocator::largePageSize - 1)) & ~(static_cast<usz>(PhysicalAllocator::largePageSize) - 1);
+    usz largeEnd = endingAddress & ~(static_cast<usz>(PhysicalAllocator::largePageSize) - 1);
+
+    // large pages are used only if region contains aligned 2MiB and preffered address keeps it aligned
+    bool largePagesUsed = largeEnd > largeStart;
+    if(mappingAddress != nullptr && (reinterpret_cast<usz>(mappingAddress) - startingAddress) % PhysicalAllocator::largePageSize != 0) largePagesUsed = false;
+    if(!largePagesUsed) largeStart = largeEnd = endingAddress;
 
-    // add all addresses to the list
-    for(usz i = 0; i < pageCount; i++) {
-        pages->appendBack(reinterpret_cast<void*>(startingAddress + i * pageSize));
-        size += pageSize;
+    // describe the region by extents - small pages before the large ones, large pages and small pages after them
+    pages->appendRun(reinterpret_cast<void*>(startingAddress), (largeStart - startingAddress) / PhysicalAllocator::pageSize);
+    pages->appendRun(reinterpret_cast<void*>(largeStart), (largeEnd - largeStart) / PhysicalAllocator::largePageSize, PhysicalAllocator::largePageSize);
+    pages->appendRun(reinterpret_cast<void*>(largeEnd), (endingAddress - largeEnd) / PhysicalAllocator::pageSize);
+    size = endingAddress - startingAddress;
+
+    // set info about large pages, virtual address congruent with physical one keeps them aligned
+    if(largePagesUsed) {
+        largePageAlignmentNeeded = true;
+        largePages = (largeEnd - largeStart) / PhysicalAllocator::largePageSize;
+        usz hugeStart = (largeStart + (hugePageSize - 1)) & ~(hugePageSize - 1);
+        alignment = (hugeStart + hugePageSize <= largeEnd && mappingAddress == nullptr) ? hugePageSize : PhysicalAllocator::largePageSize;
+        alignmentOffset = startingAddress % alignment;
     }
 
-    // set info about large pages
-    largePageAlignmentNeeded = largePages;
+}
+
+VirtualMemoryObject *MMIOVirtualMemoryObject::clone() {
+
+    // device memory cannot be copied, the clone maps the same registers
+    return this;
 
 }
 
 MemoryBackedVirtualMemoryObject::MemoryBackedVirtualMemoryObject(usz length, bool disallowLargePages, void *mappingAddress, bool write, bool execute, bool cache, u32 pid)
-    : VirtualMemoryObject((write ? writeable : 0) | (execute ? executable : 0) | (cache ? cacheable : 0), mappingAddress) {
+    : VirtualMemoryObject((write ? writeable : 0) | (execute ? executable : 0) | (cache ? cacheable : 0), mappingAddress), ownerPID(pid) {
 
     // check whether large pages are an option
     bool largePagesUsed = !disallowLargePages;
     if(mappingAddress != nullptr && (reinterpret_cast<u64>(mappingAddress) % PhysicalAllocator::largePageSize) != 0) largePagesUsed = false;
     if(length < (PhysicalAllocator::largePageSize)) largePagesUsed = false;
 
-    // calculate count of pages needed to be allocated
-    usz pageSize = largePagesUsed ? PhysicalAllocator::largePageSize : PhysicalAllocator::pageSize;
-    usz pageCount = (length + (pageSize - 1)) / pageSize;
+    // calculate count of pages needed to be allocated, only the remainder is allocated in small pages
+    usz largePageCount = largePagesUsed ? length / PhysicalAllocator::largePageSize : 0;
+    usz remainder = length - largePageCount * PhysicalAllocator::largePageSize;
+    usz smallPageCount = (remainder + (PhysicalAllocator::pageSize - 1)) / PhysicalAllocator::pageSize;
 
-    // allocate pages and add them to the list
-    for(usz i = 0; i < pageCount; i++) {
-        void *newlyAllocatedPage = PhysicalAllocator::allocatePage(pid, largePagesUsed);
-        pages->appendBack(newlyAllocatedPage);
-        size += pageSize;
+    // allocate pages and add them to the extents (contiguous ones are merged)
+    for(usz i = 0; i < largePageCount; i++) {
+        pages->append(PhysicalAllocator::allocatePage(pid, true), PhysicalAllocator::largePageSize);
+        size += PhysicalAllocator::largePageSize;
+    }
+    for(usz i = 0; i < smallPageCount; i++) {
+        pages->append(PhysicalAllocator::allocatePage(pid));
+        size += PhysicalAllocator::pageSize;
     }
 
-    // set the flag if using large pages
-    if(largePagesUsed) largePageAlignmentNeeded = true;
+    // set info about large pages, if first one is 1GiB aligned, the run may be mapped using huge pages
+    if(largePageCount > 0) {
+        largePageAlignmentNeeded = true;
+        largePages = largePageCount;
+        usz firstPage = reinterpret_cast<usz>(pages->getPage(0));
+        alignment = (largePageCount >= hugePageSize / PhysicalAllocator::largePageSize && mappingAddress == nullptr) ? hugePageSize : PhysicalAllocator::largePageSize;
+        alignmentOffset = firstPage % alignment;
+    }
 
 }
 
 MemoryBackedVirtualMemoryObject::~MemoryBackedVirtualMemoryObject() {
 
-    // free all allocated pages
-    for(usz i = 0; i < pages->size(); i++) PhysicalAllocator::freePage(pages->get(i));
+    // free all allocated pages, except for those already released by decommit
+    pages->forEach([&](const Extent& extent) {
+        for(usz i = 0; i < extent.pageCount; i++) {
+            if(replacedPages.get((extent.offset + i * extent.pageSize) / PhysicalAllocator::pageSize) != nullptr) continue;
+            PhysicalAllocator::freePage(reinterpret_cast<void*>(extent.address + i * extent.pageSize));
+        }
+    });
+
+    // free pages allocated after decommit
+    replacedPages.forEach([](u64, void *&page) {
+        if(reinterpret_cast<usz>(page) != decommittedPage) PhysicalAllocator::freePage(page);
+    });
+
+    // NOTE: the extents will be removed in base class destructor
+
+}
+
+void *MemoryBackedVirtualMemoryObject::resolveFault(usz pageIndex, bool write, bool *mapWriteable) {
+
+    // lock object spinlock
+    ScopedSpinlock lock(spinlock);
+
+    // check bounds
+    if(pageIndex >= size / PhysicalAllocator::pageSize) return nullptr;
+
+    // decommitted page is read, map shared zero page until it is written
+    void **slot = replacedPages.findSlot(pageIndex);
+    if(slot != nullptr && reinterpret_cast<usz>(*slot) == decommittedPage) {
+        if(!write) {
+            *mapWriteable = false;
+            return getZeroPage();
+        }
+        *slot = allocateZeroedPage(ownerPID);
+        *mapWriteable = true;
+        return *slot;
+    }
+
+    // page which was not replaced stays in its frame, shared page is mapped read-only until it is written
+    // NOTE: large frames are never shared (their reference count is 0)
+    void *page = (slot != nullptr && *slot != nullptr) ? *slot : pages->getPhysicalAddress(pageIndex * PhysicalAllocator::pageSize);
+    bool shared = PhysicalAllocator::getPageReferenceCount(page) > 1;
+    if(!write || !shared) {
+        *mapWriteable = !shared;
+        return page;
+    }
+
+    // other mappings could still write to the page until running clone write-protects them
+    if(clonesInProgress > 0) return reinterpret_cast<void*>(faultRetry);
+
+    // copy the page and drop reference to the shared one
+    void *copy = PhysicalAllocator::allocatePage(ownerPID);
+    usz *source = reinterpret_cast<usz*>(reinterpret_cast<usz>(page) + CPU::pagingBase);
+    usz *destination = reinterpret_cast<usz*>(reinterpret_cast<usz>(copy) + CPU::pagingBase);
+    for(usz i = 0; i < PhysicalAllocator::pageSize / sizeof(usz); i++) destination[i] = source[i];
+    PhysicalAllocator::freePage(page);
+    replacedPages.set(pageIndex, copy);
+    *mapWriteable = true;
+    return copy;
+
+}
+
+VirtualMemoryObject *MemoryBackedVirtualMemoryObject::clone() {
+
+    // create empty object with the same parameters, it is paged on demand, so it does not need any alignment
+    MemoryBackedVirtualMemoryObject *newObject = new MemoryBackedVirtualMemoryObject(0, true, nullptr, false, false, false, ownerPID);
+    newObject->flags = flags;
+    newObject->size = size;
+    newObject->largePages = largePages;
+    newObject->pagedOnDemand = true;
+
+    // ranges of pages shared with the clone
+    struct SharedRange {
+        usz firstPage;
+        usz pageCount;
+    };
+    Vector<SharedRange> sharedRanges;
+    auto addShared = [&](usz firstPage, usz pageCount) {
+        if(sharedRanges.size() > 0) {
+            SharedRange& last = sharedRanges[sharedRanges.size() - 1];
+            if(last.firstPage + last.pageCount == firstPage) {
+                last.pageCount += pageCount;
+                return;
+            }
+        }
+        sharedRanges.appendBack(SharedRange { firstPage, pageCount });
+    };
+
+    // no one can access new object yet, so it does not need locking
+    {
+        ScopedSpinlock lock(spinlock);
+
+        // 4KiB frames are shared until written, large frames cannot be referenced, so they are copied right away
+        // NOTE: frames which were replaced stay described by the extents, but neither of the objects uses them
+        constexpr usz pagesPerLarge = PhysicalAllocator::largePageSize / PhysicalAllocator::pageSize;
+        pages->forEach([&](const Extent& extent) {
+            for(usz i = 0; i < extent.pageCount; i++) {
+                void *frame = reinterpret_cast<void*>(extent.address + i * extent.pageSize);
+                usz pageIndex = (extent.offset + i * extent.pageSize) / PhysicalAllocator::pageSize;
+                bool replaced = replacedPages.get(pageIndex) != nullptr;
+                if(extent.pageSize == PhysicalAllocator::pageSize) {
+                    if(!replaced) PhysicalAllocator::referencePage(frame);
+                    newObject->pages->append(frame);
+                    addShared(pageIndex, 1);
+                    continue;
+                }
+                if(replaced) {
+                    newObject->pages->append(frame, extent.pageSize);
+                    addShared(pageIndex, pagesPerLarge);
+                    continue;
+                }
+                void *copy = PhysicalAllocator::allocatePage(ownerPID, true);
+                usz *source = reinterpret_cast<usz*>(reinterpret_cast<usz>(frame) + CPU::pagingBase);
+                usz *destination = reinterpret_cast<usz*>(reinterpret_cast<usz>(copy) + CPU::pagingBase);
+                for(usz j = 0; j < PhysicalAllocator::largePageSize / sizeof(usz); j++) destination[j] = source[j];
+                newObject->pages->append(copy, extent.pageSize);
+            }
+        });
+
+        // pages replaced after decommit or copy are shared as well
+        replacedPages.forEach([&](u64 pageIndex, void *&page) {
+            if(reinterpret_cast<usz>(page) != decommittedPage) PhysicalAllocator::referencePage(page);
+            newObject->replacedPages.set(pageIndex, page);
+        });
+        if(protections != nullptr) {
+            newObject->protections = new Vector<Protection>();
+            protections->forEach([&](Protection& protection) { newObject->protections->appendBack(protection); });
+        }
+
+        // writes to shared pages are resolved by faults from now on
+        pagedOnDemand = true;
+        clonesInProgress++;
+
+    }
+
+    // existing mappings of shared pages have to fault on next write (mappings of large frames stay writeable)
+    sharedRanges.forEach([&](SharedRange& range) { writeProtectMappings(range.firstPage, range.pageCount); });
+
+    // allow copying of shared pages again
+    {
+        ScopedSpinlock lock(spinlock);
+        clonesInProgress--;
+    }
+
+    return newObject;
+
+}
+
+bool MemoryBackedVirtualMemoryObject::commit(usz offset, usz length) {
+
+    if(!validRange(offset, length)) return false;
+
+    // allocate only decommitted pages, the rest of the object is allocated upfront
+    ScopedSpinlock lock(spinlock);
+    usz firstPage = offset / PhysicalAllocator::pageSize;
+    for(usz i = firstPage; i < firstPage + length / PhysicalAllocator::pageSize; i++) {
+        void **slot = replacedPages.findSlot(i);
+        if(slot != nullptr && reinterpret_cast<usz>(*slot) == decommittedPage) *slot = allocateZeroedPage(ownerPID);
+    }
+    return true;
+
+}
+
+bool MemoryBackedVirtualMemoryObject::decommit(usz offset, usz length) {
+
+    if(!validRange(offset, length)) return false;
+
+    // detach pages from the object, faults from now on see decommitted pages
+    Vector<void*> released;
+    usz firstPage = offset / PhysicalAllocator::pageSize;
+    usz endPage = firstPage + length / PhysicalAllocator::pageSize;
+    constexpr usz pagesPerLarge = PhysicalAllocator::largePageSize / PhysicalAllocator::pageSize;
+    {
+        ScopedSpinlock lock(spinlock);
+        usz i = firstPage;
+        while(i < endPage) {
+
+            // find frame containing the page, large frame which was already released is tracked by its 4KiB pages
+            const Extent& extent = pages->getExtentAt(i * PhysicalAllocator::pageSize);
+            usz extentPage = extent.offset / PhysicalAllocator::pageSize;
+            usz framePage = (extent.pageSize == PhysicalAllocator::pageSize) ? i : extentPage + (i - extentPage) / pagesPerLarge * pagesPerLarge;
+            if(extent.pageSize == PhysicalAllocator::pageSize || replacedPages.get(framePage) != nullptr) {
+                void **slot = replacedPages.getSlot(i);
+                if(*slot == nullptr) released.appendBack(pages->getPhysicalAddress(i * PhysicalAllocator::pageSize));
+                else if(reinterpret_cast<usz>(*slot) != decommittedPage) released.appendBack(*slot);
+                *slot = reinterpret_cast<void*>(decommittedPage);
+                i++;
+                continue;
+            }
+
+            // whole large frame is released at once
+            if(framePage == i && endPage - i >= pagesPerLarge) {
+                released.appendBack(pages->getPhysicalAddress(i * PhysicalAllocator::pageSize));
+                for(usz j = 0; j < pagesPerLarge; j++) replacedPages.set(i + j, reinterpret_cast<void*>(decommittedPage));
+                i += pagesPerLarge;
+                continue;
+            }
+
+            // part of large frame cannot be released, it is zeroed in place instead
+            usz partEnd = framePage + pagesPerLarge < endPage ? framePage + pagesPerLarge : endPage;
+            usz *array = reinterpret_cast<usz*>(reinterpret_cast<usz>(pages->getPhysicalAddress(i * PhysicalAllocator::pageSize)) + CPU::pagingBase);
+            for(usz j = 0; j < (partEnd - i) * PhysicalAllocator::pageSize / sizeof(usz); j++) array[j] = 0ull;
+            i = partEnd;
+
+        }
+        pagedOnDemand = true;
+    }
+
+    // remove the pages from every mapping, only then no core can access them and they may be freed
+    updateMappings(firstPage, endPage - firstPage, ~0ull, 0);
+    released.forEach([](void *page) { PhysicalAllocator::freePage(page); });
+    return true;
+
+}
+
+DemandPagedVirtualMemoryObject::DemandPagedVirtualMemoryObject(usz length, void *mappingAddress, bool write, bool execute, bool cache, u32 pid)
+    : VirtualMemoryObject((write ? writeable : 0) | (execute ? executable : 0) | (cache ? cacheable : 0), mappingAddress), ownerPID(pid) {
+
+    // only reserve the size, pages are allocated on first access
+    usz pageCount = (length + (PhysicalAllocator::pageSize - 1)) / PhysicalAllocator::pageSize;
+    size = pageCount * PhysicalAllocator::pageSize;
+    pagedOnDemand = true;
+
+    // calculate how many levels of slot tables are needed to describe all pages
+    usz capacity = slotsPerTable;
+    while(capacity < pageCount) {
+        capacity *= slotsPerTable;
+        tableLevels++;
+    }
+
+}
+
+DemandPagedVirtualMemoryObject::~DemandPagedVirtualMemoryObject() {
+
+    // free all committed pages together with slot tables
+    if(rootTable != nullptr) freeTable(rootTable, tableLevels - 1);
+
+}
+
+usz DemandPagedVirtualMemoryObject::committedPageCount() { return committedPages; }
+
+void *DemandPagedVirtualMemoryObject::resolveFault(usz pageIndex, bool write, bool *mapWriteable) {
+
+    // lock object spinlock
+    ScopedSpinlock lock(spinlock);
+
+    // check bounds
+    if(pageIndex >= size / PhysicalAllocator::pageSize) return nullptr;
+
+    // if page was already committed and is not shared with a clone, just return it
+    void **slot = getSlot(pageIndex, write);
+    if(slot != nullptr && *slot != nullptr) {
+
+        // shared page is mapped read-only until it is written
+        bool shared = PhysicalAllocator::getPageReferenceCount(*slot) > 1;
+        if(!write || !shared) {
+            *mapWriteable = !shared;
+            return *slot;
+        }
+
+        // other mappings could still write to the page until running clone write-protects them
+        if(clonesInProgress > 0) return reinterpret_cast<void*>(faultRetry);
+
+        // copy the page and drop reference to the shared one
+        void *copy = PhysicalAllocator::allocatePage(ownerPID);
+        usz *source = reinterpret_cast<usz*>(reinterpret_cast<usz>(*slot) + CPU::pagingBase);
+        usz *destination = reinterpret_cast<usz*>(reinterpret_cast<usz>(copy) + CPU::pagingBase);
+        for(usz i = 0; i < PhysicalAllocator::pageSize / sizeof(usz); i++) destination[i] = source[i];
+        PhysicalAllocator::freePage(*slot);
+        *slot = copy;
+        *mapWriteable = true;
+        return copy;
+
+    }
+
+    // untouched page is read, map shared zero page until it is written
+    if(!write) {
+        *mapWriteable = false;
+        return getZeroPage();
+    }
+
+    // first write, commit new page
+    *slot = allocateZeroedPage(ownerPID);
+    committedPages++;
+    *mapWriteable = true;
+    return *slot;
+
+}
+
+VirtualMemoryObject *DemandPagedVirtualMemoryObject::clone() {
+
+    // create empty object with the same parameters
+    DemandPagedVirtualMemoryObject *newObject = new DemandPagedVirtualMemoryObject(size, nullptr, false, false, false, ownerPID);
+    newObject->flags = flags;
+
+    // share all committed pages with the clone (no one can access new object yet, so it does not need locking)
+    {
+        ScopedSpinlock lock(spinlock);
+        if(rootTable != nullptr) shareTable(rootTable, tableLevels - 1, 0, newObject);
+        if(protections != nullptr) {
+            newObject->protections = new Vector<Protection>();
+            protections->forEach([&](Protection& protection) { newObject->protections->appendBack(protection); });
+        }
+        clonesInProgress++;
+    }
+
+    // existing mappings of shared pages have to fault on next write
+    writeProtectMappings(0, size / PhysicalAllocator::pageSize);
+
+    // allow copying of shared pages again
+    {
+        ScopedSpinlock lock(spinlock);
+        clonesInProgress--;
+    }
+
+    return newObject;
+
+}
+
+bool DemandPagedVirtualMemoryObject::commit(usz offset, usz length) {
+
+    if(!validRange(offset, length)) return false;
+
+    // allocate pages which were not touched yet (mappings of zero page see the same contents, so they stay)
+    ScopedSpinlock lock(spinlock);
+    usz firstPage = offset / PhysicalAllocator::pageSize;
+    for(usz i = firstPage; i < firstPage + length / PhysicalAllocator::pageSize; i++) {
+        void **slot = getSlot(i, true);
+        if(*slot != nullptr) continue;
+        *slot = allocateZeroedPage(ownerPID);
+        committedPages++;
+    }
+    return true;
+
+}
+
+bool DemandPagedVirtualMemoryObject::decommit(usz offset, usz length) {
+
+    if(!validRange(offset, length)) return false;
+
+    // detach pages from the object, faults from now on see empty slots
+    Vector<void*> released;
+    usz firstPage = offset / PhysicalAllocator::pageSize;
+    usz pageCount = length / PhysicalAllocator::pageSize;
+    {
+        ScopedSpinlock lock(spinlock);
+        for(usz i = firstPage; i < firstPage + pageCount; i++) {
+            void **slot = getSlot(i, false);
+            if(slot == nullptr || *slot == nullptr) continue;
+            released.appendBack(*slot);
+            *slot = nullptr;
+            committedPages--;
+        }
+    }
+
+    // remove the pages from every mapping, only then no core can access them and they may be freed (shared ones are only dereferenced)
+    updateMappings(firstPage, pageCount, ~0ull, 0);
+    released.forEach([](void *page) { PhysicalAllocator::freePage(page); });
+    return true;
+
+}
+
+void **DemandPagedVirtualMemoryObject::getSlot(usz pageIndex, bool create) {
+
+    // root table is created on first commit
+    if(rootTable == nullptr) {
+        if(!create) return nullptr;
+        rootTable = reinterpret_cast<void**>(reinterpret_cast<usz>(allocateZeroedPage(ownerPID)) + CPU::pagingBase);
+    }
+
+    // walk down the tables (similarly to paging structures), creating them if needed
+    void **table = rootTable;
+    for(usz level = tableLevels - 1; level > 0; level--) {
+        usz index = (pageIndex >> (9 * level)) & (slotsPerTable - 1);
+        if(table[index] == nullptr) {
+            if(!create) return nullptr;
+            table[index] = reinterpret_cast<void*>(reinterpret_cast<usz>(allocateZeroedPage(ownerPID)) + CPU::pagingBase);
+        }
+        table = reinterpret_cast<void**>(table[index]);
+    }
+
+    // return slot in the lowest table
+    return &table[pageIndex & (slotsPerTable - 1)];
+
+}
+
+void DemandPagedVirtualMemoryObject::freeTable(void **table, usz level) {
+
+    // free committed pages (lowest level) or lower tables
+    for(usz i = 0; i < slotsPerTable; i++) {
+        if(table[i] == nullptr) continue;
+        if(level == 0) PhysicalAllocator::freePage(table[i]);
+        else freeTable(reinterpret_cast<void**>(table[i]), level - 1);
+    }
+
+    // free the table itself
+    PhysicalAllocator::freePage(reinterpret_cast<void*>(reinterpret_cast<usz>(table) - CPU::pagingBase));
+
+}
+
+void DemandPagedVirtualMemoryObject::shareTable(void **table, usz level, usz firstPage, DemandPagedVirtualMemoryObject *target) {
+
+    // calculate how many pages single slot describes on this level
+    usz pagesPerSlot = 1;
+    for(usz i = 0; i < level; i++) pagesPerSlot *= slotsPerTable;
+
+    // reference committed pages (lowest level) or descend to lower tables
+    for(usz i = 0; i < slotsPerTable; i++) {
+        if(table[i] == nullptr) continue;
+        if(level > 0) {
+            shareTable(reinterpret_cast<void**>(table[i]), level - 1, firstPage + i * pagesPerSlot, target);
+            continue;
+        }
+        PhysicalAllocator::referencePage(table[i]);
+        *target->getSlot(firstPage + i, true) = table[i];
+        target->committedPages++;
+    }
+
+}
+
+SharedMemoryVirtualMemoryObject::SharedMemoryVirtualMemoryObject(usz length, bool write, u32 pid)
+    : MemoryBackedVirtualMemoryObject(length, false, nullptr, write, false, true, pid) {
+
+    // object may be mapped into user parts of address spaces
+    flags |= userMappable;
+
+}
+
+VirtualMemoryObject *SharedMemoryVirtualMemoryObject::clone() {
+
+    // object is meant to be shared, so the clone maps the same pages
+    return this;
+
+}
+
+BlockBackedVirtualMemoryObject::BlockBackedVirtualMemoryObject(IBlockDevice *device, usz firstPage, usz length, void *mappingAddress, bool execute)
+    : VirtualMemoryObject((execute ? executable : 0) | cacheable, mappingAddress), device(device), firstPage(firstPage) {
+
+    // only reserve the size, pages are provided by page cache on first access
+    usz pageCount = (length + (PhysicalAllocator::pageSize - 1)) / PhysicalAllocator::pageSize;
+    size = pageCount * PhysicalAllocator::pageSize;
+    pagedOnDemand = true;
+
+}
+
+void *BlockBackedVirtualMemoryObject::resolveFault(usz pageIndex, bool, bool *mapWriteable) {
+
+    // check bounds, object is read-only, so cached frame is mapped directly in every mapping
+    // NOTE: page which is not cached yet is read by waitForPage, once locks of the address space are dropped
+    if(pageIndex >= size / PhysicalAllocator::pageSize) return nullptr;
+    *mapWriteable = false;
+    return PageCache::getPage(device, firstPage + pageIndex);
+
+}
+
+bool BlockBackedVirtualMemoryObject::waitForPage(usz pageIndex, bool mayWait) {
+
+    // faulting thread waits until the page is read into the cache, read cannot complete while interrupts are disabled
+    if(pageIndex >= size / PhysicalAllocator::pageSize || !mayWait) return false;
+    return PageCache::waitForPage(device, firstPage + pageIndex);
+
+}
+
+ReservedVirtualMemoryObject::ReservedVirtualMemoryObject(usz length, void *mappingAddress) : VirtualMemoryObject(writeable, mappingAddress) {
 
-    // NOTE: the list will be removed in base class destructor
+    // only reserve the size, nothing is mapped by the address space (faults are not resolved, as base class has no pages)
+    usz pageCount = (length + (PhysicalAllocator::pageSize - 1)) / PhysicalAllocator::pageSize;
+    size = pageCount * PhysicalAllocator::pageSize;
+    pagedOnDemand = true;
 
 }
 
@@ -80,16 +843,18 @@ UncacheablePageVirtualMemoryObject::UncacheablePageVirtualMemoryObject(bool larg
     : VirtualMemoryObject(writeable, mappingAddress) {
 
     // allocate page
-    pages->appendBack(PhysicalAllocator::allocatePage(kernelPID, large));
+    pages->append(PhysicalAllocator::allocatePage(kernelPID, large), large ? PhysicalAllocator::largePageSize : PhysicalAllocator::pageSize);
     largePageAlignmentNeeded = large;
+    largePages = large ? 1 : 0;
+    alignment = large ? PhysicalAllocator::largePageSize : PhysicalAllocator::pageSize;
     size = (large) ? PhysicalAllocator::largePageSize : PhysicalAllocator::pageSize;
     
 }
 
 UncacheablePageVirtualMemoryObject::~UncacheablePageVirtualMemoryObject() {
-    PhysicalAllocator::freePage(pages->get(0));
+    PhysicalAllocator::freePage(pages->getPage(0));
 }
 
 void *UncacheablePageVirtualMemoryObject::getPhysicalAddress() {
-    return pages->get(0);
+    return pages->getPage(0);
 }
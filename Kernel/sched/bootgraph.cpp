@@ -0,0 +1,161 @@
+#include "sched/bootgraph.h"
+#include "driver/arch/hpet.h"
+#include "sched/idle.h"
+#include "util/logger.h"
+
+usz BootGraph::addTask(const char *name, EventHandler function, void *data) {
+
+    // stages are declared by code which knows the whole boot sequence, so running out of space is a bug
+    ScopedSpinlock lock(spinlock);
+    usz task = allocateTask(name, function, data);
+    if(task == noTask) {
+        Logger::printFormat("[boot] too many boot stages, aborting...\n");
+        for(;;); // TODO: panic!
+    }
+    return task;
+
+}
+
+void BootGraph::addDependency(usz task, usz dependency) {
+
+    // dependency releases its dependents once it finishes
+    ScopedSpinlock lock(spinlock);
+    Task& dependencyTask = tasks[dependency];
+    if(dependencyTask.dependentCount == maxDependents) {
+        Logger::printFormat("[boot] too many stages depend on stage %s, aborting...\n", dependencyTask.name);
+        for(;;); // TODO: panic!
+    }
+    dependencyTask.dependents[dependencyTask.dependentCount++] = task;
+    tasks[task].remainingDependencies++;
+
+}
+
+void BootGraph::run() {
+
+    // make stages without dependencies ready and let other cores know
+    u64 startNanoseconds = HPET::getNanoseconds();
+    {
+        ScopedSpinlock lock(spinlock);
+        __atomic_store_n(&remainingTasks, taskCount, __ATOMIC_RELAXED);
+        for(usz i = 0; i < taskCount; i++) if(tasks[i].remainingDependencies == 0) makeReady(i);
+        __atomic_store_n(&running, true, __ATOMIC_RELEASE);
+    }
+    Idle::wakeAll();
+
+    // take part until every stage (and everything spawned by them) finished
+    while(__atomic_load_n(&remainingTasks, __ATOMIC_ACQUIRE) != 0) {
+        if(!runReadyTask()) Idle::wait();
+    }
+    u64 endNanoseconds = HPET::getNanoseconds();
+    __atomic_store_n(&running, false, __ATOMIC_RELEASE);
+
+    printReport(startNanoseconds, endNanoseconds);
+
+}
+
+usz BootGraph::spawn(const char *name, EventHandler function, void *data) {
+
+    // task is queued only while the graph runs, otherwise there is nobody else to run it
+    usz task = noTask;
+    {
+        ScopedSpinlock lock(spinlock);
+        if(__atomic_load_n(&running, __ATOMIC_ACQUIRE)) task = allocateTask(name, function, data);
+        if(task != noTask) {
+            __atomic_add_fetch(&remainingTasks, 1, __ATOMIC_RELAXED);
+            makeReady(task);
+        }
+    }
+    if(task == noTask) {
+        function(data);
+        return noTask;
+    }
+    Idle::wakeAll();
+    return task;
+
+}
+
+void BootGraph::waitFor(usz task) {
+
+    // help with other tasks instead of waiting idle, finishing task wakes all cores
+    if(task == noTask) return;
+    while(__atomic_load_n(&tasks[task].state, __ATOMIC_ACQUIRE) != State::Done) {
+        if(!runReadyTask()) Idle::wait();
+    }
+
+}
+
+void BootGraph::serviceSecondaryCore() {
+
+    if(!__atomic_load_n(&running, __ATOMIC_ACQUIRE)) return;
+    while(runReadyTask());
+
+}
+
+usz BootGraph::allocateTask(const char *name, EventHandler function, void *data) {
+
+    // take next free slot, tasks are never removed
+    if(taskCount == maxTasks) return noTask;
+    usz task = taskCount++;
+    Task& newTask = tasks[task];
+    newTask.name = name;
+    newTask.function = function;
+    newTask.data = data;
+    newTask.dependentCount = 0;
+    newTask.remainingDependencies = 0;
+    newTask.state = State::Waiting;
+    return task;
+
+}
+
+void BootGraph::makeReady(usz task) {
+
+    // every task is queued exactly once, so the queue never wraps
+    tasks[task].state = State::Ready;
+    readyTasks[readyTail++] = task;
+
+}
+
+bool BootGraph::runReadyTask() {
+
+    // take the oldest ready task
+    usz task;
+    {
+        ScopedSpinlock lock(spinlock);
+        if(readyHead == readyTail) return false;
+        task = readyTasks[readyHead++];
+        tasks[task].state = State::Running;
+    }
+
+    // run it and measure wall-clock time it took
+    Task& runningTask = tasks[task];
+    runningTask.core = CPU::getCoreAPICID();
+    runningTask.startNanoseconds = HPET::getNanoseconds();
+    runningTask.function(runningTask.data);
+    runningTask.endNanoseconds = HPET::getNanoseconds();
+
+    // release dependents and wake up cores which may wait for them (or for this task)
+    {
+        ScopedSpinlock lock(spinlock);
+        for(usz i = 0; i < runningTask.dependentCount; i++) {
+            usz dependent = runningTask.dependents[i];
+            if(--tasks[dependent].remainingDependencies == 0) makeReady(dependent);
+        }
+        __atomic_store_n(&runningTask.state, State::Done, __ATOMIC_RELEASE);
+    }
+    __atomic_sub_fetch(&remainingTasks, 1, __ATOMIC_ACQ_REL);
+    Idle::wakeAll();
+    return true;
+
+}
+
+void BootGraph::printReport(u64 startNanoseconds, u64 endNanoseconds) {
+
+    // times are relative to the start of the graph, parent stages include time of subtasks they waited for
+    Logger::printFormat("[boot] boot stages finished in %u us:\n", (endNanoseconds - startNanoseconds) / 1000);
+    for(usz i = 0; i < taskCount; i++) {
+        Task& task = tasks[i];
+        Logger::printFormat("[boot]   - %s: core %u, started at +%u us, took %u us\n", task.name, task.core,
+                            (task.startNanoseconds - startNanoseconds) / 1000, (task.endNanoseconds - task.startNanoseconds) / 1000);
+    }
+
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <driver/arch/cpu.h>
+#include <util/spinlock.h>
+#include <util/types.h>
+
+/**
+ * @brief Class running initialization stages of the kernel as graph of tasks - stages declare which stages they depend
+ *        on, ready ones are taken by BSP and by secondary cores waiting for the scheduler, so independent stages run
+ *        concurrently (stages may also spawn subtasks, e.g. one per controller or port, and wait for them)
+ */
+class BootGraph {
+
+public:
+
+    /**
+     * @brief Identifier returned instead of task which was not added to the graph (e.g. spawned when graph does not run)
+     */
+    static constexpr usz noTask = ~static_cast<usz>(0);
+
+    /**
+     * @brief Adds stage to the graph, has to be called before run
+     * @param name Name of the stage (used in timing report)
+     * @param function Function of the stage
+     * @param data Data passed to the function
+     * @return Identifier of the stage
+     */
+    static usz addTask(const char *name, EventHandler function, void *data = nullptr);
+
+    /**
+     * @brief Declares that stage can start only after other stage finished, has to be called before run
+     * @param task Identifier of dependent stage
+     * @param dependency Identifier of stage it depends on
+     */
+    static void addDependency(usz task, usz dependency);
+
+    /**
+     * @brief Runs all stages of the graph (current core takes part as well) and prints how long each of them took
+     */
+    static void run();
+
+    /**
+     * @brief Adds task which is ready right away, may be called by running stages
+     * @param name Name of the task (used in timing report)
+     * @param function Function of the task
+     * @param data Data passed to the function
+     * @return Identifier of the task, noTask if graph does not run (or is full) and function was run directly
+     */
+    static usz spawn(const char *name, EventHandler function, void *data);
+
+    /**
+     * @brief Waits until task finished, ready tasks are run meanwhile
+     * @param task Identifier of the task (noTask returns at once)
+     */
+    static void waitFor(usz task);
+
+    /**
+     * @brief Runs ready tasks, called repeatedly by secondary cores while they wait
+     */
+    static void serviceSecondaryCore();
+
+private:
+
+    static constexpr usz maxTasks = 128;
+    static constexpr usz maxDependents = 8;
+
+    enum class State : u8 {
+        Waiting,
+        Ready,
+        Running,
+        Done
+    };
+
+    struct Task {
+        const char *name;
+        EventHandler function;
+        void *data;
+        usz dependents[maxDependents];
+        usz dependentCount;
+        usz remainingDependencies;
+        State state;
+        u8 core;
+        u64 startNanoseconds;
+        u64 endNanoseconds;
+    };
+
+    static usz allocateTask(const char *name, EventHandler function, void *data);
+    static void makeReady(usz task);
+    static bool runReadyTask();
+    static void printReport(u64 startNanoseconds, u64 endNanoseconds);
+
+    static inline Task tasks[maxTasks] = {};
+    static inline usz readyTasks[maxTasks] = {};
+    static inline usz readyHead = 0;
+    static inline usz readyTail = 0;
+    static inline usz taskCount = 0;
+    static inline usz remainingTasks = 0;
+    static inline bool running = false;
+    static inline Spinlock spinlock{"boot graph"};
+
+};
@@ -0,0 +1,104 @@
+#include "sched/idle.h"
+#include "driver/arch/apic.h"
+#include "driver/arch/ints.h"
+#include "sched/scheduler.h"
+#include "util/logger.h"
+
+void Idle::initialize() {
+
+    // MWAIT wakes up on write to the wake word by itself, HLT needs an interrupt
+    if(CPU::supportsMonitorWait()) __atomic_store_n(&monitorWait, true, __ATOMIC_RELEASE);
+    u8 vector = Interrupts::reserveVector(&Idle::wakeInterruptHandler, nullptr);
+    if(vector == 0) {
+        Logger::printFormat("[idle] could not reserve interrupt vector for wakeups, aborting...\n");
+        for(;;); // TODO: panic!
+    }
+    __atomic_store_n(&wakeVector, vector, __ATOMIC_RELEASE);
+    Logger::printFormat("[idle] idle cores sleep with %s\n", monitorWait ? "MONITOR/MWAIT" : "HLT");
+
+}
+
+void Idle::wait() {
+
+    // core can sleep only if something is able to wake it up
+    bool interruptState = CPU::enterCritical();
+    if(!interruptState || __atomic_load_n(&wakeVector, __ATOMIC_ACQUIRE) == 0) {
+        CPU::exitCritical(interruptState);
+        CPU::pause();
+        return;
+    }
+
+    // interrupt which wakes the core must not switch threads before it is marked awake again
+    Scheduler::disablePreemption();
+
+    // announce sleeping before checking the wake word, waker writes the word before checking sleeping cores, so
+    // at least one of us sees the other
+    u8 core = CPU::getCoreAPICID();
+    CoreState& state = cores.get();
+    __atomic_fetch_or(&sleepingCores, 1ull << core, __ATOMIC_SEQ_CST);
+    if(monitorWait) CPU::monitor(&state.wakeWord);
+    if(__atomic_load_n(&state.wakeWord, __ATOMIC_SEQ_CST) == 0) {
+
+        // interrupts are enabled only together with sleeping, so that wakeup IPI cannot come before it
+        if(monitorWait) CPU::monitorWait(true);
+        else CPU::halt(true);
+        CPU::setInterruptState(false);
+
+    }
+
+    // consume the wakeup
+    __atomic_fetch_and(&sleepingCores, ~(1ull << core), __ATOMIC_SEQ_CST);
+    __atomic_exchange_n(&state.wakeWord, 0, __ATOMIC_SEQ_CST);
+    CPU::exitCritical(interruptState);
+    Scheduler::enablePreemption();
+
+}
+
+void Idle::wake(u8 core) {
+
+    // write the wake word (which wakes MWAIT by itself), halted core needs IPI
+    if(__atomic_exchange_n(&cores[core].wakeWord, 1, __ATOMIC_SEQ_CST) != 0) return;
+    if(monitorWait || core == CPU::getCoreAPICID()) return;
+    if((__atomic_load_n(&sleepingCores, __ATOMIC_SEQ_CST) & (1ull << core)) != 0) LAPIC::sendIPI(core, wakeVector);
+
+}
+
+void Idle::wakeAll() {
+
+    u8 self = CPU::getCoreAPICID();
+    for(u32 i = 0; i < CPU::maxCoreCount; i++) if(i != self) wake(static_cast<u8>(i));
+
+}
+
+bool Idle::wakeIdleCore(u8 exceptCore) {
+
+    // pick the lowest sleeping core, it does not matter much which one
+    u64 candidates = __atomic_load_n(&sleepingCores, __ATOMIC_RELAXED) & ~(1ull << exceptCore) & ~(1ull << CPU::getCoreAPICID());
+    if(candidates == 0) return false;
+    wake(static_cast<u8>(__builtin_ctzll(candidates)));
+    return true;
+
+}
+
+void Idle::waitWhileEqual(const u32 *word, u32 value) {
+
+    // NOTE: support is checked directly, this may run before initialize (e.g. on cores waiting for the BSP)
+    bool useMonitorWait = CPU::supportsMonitorWait();
+    while(__atomic_load_n(word, __ATOMIC_ACQUIRE) == value) {
+        if(!useMonitorWait) {
+            CPU::pause();
+            continue;
+        }
+        CPU::monitor(word);
+        if(__atomic_load_n(word, __ATOMIC_ACQUIRE) == value) CPU::monitorWait(false);
+    }
+
+}
+
+bool Idle::usesMonitorWait() { return monitorWait; }
+
+void Idle::wakeInterruptHandler(void *, u32) {
+
+    // nothing to do, the interrupt itself ended HLT
+
+}
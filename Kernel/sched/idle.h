@@ -0,0 +1,73 @@
+#pragma once
+#include <driver/arch/cpu.h>
+#include <util/percpu.h>
+#include <util/types.h>
+
+/**
+ * @brief Class putting cores which have nothing to do to sleep - with MONITOR/MWAIT on wake word of the core where
+ *        available (writing the word wakes the core), otherwise with HLT (and wakeup IPI sent to halted cores)
+ */
+class Idle {
+
+public:
+
+    /**
+     * @brief Detects MONITOR/MWAIT and reserves wakeup vector, has to be called once (by BSP) after interrupts are initialized
+     * NOTE: until then, waits only pause the core once
+     */
+    static void initialize();
+
+    /**
+     * @brief Sleeps until wake is called for currently executing core or any interrupt comes, wakeup which came before
+     *        is not lost (so that callers check their condition, call this and check it again in a loop)
+     * NOTE: meant for idle thread and code running before scheduling, interrupts have to be enabled (otherwise core
+     *       only pauses once)
+     */
+    static void wait();
+
+    /**
+     * @brief Wakes core up from wait (or makes its next wait return at once), may be called from interrupt context
+     * @param core LAPIC ID of the core
+     */
+    static void wake(u8 core);
+
+    /**
+     * @brief Wakes all cores other than currently executing one
+     */
+    static void wakeAll();
+
+    /**
+     * @brief Wakes one of sleeping cores (e.g. so that it steals work queued on busy core)
+     * @param exceptCore LAPIC ID of core which should not be woken (besides the current one)
+     * @return true if some core was woken, false if no other core sleeps
+     */
+    static bool wakeIdleCore(u8 exceptCore);
+
+    /**
+     * @brief Waits until word changes from given value, usable also with interrupts disabled (e.g. before IDT is
+     *        loaded) - sleeps with MWAIT on the word itself if available, spins otherwise
+     * @param word Word to be watched
+     * @param value Value which keeps the core waiting
+     */
+    static void waitWhileEqual(const u32 *word, u32 value);
+
+    /**
+     * @brief Returns whether waits use MONITOR/MWAIT
+     * @return true if MONITOR/MWAIT are used, false if HLT is used
+     */
+    static bool usesMonitorWait();
+
+private:
+
+    struct CoreState {
+        u64 wakeWord;
+    };
+
+    static void wakeInterruptHandler(void *, u32);
+
+    static inline PerCPU<CoreState> cores;
+    static inline u64 sleepingCores = 0;
+    static inline u8 wakeVector = 0;
+    static inline bool monitorWait = false;
+
+};
@@ -0,0 +1,372 @@
+#include "sched/scheduler.h"
+#include "driver/arch/apic.h"
+#include "driver/arch/hpet.h"
+#include "driver/arch/ints.h"
+#include "sched/idle.h"
+#include "util/rcu.h"
+#include "util/softirq.h"
+
+// saves callee-saved registers on current stack, switches stacks and restores registers saved on the new one
+__attribute__((naked))
+static void switchContext(void **, void *) {
+
+    asm volatile (
+        "push %rbp\n"
+        "push %rbx\n"
+        "push %r12\n"
+        "push %r13\n"
+        "push %r14\n"
+        "push %r15\n"
+        "mov %rsp, (%rdi)\n"
+        "mov %rsi, %rsp\n"
+        "pop %r15\n"
+        "pop %r14\n"
+        "pop %r13\n"
+        "pop %r12\n"
+        "pop %rbx\n"
+        "pop %rbp\n"
+        "ret\n"
+    );
+
+}
+
+void Scheduler::initialize() {
+
+    // reserve vector of LAPIC timers, which drive preemption on all cores
+    timerVector = Interrupts::reserveVector(&Scheduler::timerInterruptHandler, nullptr);
+    if(timerVector == 0) {
+        Logger::printFormat("[sched] could not reserve interrupt vector for scheduler timer, aborting...\n");
+        for(;;); // TODO: panic!
+    }
+    Logger::printFormat("[sched] scheduler initialized, time slice: %u us\n", timeSliceMicroseconds);
+
+}
+
+void Scheduler::initializeCore(const char *name) {
+
+    // current context becomes thread pinned to this core (it runs on stack given by the bootloader)
+    u8 core = CPU::getCoreAPICID();
+    Thread *thread = new Thread();
+    thread->id = __atomic_fetch_add(&nextThreadID, 1, __ATOMIC_RELAXED);
+    thread->name = name;
+    thread->state = Thread::State::Running;
+    thread->affinity = core;
+    thread->core = core;
+    thread->onCore = true;
+    thread->ownsStack = false;
+
+    // idle thread runs whenever there is nothing else to run, it is never queued
+    Thread *idle = allocateThread(&Scheduler::idleLoop, nullptr, "idle", core);
+
+    // publish state of the core and start preempting
+    bool interruptState = CPU::enterCritical();
+    CoreState& state = cores[core];
+    state.current = thread;
+    state.idle = idle;
+    state.previous = nullptr;
+    state.needsReschedule = false;
+    __atomic_store_n(&state.active, true, __ATOMIC_RELEASE);
+    LAPIC::startPeriodicTimer(timerVector, timeSliceMicroseconds);
+    CPU::exitCritical(interruptState);
+
+}
+
+Thread *Scheduler::createThread(EventHandler function, void *data, const char *name, i32 affinity) {
+
+    // create thread and queue it on its core (or on this one, other cores will steal it if they are idle)
+    Thread *thread = allocateThread(function, data, name, affinity);
+    bool interruptState = CPU::enterCritical();
+    thread->core = (affinity == Thread::anyCore) ? CPU::getCoreAPICID() : static_cast<u8>(affinity);
+    enqueue(thread);
+    CPU::exitCritical(interruptState);
+    return thread;
+
+}
+
+void Scheduler::yield() {
+
+    // switch only if scheduling runs on this core
+    bool interruptState = CPU::enterCritical();
+    CoreState& state = cores.get();
+    if(state.active) {
+        state.needsReschedule = false;
+        schedule(true);
+    }
+    CPU::exitCritical(interruptState);
+
+}
+
+void Scheduler::exit() {
+
+    // mark thread dead and leave it for good, next thread frees it
+    CPU::enterCritical();
+    cores.get().current->state = Thread::State::Dead;
+    schedule(false);
+
+    // never reached
+    for(;;);
+
+}
+
+void Scheduler::block() {
+
+    // consume wakeup which came before, state lock orders this against wakeUp
+    bool interruptState = CPU::enterCritical();
+    Thread *thread = cores.get().current;
+    thread->stateLock.lock();
+    if(thread->wakeupPending) {
+        thread->wakeupPending = false;
+        thread->stateLock.unlock();
+        CPU::exitCritical(interruptState);
+        return;
+    }
+    thread->state = Thread::State::Blocked;
+    thread->stateLock.unlock();
+
+    // switch away, waker queues the thread again
+    schedule(false);
+    CPU::exitCritical(interruptState);
+
+}
+
+void Scheduler::wakeUp(Thread *thread) {
+
+    // thread which does not sleep yet will not block next time
+    bool interruptState = CPU::enterCritical();
+    thread->stateLock.lock();
+    if(thread->state != Thread::State::Blocked) {
+        thread->wakeupPending = true;
+        thread->stateLock.unlock();
+        CPU::exitCritical(interruptState);
+        return;
+    }
+
+    // thread may be still switching away on its core, it can be queued only when it is off its stack
+    thread->state = Thread::State::Ready;
+    while(__atomic_load_n(&thread->onCore, __ATOMIC_ACQUIRE)) CPU::pause();
+    enqueue(thread);
+    thread->stateLock.unlock();
+    CPU::exitCritical(interruptState);
+
+}
+
+void Scheduler::sleep(u64 milliseconds) {
+
+    // timed event wakes the thread up, wakeup coming before blocking is remembered
+    if(milliseconds == 0) {
+        yield();
+        return;
+    }
+    HPET::createTimedEvent(milliseconds, [](void *thread) { wakeUp(reinterpret_cast<Thread*>(thread)); }, getCurrentThread());
+    block();
+
+}
+
+Thread *Scheduler::getCurrentThread() {
+
+    // thread cannot move between reading core and its state with interrupts disabled
+    bool interruptState = CPU::enterCritical();
+    CoreState& state = cores.get();
+    Thread *current = state.active ? state.current : nullptr;
+    CPU::exitCritical(interruptState);
+    return current;
+
+}
+
+void Scheduler::disablePreemption() {
+
+    // count belongs to the core, thread cannot leave it while the count is raised
+    bool interruptState = CPU::enterCritical();
+    cores.get().preemptionDisabled++;
+    CPU::exitCritical(interruptState);
+
+}
+
+void Scheduler::enablePreemption() {
+
+    // switch right away if time slice ended meanwhile
+    bool interruptState = CPU::enterCritical();
+    CoreState& state = cores.get();
+    state.preemptionDisabled--;
+    bool switchNeeded = state.preemptionDisabled == 0 && state.needsReschedule;
+    CPU::exitCritical(interruptState);
+    if(switchNeeded) preemptIfNeeded();
+
+}
+
+void Scheduler::preemptIfNeeded() {
+
+    // interrupted code must not be running deferred work, be inside of RCU read-side section or hold other per-core
+    // resources, in that case preemption is retried at the next interrupt
+    bool interruptState = CPU::enterCritical();
+    CoreState& state = cores.get();
+    if(state.active && state.needsReschedule && state.preemptionDisabled == 0 && !SoftIRQ::isRunning() && !RCU::isReading()) {
+        state.needsReschedule = false;
+        schedule(true);
+    }
+    CPU::exitCritical(interruptState);
+
+}
+
+u64 Scheduler::getContextSwitchCount() { return contextSwitchCount.sum(); }
+
+u64 Scheduler::getStolenCount() { return stolenCount.sum(); }
+
+void Scheduler::schedule(bool requeuePrevious) {
+
+    // find thread to run, current one keeps running if it may and nothing else is ready
+    u8 core = CPU::getCoreAPICID();
+    CoreState& state = cores[core];
+    Thread *previous = state.current;
+    Thread *next = pickNext(state, !requeuePrevious || previous == state.idle);
+    if(next == nullptr) {
+        if(requeuePrevious) return;
+        next = state.idle;
+    }
+    if(next == previous) return;
+
+    // previous thread is queued again only after the switch, when no core can be running on its stack
+    if(requeuePrevious && previous != state.idle) previous->state = Thread::State::Ready;
+    state.requeuePrevious = requeuePrevious && previous != state.idle;
+    state.previous = previous;
+    next->state = Thread::State::Running;
+    next->core = core;
+    __atomic_store_n(&next->onCore, true, __ATOMIC_RELAXED);
+    state.current = next;
+    contextSwitchCount.add();
+    switchContext(&previous->stackPointer, next->stackPointer);
+
+    // we are back (possibly on other core), finish the switch which brought us here
+    finishSwitch();
+
+}
+
+Thread *Scheduler::pickNext(CoreState& state, bool mayIdle) {
+
+    // take first thread of own run queue
+    state.runQueueLock.lock();
+    Thread *next = state.runQueue.removeFront();
+    state.runQueueLock.unlock();
+    if(next != nullptr) return next;
+
+    // core which would otherwise idle steals from others
+    return mayIdle ? stealThread(CPU::getCoreAPICID()) : nullptr;
+
+}
+
+Thread *Scheduler::stealThread(u8 thiefCore) {
+
+    // walk other cores, starting with the next one, so that thieves do not all pick the same victim
+    for(u32 i = 1; i < CPU::maxCoreCount; i++) {
+
+        // skip inactive cores and cores whose queue is just being changed, queue itself is read only under the lock
+        CoreState& victim = cores[(thiefCore + i) % CPU::maxCoreCount];
+        if(!__atomic_load_n(&victim.active, __ATOMIC_ACQUIRE)) continue;
+        if(!victim.runQueueLock.tryLock()) continue;
+
+        // take the last thread which is not pinned (the one which waited for the shortest time, so likely coldest), empty queue has none
+        Thread *thread = victim.runQueue.getLast();
+        while(thread != nullptr && thread->affinity != Thread::anyCore) thread = victim.runQueue.getPrevious(thread);
+        if(thread != nullptr) victim.runQueue.remove(thread);
+        victim.runQueueLock.unlock();
+        if(thread != nullptr) {
+            stolenCount.add();
+            return thread;
+        }
+
+    }
+
+    // nothing to steal
+    return nullptr;
+
+}
+
+void Scheduler::enqueue(Thread *thread) {
+
+    // pinned threads go to their core, others to the core they ran on last
+    u8 core = (thread->affinity == Thread::anyCore) ? thread->core : static_cast<u8>(thread->affinity);
+    CoreState& state = cores[core];
+    state.runQueueLock.lock();
+    state.runQueue.appendBack(thread);
+    state.runQueueLock.unlock();
+
+    // sleeping core has to notice the thread, thread queued on this (busy) core may be stolen by a sleeping one
+    if(core != CPU::getCoreAPICID()) Idle::wake(core);
+    else if(thread->affinity == Thread::anyCore) Idle::wakeIdleCore(core);
+
+}
+
+void Scheduler::finishSwitch() {
+
+    // release previous thread of this core, it is off its stack now
+    CoreState& state = cores.get();
+    Thread *previous = state.previous;
+    state.previous = nullptr;
+    if(previous == nullptr) return;
+    __atomic_store_n(&previous->onCore, false, __ATOMIC_RELEASE);
+
+    // dead thread is freed, preempted one is queued again (blocked one is queued by its waker)
+    if(previous->state == Thread::State::Dead) freeThread(previous);
+    else if(state.requeuePrevious) {
+        previous->core = CPU::getCoreAPICID();
+        enqueue(previous);
+    }
+
+}
+
+void Scheduler::threadStart() {
+
+    // new thread is entered from switchContext, finish the switch and run thread function with interrupts enabled
+    finishSwitch();
+    Thread *thread = cores.get().current;
+    CPU::setInterruptState(true);
+    thread->function(thread->data);
+    exit();
+
+}
+
+void Scheduler::idleLoop(void *) {
+
+    // look for work (local or stolen) and sleep until some is queued here (or next time slice, to steal again)
+    for(;;) {
+        yield();
+        Idle::wait();
+    }
+
+}
+
+void Scheduler::timerInterruptHandler(void *, u32) {
+
+    // time slice of current thread ended, switch happens at the end of interrupt handler
+    cores.get().needsReschedule = true;
+
+}
+
+Thread *Scheduler::allocateThread(EventHandler function, void *data, const char *name, i32 affinity) {
+
+    // create thread and its stack
+    Thread *thread = new Thread();
+    thread->id = __atomic_fetch_add(&nextThreadID, 1, __ATOMIC_RELAXED);
+    thread->name = name;
+    thread->affinity = affinity;
+    thread->function = function;
+    thread->data = data;
+    thread->stack = new u8[threadStackSize];
+
+    // prepare stack as if the thread was switched away right before entering threadStart (with aligned stack)
+    u64 *top = reinterpret_cast<u64*>((reinterpret_cast<usz>(thread->stack) + threadStackSize) & ~static_cast<usz>(15));
+    *--top = 0;
+    *--top = reinterpret_cast<u64>(&Scheduler::threadStart);
+    for(usz i = 0; i < 6; i++) *--top = 0;
+    thread->stackPointer = top;
+    return thread;
+
+}
+
+void Scheduler::freeThread(Thread *thread) {
+
+    // thread adopted from boot context does not own its stack
+    if(thread->ownsStack) delete[] reinterpret_cast<u8*>(thread->stack);
+    delete thread;
+
+}
@@ -0,0 +1,165 @@
+#pragma once
+#include <driver/arch/cpu.h>
+#include <util/intrusivelist.h>
+#include <util/percpu.h>
+#include <util/spinlock.h>
+#include <util/types.h>
+
+/**
+ * @brief Kernel thread - own stack and saved context, scheduled by Scheduler on any core (or only on one, if pinned)
+ */
+struct Thread {
+
+    enum class State : u8 {
+        Ready,
+        Running,
+        Blocked,
+        Dead
+    };
+
+    static constexpr i32 anyCore = -1;
+
+    usz id = 0;
+    const char *name = nullptr;
+    State state = State::Ready;
+    i32 affinity = anyCore;
+    u8 core = 0;
+    bool onCore = false;
+    bool wakeupPending = false;
+    bool ownsStack = true;
+    void *stackPointer = nullptr;
+    void *stack = nullptr;
+    EventHandler function = nullptr;
+    void *data = nullptr;
+    RawSpinlock stateLock;
+    IntrusiveLink<Thread> link;
+
+};
+
+/**
+ * @brief Class scheduling kernel threads - every core has its own run queue served round robin, LAPIC timer preempts
+ *        running thread every time slice and cores which have nothing to run steal ready threads from other cores
+ */
+class Scheduler {
+
+public:
+
+    /**
+     * @brief Initializes scheduler, has to be called once (by BSP) before any core calls initializeCore
+     */
+    static void initialize();
+
+    /**
+     * @brief Starts scheduling on currently executing core, code calling this becomes thread of the core
+     * @param name Name of the thread created from current context
+     */
+    static void initializeCore(const char *name);
+
+    /**
+     * @brief Creates new thread and queues it for running
+     * @param function Function run by the thread, thread exits when it returns
+     * @param data Data passed to the function
+     * @param name Name of the thread (for diagnostics)
+     * @param affinity Core (LAPIC ID) to which thread is pinned, Thread::anyCore to let it run anywhere
+     * @return Created thread, it is valid until it exits
+     */
+    static Thread *createThread(EventHandler function, void *data, const char *name, i32 affinity = Thread::anyCore);
+
+    /**
+     * @brief Gives up the rest of time slice of current thread, if any other thread is ready
+     */
+    static void yield();
+
+    /**
+     * @brief Ends current thread, its stack is freed once other thread runs on the core
+     */
+    [[noreturn]] static void exit();
+
+    /**
+     * @brief Blocks current thread until it is woken up, wakeup which came before blocking is not lost
+     */
+    static void block();
+
+    /**
+     * @brief Wakes blocked thread up (or makes its next block return at once), may be called from interrupt context
+     * @param thread Thread to be woken up
+     */
+    static void wakeUp(Thread *thread);
+
+    /**
+     * @brief Blocks current thread for given time (using HPET timed events)
+     * @param milliseconds Time to sleep
+     */
+    static void sleep(u64 milliseconds);
+
+    /**
+     * @brief Returns thread running on currently executing core
+     * @return Current thread, nullptr if scheduling was not started on the core
+     */
+    static Thread *getCurrentThread();
+
+    /**
+     * @brief Keeps current thread on its core until enablePreemption is called (calls may be nested), needed while
+     *        per-core resources (e.g. temporary kernel mappings) are held
+     * NOTE: thread must not block or yield until preemption is enabled again
+     */
+    static void disablePreemption();
+
+    /**
+     * @brief Allows preemption of current thread again
+     */
+    static void enablePreemption();
+
+    /**
+     * @brief Switches to other thread if time slice of current one ended and it may be preempted
+     * NOTE: called by interrupt handler at the very end, after EOI and deferred work
+     */
+    static void preemptIfNeeded();
+
+    /**
+     * @brief Returns count of context switches done so far on all cores
+     * @return Count of context switches
+     */
+    static u64 getContextSwitchCount();
+
+    /**
+     * @brief Returns count of threads which were stolen from run queues of other cores so far
+     * @return Count of stolen threads
+     */
+    static u64 getStolenCount();
+
+private:
+
+    struct CoreState {
+        RawSpinlock runQueueLock;
+        IntrusiveList<Thread, &Thread::link> runQueue;
+        Thread *current;
+        Thread *idle;
+        Thread *previous;
+        usz preemptionDisabled;
+        bool active;
+        bool needsReschedule;
+        bool requeuePrevious;
+    };
+
+    static constexpr usz threadStackSize = 16384;
+    static constexpr u64 timeSliceMicroseconds = 10000;
+
+    static void schedule(bool requeuePrevious);
+    static Thread *pickNext(CoreState& state, bool mayIdle);
+    static Thread *stealThread(u8 thiefCore);
+    static void enqueue(Thread *thread);
+    static void finishSwitch();
+    static void threadStart();
+    static void idleLoop(void *);
+    static void timerInterruptHandler(void *, u32);
+    static Thread *allocateThread(EventHandler function, void *data, const char *name, i32 affinity);
+    static void freeThread(Thread *thread);
+
+    static inline PerCPU<CoreState> cores;
+    static inline u8 timerVector = 0;
+    static inline usz nextThreadID = 1;
+    static inline PerCPUCounter contextSwitchCount;
+    static inline PerCPUCounter stolenCount;
+
+};
@@ -0,0 +1,370 @@
+#include "sched/workqueue.h"
+#include "driver/arch/apic.h"
+#include "driver/arch/hpet.h"
+#include "util/logger.h"
+
+Workqueue::Workqueue(const char *name, Type type, usz maxActive) : name(name), type(type), maxActive(maxActive == 0 ? 1 : maxActive) {
+
+    // per-CPU queue has pool pinned to every online core, unbound one has single pool shared by all of them
+    if(type == Type::Unbound) pools[0] = createPool(Thread::anyCore);
+    else {
+        u64 onlineCores = LAPIC::getOnlineCores();
+        for(u32 i = 0; i < CPU::maxCoreCount; i++) if(onlineCores & (1ull << i)) pools[i] = createPool(static_cast<i32>(i));
+    }
+
+    // register the queue for statistics, queues over the limit work but are not listed
+    usz index = __atomic_fetch_add(&queueCount, 1, __ATOMIC_RELAXED);
+    if(index < maxQueueCount) __atomic_store_n(&queues[index], this, __ATOMIC_RELEASE);
+
+}
+
+void Workqueue::initialize() {
+
+    // per-CPU queue for short work (e.g. completions deferred by drivers), unbound one may be used by anything longer
+    usz coreCount = CPU::countCores(LAPIC::getOnlineCores());
+    Workqueue *system = new Workqueue("kworker", Type::PerCPU, systemMaxActive);
+    Workqueue *unbound = new Workqueue("kworker unbound", Type::Unbound, coreCount);
+    __atomic_store_n(&unboundQueue, unbound, __ATOMIC_RELEASE);
+    __atomic_store_n(&systemQueue, system, __ATOMIC_RELEASE);
+    Logger::printFormat("[workqueue] system queues created, %u workers per core and %u unbound workers\n", systemMaxActive, coreCount);
+
+}
+
+Workqueue *Workqueue::getSystemQueue() { return __atomic_load_n(&systemQueue, __ATOMIC_ACQUIRE); }
+
+Workqueue *Workqueue::getUnboundQueue() { return __atomic_load_n(&unboundQueue, __ATOMIC_ACQUIRE); }
+
+bool Workqueue::queue(Work& work) {
+
+    // caller may move to other core meanwhile, work then simply runs on the previous one
+    return insert(getPool(CPU::getCoreAPICID()), work, Work::State::Idle);
+
+}
+
+bool Workqueue::queueOn(u8 core, Work& work) { return insert(getPool(core), work, Work::State::Idle); }
+
+bool Workqueue::queueDelayed(Work& work, u64 milliseconds) {
+
+    // claim the work for the timer, it is queued on this core once the timer fires
+    if(milliseconds == 0) return queue(work);
+    Work::State expectedState = Work::State::Idle;
+    if(!__atomic_compare_exchange_n(&work.state, &expectedState, Work::State::Delayed, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return false;
+    work.queue = this;
+    work.core = CPU::getCoreAPICID();
+
+    // NOTE: ID may be stored after the timer fired, cancel then fails to remove it and waits for the handler instead
+    usz timerID = HPET::createTimedEvent(milliseconds, &Workqueue::delayedWorkHandler, &work);
+    __atomic_store_n(&work.timerID, timerID, __ATOMIC_RELEASE);
+    return true;
+
+}
+
+bool Workqueue::cancel(Work& work) {
+
+    // work which was never queued has nothing to cancel
+    Workqueue *queue = __atomic_load_n(&work.queue, __ATOMIC_ACQUIRE);
+    if(queue == nullptr) return false;
+
+    // take the work away from the timer or the pool, whichever holds it
+    bool cancelled = false;
+    for(;;) {
+
+        Work::State state = __atomic_load_n(&work.state, __ATOMIC_ACQUIRE);
+        if(state == Work::State::Delayed) {
+
+            // timer which already fired still references the work, its handler notices cancelling and lets it go
+            if(!__atomic_compare_exchange_n(&work.state, &state, Work::State::Cancelling, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) continue;
+            if(HPET::removeTimedEvent(__atomic_load_n(&work.timerID, __ATOMIC_ACQUIRE))) __atomic_store_n(&work.state, Work::State::Idle, __ATOMIC_RELEASE);
+            else while(__atomic_load_n(&work.state, __ATOMIC_ACQUIRE) == Work::State::Cancelling) Scheduler::yield();
+            Pool *pool = queue->getPool(work.core);
+            ScopedSpinlock lock(pool->spinlock);
+            pool->cancelled++;
+            cancelled = true;
+            break;
+
+        }
+        if(state == Work::State::Cancelling) {
+
+            // other core cancels it right now
+            Scheduler::yield();
+            continue;
+
+        }
+        if(state == Work::State::Pending) {
+
+            // work may move to other pool meanwhile, in that case it is looked up again
+            Pool *pool = reinterpret_cast<Pool*>(__atomic_load_n(&work.pool, __ATOMIC_ACQUIRE));
+            ScopedSpinlock lock(pool->spinlock);
+            if(work.state != Work::State::Pending || work.pool != pool) continue;
+            pool->pending.remove(&work);
+            __atomic_store_n(&work.state, Work::State::Idle, __ATOMIC_RELEASE);
+            pool->cancelled++;
+            wakeFlushWaiters(pool);
+            cancelled = true;
+            break;
+
+        }
+        break;
+
+    }
+
+    // wait until no worker runs it (it may have been queued on any pool before)
+    for(u32 i = 0; i < CPU::maxCoreCount; i++) if(queue->pools[i] != nullptr) wait(queue->pools[i], &work, 0);
+    return cancelled;
+
+}
+
+bool Workqueue::flush(Work& work) {
+
+    // work which was never queued has nothing to wait for
+    Workqueue *queue = __atomic_load_n(&work.queue, __ATOMIC_ACQUIRE);
+    if(queue == nullptr) return false;
+
+    // delayed work is queued right away, timer which already fired queues it by itself
+    Work::State state = Work::State::Delayed;
+    if(__atomic_compare_exchange_n(&work.state, &state, Work::State::Cancelling, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        if(HPET::removeTimedEvent(__atomic_load_n(&work.timerID, __ATOMIC_ACQUIRE))) queue->insert(queue->getPool(work.core), work, Work::State::Cancelling);
+        else {
+            while(__atomic_load_n(&work.state, __ATOMIC_ACQUIRE) == Work::State::Cancelling) Scheduler::yield();
+            queue->insert(queue->getPool(work.core), work, Work::State::Idle);
+        }
+    }
+
+    // wait for the instance which is pending now (if any) and for running ones
+    bool waited = false;
+    for(u32 i = 0; i < CPU::maxCoreCount; i++) {
+        Pool *pool = queue->pools[i];
+        if(pool == nullptr) continue;
+        u64 sequence = 0;
+        {
+            ScopedSpinlock lock(pool->spinlock);
+            if(work.state == Work::State::Pending && work.pool == pool) sequence = work.sequence;
+            for(usz j = 0; j < queue->maxActive && sequence == 0; j++) if(pool->workers[j].work == &work) sequence = pool->workers[j].sequence;
+        }
+        if(sequence == 0) continue;
+        wait(pool, &work, sequence);
+        waited = true;
+    }
+    return waited;
+
+}
+
+void Workqueue::flush() {
+
+    // every work queued before this point has lower sequence number, it is inserted under lock of its pool
+    u64 sequence = __atomic_load_n(&nextSequence, __ATOMIC_ACQUIRE) - 1;
+    for(u32 i = 0; i < CPU::maxCoreCount; i++) if(pools[i] != nullptr) wait(pools[i], nullptr, sequence);
+
+}
+
+Workqueue::Statistics Workqueue::getStatistics() {
+
+    // sum statistics of all pools, maximums are taken over pools
+    Statistics statistics = {};
+    for(u32 i = 0; i < CPU::maxCoreCount; i++) {
+        Pool *pool = pools[i];
+        if(pool == nullptr) continue;
+        ScopedSpinlock lock(pool->spinlock);
+        statistics.queued += pool->queued;
+        statistics.executed += pool->executed;
+        statistics.cancelled += pool->cancelled;
+        statistics.depth += pool->pending.size();
+        if(pool->maxDepth > statistics.maxDepth) statistics.maxDepth = pool->maxDepth;
+        statistics.totalLatencyNanoseconds += pool->totalLatencyNanoseconds;
+        if(pool->maxLatencyNanoseconds > statistics.maxLatencyNanoseconds) statistics.maxLatencyNanoseconds = pool->maxLatencyNanoseconds;
+    }
+    return statistics;
+
+}
+
+void Workqueue::dumpStatistics() {
+
+    // print every registered queue, latency is time from queueing (or timer firing) to the start of the work
+    Logger::printFormat("[workqueue] workqueue statistics:\n");
+    usz count = __atomic_load_n(&queueCount, __ATOMIC_ACQUIRE);
+    for(usz i = 0; i < count && i < maxQueueCount; i++) {
+        Workqueue *queue = __atomic_load_n(&queues[i], __ATOMIC_ACQUIRE);
+        if(queue == nullptr) continue;
+        Statistics statistics = queue->getStatistics();
+        u64 averageLatency = (statistics.executed == 0) ? 0 : statistics.totalLatencyNanoseconds / statistics.executed;
+        Logger::printFormat("[workqueue]   - %s - queued: %u, executed: %u, cancelled: %u, depth now/max: %u/%u, latency avg/max: %u/%u us\n",
+            queue->name, statistics.queued, statistics.executed, statistics.cancelled, statistics.depth, statistics.maxDepth,
+            averageLatency / 1000, statistics.maxLatencyNanoseconds / 1000);
+    }
+
+}
+
+Workqueue::Pool *Workqueue::getPool(u8 core) {
+
+    // unbound queue has just one pool, core which came online after the queue was created uses any other pool
+    if(type == Type::Unbound) return pools[0];
+    if(core < CPU::maxCoreCount && pools[core] != nullptr) return pools[core];
+    u8 currentCore = CPU::getCoreAPICID();
+    if(pools[currentCore] != nullptr) return pools[currentCore];
+    for(u32 i = 0; i < CPU::maxCoreCount; i++) if(pools[i] != nullptr) return pools[i];
+    return nullptr;
+
+}
+
+Workqueue::Pool *Workqueue::createPool(i32 affinity) {
+
+    // workers bound the concurrency of the pool, they wait in the idle list until work arrives
+    Pool *pool = new Pool();
+    pool->queue = this;
+    pool->workers = new Worker[maxActive];
+    for(usz i = 0; i < maxActive; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].thread = Scheduler::createThread(&Workqueue::workerLoop, &pool->workers[i], name, affinity);
+    }
+    return pool;
+
+}
+
+bool Workqueue::insert(Pool *pool, Work& work, Work::State expectedState) {
+
+    // state changes to pending only under lock of the pool, so that cancel finds the work where its state says
+    ScopedSpinlock lock(pool->spinlock);
+    if(!__atomic_compare_exchange_n(&work.state, &expectedState, Work::State::Pending, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return false;
+    __atomic_store_n(&work.queue, this, __ATOMIC_RELEASE);
+    __atomic_store_n(&work.pool, static_cast<void*>(pool), __ATOMIC_RELEASE);
+    work.sequence = __atomic_fetch_add(&nextSequence, 1, __ATOMIC_ACQ_REL);
+    work.queuedNanoseconds = HPET::getNanoseconds();
+    pool->pending.appendBack(&work);
+    pool->queued++;
+    if(pool->pending.size() > pool->maxDepth) pool->maxDepth = pool->pending.size();
+
+    // wake up one idle worker, if all of them are busy the work waits for the first one which finishes
+    Worker *worker = pool->idleWorkers.removeFront();
+    if(worker != nullptr) {
+        worker->idle = false;
+        Scheduler::wakeUp(worker->thread);
+    }
+    return true;
+
+}
+
+bool Workqueue::isFlushed(Pool *pool, FlushWaiter *waiter) {
+
+    // waiter for the whole queue waits until all older work (pending or running) finished
+    if(waiter->work == nullptr) {
+        u64 oldestSequence = ~static_cast<u64>(0);
+        Work *firstPending = pool->pending.getFirst();
+        if(firstPending != nullptr) oldestSequence = firstPending->sequence;
+        for(usz i = 0; i < pool->queue->maxActive; i++) {
+            Worker& worker = pool->workers[i];
+            if(worker.work != nullptr && worker.sequence < oldestSequence) oldestSequence = worker.sequence;
+        }
+        return oldestSequence > waiter->sequence;
+    }
+
+    // waiter for single work waits for the awaited instance (with sequence 0 only for running ones, whichever they are)
+    Work *work = waiter->work;
+    if(work->state == Work::State::Pending && work->pool == pool && work->sequence <= waiter->sequence) return false;
+    for(usz i = 0; i < pool->queue->maxActive; i++) {
+        Worker& worker = pool->workers[i];
+        if(worker.work == work && (waiter->sequence == 0 || worker.sequence <= waiter->sequence)) return false;
+    }
+    return true;
+
+}
+
+void Workqueue::wait(Pool *pool, Work *work, u64 sequence) {
+
+    // register as waiter, worker which finishes last awaited work wakes us up
+    FlushWaiter waiter;
+    waiter.thread = Scheduler::getCurrentThread();
+    waiter.work = work;
+    waiter.sequence = sequence;
+    waiter.done = false;
+    {
+        ScopedSpinlock lock(pool->spinlock);
+        if(isFlushed(pool, &waiter)) return;
+        pool->flushWaiters.appendBack(&waiter);
+    }
+
+    // done flag is set together with the wakeup under the lock, so waiter cannot leave before it is woken
+    for(;;) {
+        {
+            ScopedSpinlock lock(pool->spinlock);
+            if(waiter.done) return;
+        }
+        Scheduler::block();
+    }
+
+}
+
+void Workqueue::wakeFlushWaiters(Pool *pool) {
+
+    // called with lock of the pool held
+    pool->flushWaiters.forEach([pool](FlushWaiter *waiter) {
+        if(!isFlushed(pool, waiter)) return;
+        pool->flushWaiters.remove(waiter);
+        waiter->done = true;
+        Scheduler::wakeUp(waiter->thread);
+    });
+
+}
+
+void Workqueue::workerLoop(void *workerData) {
+
+    Worker *worker = reinterpret_cast<Worker*>(workerData);
+    Pool *pool = worker->pool;
+    for(;;) {
+
+        // take the oldest pending work, or wait in the idle list (wakeup meant for someone else just loops again)
+        EventHandler function = nullptr;
+        void *data = nullptr;
+        {
+            ScopedSpinlock lock(pool->spinlock);
+            Work *work = pool->pending.removeFront();
+            if(work == nullptr) {
+                if(!worker->idle) {
+                    worker->idle = true;
+                    pool->idleWorkers.appendBack(worker);
+                }
+            }
+            else {
+
+                // work is not pending from now on, so its function may queue it again
+                if(worker->idle) {
+                    worker->idle = false;
+                    pool->idleWorkers.remove(worker);
+                }
+                function = work->function;
+                data = work->data;
+                worker->work = work;
+                worker->sequence = work->sequence;
+                __atomic_store_n(&work->state, Work::State::Idle, __ATOMIC_RELEASE);
+
+                // record latency of the work
+                u64 latency = HPET::getNanoseconds() - work->queuedNanoseconds;
+                pool->totalLatencyNanoseconds += latency;
+                if(latency > pool->maxLatencyNanoseconds) pool->maxLatencyNanoseconds = latency;
+
+            }
+        }
+        if(function == nullptr) {
+            Scheduler::block();
+            continue;
+        }
+
+        // run the work (it may free itself), then let waiters know it finished
+        function(data);
+        ScopedSpinlock lock(pool->spinlock);
+        worker->work = nullptr;
+        worker->sequence = 0;
+        pool->executed++;
+        wakeFlushWaiters(pool);
+
+    }
+
+}
+
+void Workqueue::delayedWorkHandler(void *workData) {
+
+    // queue the work, unless cancel took it meanwhile - then it is handed back to cancel, which waits for that
+    Work *work = reinterpret_cast<Work*>(workData);
+    Workqueue *queue = work->queue;
+    if(!queue->insert(queue->getPool(work->core), *work, Work::State::Delayed)) __atomic_store_n(&work->state, Work::State::Idle, __ATOMIC_RELEASE);
+
+}
@@ -0,0 +1,204 @@
+#pragma once
+#include <driver/arch/cpu.h>
+#include <sched/scheduler.h>
+#include <util/intrusivelist.h>
+#include <util/spinlock.h>
+#include <util/types.h>
+
+class Workqueue;
+
+/**
+ * @brief Piece of work run by worker thread of a workqueue (so unlike softirq work it may block), it may be queued
+ *        again (or freed) by its own function
+ */
+struct Work {
+
+    enum class State : u8 {
+        Idle,
+        Delayed,
+        Cancelling,
+        Pending
+    };
+
+    EventHandler function = nullptr;
+    void *data = nullptr;
+    State state = State::Idle;
+    u8 core = 0;
+    Workqueue *queue = nullptr;
+    void *pool = nullptr;
+    usz timerID = 0;
+    u64 sequence = 0;
+    u64 queuedNanoseconds = 0;
+    IntrusiveLink<Work> link;
+
+};
+
+/**
+ * @brief Named queue of work run by bounded pools of kernel threads - per-CPU queues have pool of workers pinned to
+ *        every core (work runs on the core which queued it), unbound queue has single pool of workers running anywhere
+ */
+class Workqueue {
+
+public:
+
+    enum class Type : u8 {
+        PerCPU,
+        Unbound
+    };
+
+    /**
+     * @brief Statistics of single queue
+     */
+    struct Statistics {
+        u64 queued;
+        u64 executed;
+        u64 cancelled;
+        usz depth;
+        usz maxDepth;
+        u64 totalLatencyNanoseconds;
+        u64 maxLatencyNanoseconds;
+    };
+
+    /**
+     * @brief Constructor - creates worker threads, has to be called after the scheduler is initialized
+     * @param name Name of the queue (used for its workers and in statistics)
+     * @param type Whether work runs on core which queued it or on any core
+     * @param maxActive Count of work items which may run at the same time (per core for per-CPU queues)
+     */
+    Workqueue(const char *name, Type type, usz maxActive);
+    Workqueue(const Workqueue &) = delete;
+    Workqueue(Workqueue &&) = delete;
+
+    /**
+     * @brief Creates system queues, has to be called once (by BSP) after the scheduler is initialized
+     */
+    static void initialize();
+
+    /**
+     * @brief Returns per-CPU queue for general use
+     * @return System queue, nullptr if queues were not initialized yet
+     */
+    static Workqueue *getSystemQueue();
+
+    /**
+     * @brief Returns unbound queue for general (possibly long-running) use
+     * @return Unbound system queue, nullptr if queues were not initialized yet
+     */
+    static Workqueue *getUnboundQueue();
+
+    /**
+     * @brief Queues work on currently executing core (or anywhere for unbound queue), may be called from interrupt context
+     * @param work Work to be queued
+     * @return true if work was queued, false if it was already pending (or delayed)
+     */
+    bool queue(Work& work);
+
+    /**
+     * @brief Queues work on given core, may be called from interrupt context
+     * @param core LAPIC ID of the core (ignored by unbound queue, current core is used if it has no workers)
+     * @param work Work to be queued
+     * @return true if work was queued, false if it was already pending (or delayed)
+     */
+    bool queueOn(u8 core, Work& work);
+
+    /**
+     * @brief Queues work once given time passes (using HPET timed events), may be called from interrupt context
+     * @param work Work to be queued
+     * @param milliseconds Delay, 0 queues the work right away
+     * @return true if work was scheduled, false if it was already pending (or delayed)
+     */
+    bool queueDelayed(Work& work, u64 milliseconds);
+
+    /**
+     * @brief Cancels pending (or delayed) work and waits until it is not running anymore, so it may be freed afterwards
+     * @param work Work to be cancelled
+     * @return true if work was pending and it will not run, false otherwise
+     * NOTE: has to be called by a thread
+     */
+    static bool cancel(Work& work);
+
+    /**
+     * @brief Waits until work finished running, delayed work is queued right away
+     * @param work Work to be waited for
+     * @return true if work was pending or running, false if it was idle
+     * NOTE: has to be called by a thread
+     */
+    static bool flush(Work& work);
+
+    /**
+     * @brief Waits until all work queued so far finished running (delayed work which was not queued yet is not awaited)
+     * NOTE: has to be called by a thread, which is not a worker of this queue
+     */
+    void flush();
+
+    /**
+     * @brief Returns snapshot of statistics of the queue
+     * @return Current statistics
+     */
+    Statistics getStatistics();
+
+    /**
+     * @brief Prints statistics of all queues, using kernel logger
+     */
+    static void dumpStatistics();
+
+private:
+
+    struct Pool;
+
+    struct Worker {
+        Pool *pool = nullptr;
+        Thread *thread = nullptr;
+        Work *work = nullptr;
+        u64 sequence = 0;
+        bool idle = false;
+        IntrusiveLink<Worker> link;
+    };
+
+    struct FlushWaiter {
+        Thread *thread;
+        Work *work;
+        u64 sequence;
+        bool done;
+        IntrusiveLink<FlushWaiter> link;
+    };
+
+    struct Pool {
+        Workqueue *queue = nullptr;
+        Spinlock spinlock{"workqueue pool"};
+        IntrusiveList<Work, &Work::link> pending;
+        IntrusiveList<Worker, &Worker::link> idleWorkers;
+        IntrusiveList<FlushWaiter, &FlushWaiter::link> flushWaiters;
+        Worker *workers = nullptr;
+        u64 queued = 0;
+        u64 executed = 0;
+        u64 cancelled = 0;
+        usz maxDepth = 0;
+        u64 totalLatencyNanoseconds = 0;
+        u64 maxLatencyNanoseconds = 0;
+    };
+
+    static constexpr usz maxQueueCount = 16;
+    static constexpr usz systemMaxActive = 2;
+
+    Pool *getPool(u8 core);
+    Pool *createPool(i32 affinity);
+    bool insert(Pool *pool, Work& work, Work::State expectedState);
+    static bool isFlushed(Pool *pool, FlushWaiter *waiter);
+    static void wait(Pool *pool, Work *work, u64 sequence);
+    static void wakeFlushWaiters(Pool *pool);
+    static void workerLoop(void *worker);
+    static void delayedWorkHandler(void *work);
+
+    const char *name;
+    Type type;
+    usz maxActive;
+    u64 nextSequence = 1;
+    Pool *pools[CPU::maxCoreCount] = {};
+
+    static inline Workqueue *queues[maxQueueCount] = {};
+    static inline usz queueCount = 0;
+    static inline Workqueue *systemQueue = nullptr;
+    static inline Workqueue *unboundQueue = nullptr;
+
+};
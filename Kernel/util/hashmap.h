@@ -0,0 +1,252 @@
+#pragma once
+
+#include <util/types.h>
+
+/**
+ * @brief Mixes bits of integer, so that keys differing only in few bits land in distant buckets (finalizer of MurmurHash3)
+ * @param value Value to be mixed
+ * @return Mixed value
+ */
+inline u64 hashInteger(u64 value) {
+
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdull;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ull;
+    value ^= value >> 33;
+    return value;
+
+}
+
+/**
+ * Default hash of integer-like keys, specialize it for other key types
+ */
+template<typename K>
+struct Hash {
+    static u64 hash(const K& key) { return hashInteger(static_cast<u64>(key)); }
+};
+
+template<typename K>
+struct Hash<K*> {
+    static u64 hash(K *key) { return hashInteger(reinterpret_cast<u64>(key)); }
+};
+
+/**
+ * Class encapsulating hash map with open addressing and Robin Hood probing, probe distances are kept in separate
+ * byte array, so that most misses are decided without touching the entries at all
+ * NOTE: keys and values have to be default constructible and assignable (entries are kept in plain array)
+ */
+template<typename K, typename V, typename H = Hash<K>>
+class HashMap {
+
+public:
+
+    constexpr HashMap() {};
+
+    HashMap(const HashMap &) = delete;
+    HashMap& operator=(const HashMap &) = delete;
+
+    ~HashMap() {
+
+        delete[] distances;
+        delete[] entries;
+
+    };
+
+    /**
+     * @brief Inserts value under given key, replacing previous value if the key is already present
+     * @param key Key
+     * @param value Value
+     * @return Pointer to stored value, valid until next insertion
+     */
+    V *insert(const K& key, const V& value) {
+
+        // replace value of existing key
+        V *existing = find(key);
+        if(existing != nullptr) {
+            *existing = value;
+            return existing;
+        }
+
+        // keep load factor under 7/8, Robin Hood probing keeps probe sequences short even then
+        if((count + 1) * 8 > capacity * 7) grow();
+        count++;
+        return place(key, value);
+
+    };
+
+    /**
+     * @brief Finds value stored under given key
+     * @param key Key
+     * @return Pointer to stored value, nullptr if key is not present
+     */
+    V *find(const K& key) const {
+
+        usz index = findIndex(key);
+        return (index == capacity) ? nullptr : &entries[index].value;
+
+    };
+
+    bool contains(const K& key) const {
+        return find(key) != nullptr;
+    };
+
+    /**
+     * @brief Removes key from the map
+     * @param key Key to be removed
+     * @return true if key was present, false otherwise
+     */
+    bool remove(const K& key) {
+
+        // find the entry
+        usz index = findIndex(key);
+        if(index == capacity) return false;
+
+        // shift following entries of the same cluster one place back, so that no tombstones are needed
+        usz next = (index + 1) & (capacity - 1);
+        while(distances[next] > 1) {
+            entries[index] = static_cast<Entry&&>(entries[next]);
+            distances[index] = distances[next] - 1;
+            index = next;
+            next = (next + 1) & (capacity - 1);
+        }
+        entries[index] = Entry();
+        distances[index] = 0;
+        count--;
+        return true;
+
+    };
+
+    /**
+     * @brief Makes sure that given count of keys fits without rehashing
+     * @param keyCount Requested count of keys
+     */
+    void reserve(usz keyCount) {
+
+        // find smallest power of two keeping the load factor
+        usz newCapacity = (capacity == 0) ? initialCapacity : capacity;
+        while(keyCount * 8 > newCapacity * 7) newCapacity *= 2;
+        if(newCapacity != capacity) rehash(newCapacity);
+
+    };
+
+    void clear() {
+
+        // reset all entries, storage is kept for reuse
+        for(usz i = 0; i < capacity; i++) {
+            if(distances[i] == 0) continue;
+            entries[i] = Entry();
+            distances[i] = 0;
+        }
+        count = 0;
+
+    };
+
+    usz size() const {
+        return count;
+    };
+
+    bool isEmpty() const {
+        return count == 0;
+    };
+
+    template<typename F>
+    void forEach(F function) {
+
+        // walk all occupied entries, order is unspecified
+        for(usz i = 0; i < capacity; i++) if(distances[i] != 0) function(entries[i].key, entries[i].value);
+
+    };
+
+private:
+
+    struct Entry {
+        K key = K();
+        V value = V();
+    };
+
+    static constexpr usz initialCapacity = 16;
+    static constexpr u8 maxDistance = 0xff;
+
+    u8 *distances = nullptr;
+    Entry *entries = nullptr;
+    usz capacity = 0;
+    usz count = 0;
+
+    usz findIndex(const K& key) const {
+
+        // walk the probe sequence, key cannot lie past entry closer to its home than we are
+        if(count == 0) return capacity;
+        usz index = H::hash(key) & (capacity - 1);
+        for(u8 distance = 1; ; distance++) {
+            if(distances[index] < distance) return capacity;
+            if(distances[index] == distance && entries[index].key == key) return index;
+            index = (index + 1) & (capacity - 1);
+        }
+
+    };
+
+    void grow() {
+        rehash((capacity == 0) ? initialCapacity : capacity * 2);
+    };
+
+    void rehash(usz newCapacity) {
+
+        // allocate new arrays
+        u8 *oldDistances = distances;
+        Entry *oldEntries = entries;
+        usz oldCapacity = capacity;
+        distances = new u8[newCapacity];
+        for(usz i = 0; i < newCapacity; i++) distances[i] = 0;
+        entries = new Entry[newCapacity];
+        capacity = newCapacity;
+
+        // place all entries again
+        for(usz i = 0; i < oldCapacity; i++) if(oldDistances[i] != 0) place(oldEntries[i].key, oldEntries[i].value);
+        delete[] oldDistances;
+        delete[] oldEntries;
+
+    };
+
+    V *place(const K& key, const V& value) {
+
+        // walk the probe sequence, taking slots from entries closer to their home (the robbed entry continues instead)
+        Entry carried;
+        carried.key = key;
+        carried.value = value;
+        V *placed = nullptr;
+        usz index = H::hash(key) & (capacity - 1);
+        for(u8 distance = 1; ; distance++) {
+
+            // probe sequence too long (would happen only with very bad hash), grow and place carried entry again
+            if(distance == maxDistance) {
+                grow();
+                V *carriedPlace = place(carried.key, carried.value);
+                return (placed != nullptr) ? find(key) : carriedPlace;
+            }
+
+            // free slot ends the walk
+            if(distances[index] == 0) {
+                entries[index] = static_cast<Entry&&>(carried);
+                distances[index] = distance;
+                return (placed != nullptr) ? placed : &entries[index].value;
+            }
+
+            // rob the richer entry
+            if(distances[index] < distance) {
+                Entry robbed = static_cast<Entry&&>(entries[index]);
+                u8 robbedDistance = distances[index];
+                entries[index] = static_cast<Entry&&>(carried);
+                distances[index] = distance;
+                if(placed == nullptr) placed = &entries[index].value;
+                carried = static_cast<Entry&&>(robbed);
+                distance = robbedDistance;
+            }
+
+            index = (index + 1) & (capacity - 1);
+
+        }
+
+    };
+
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <util/types.h>
+
+/**
+ * Links embedded in element of intrusive list, element may be in as many lists as it has links
+ */
+template<typename T>
+struct IntrusiveLink {
+    T *previous = nullptr;
+    T *next = nullptr;
+};
+
+/**
+ * Class encapsulating doubly-linked list which keeps links inside of its elements, so it never allocates memory
+ * NOTE: list does not own its elements, they have to outlive their membership
+ */
+template<typename T, IntrusiveLink<T> T::*Link>
+class IntrusiveList {
+
+public:
+
+    constexpr IntrusiveList() {};
+
+    IntrusiveList(const IntrusiveList &) = delete;
+    IntrusiveList& operator=(const IntrusiveList &) = delete;
+
+    void appendBack(T *element) {
+
+        // link element after the last one
+        link(element).previous = last;
+        link(element).next = nullptr;
+        if(last != nullptr) link(last).next = element;
+        else first = element;
+        last = element;
+        count++;
+
+    };
+
+    void appendFront(T *element) {
+
+        // link element before the first one
+        link(element).previous = nullptr;
+        link(element).next = first;
+        if(first != nullptr) link(first).previous = element;
+        else last = element;
+        first = element;
+        count++;
+
+    };
+
+    /**
+     * @brief Inserts element before other element of the list
+     * @param element Element to be inserted
+     * @param position Element of the list before which insertion is performed, nullptr to append back
+     */
+    void insertBefore(T *element, T *position) {
+
+        // inserting before nothing means appending back, before first means appending front
+        if(position == nullptr) {
+            appendBack(element);
+            return;
+        }
+        if(position == first) {
+            appendFront(element);
+            return;
+        }
+
+        // link element in the middle
+        T *previous = link(position).previous;
+        link(element).previous = previous;
+        link(element).next = position;
+        link(previous).next = element;
+        link(position).previous = element;
+        count++;
+
+    };
+
+    /**
+     * @brief Inserts element after other element of the list
+     * @param element Element to be inserted
+     * @param position Element of the list after which insertion is performed, nullptr to append front
+     */
+    void insertAfter(T *element, T *position) {
+
+        // inserting after nothing means appending front
+        if(position == nullptr) appendFront(element);
+        else insertBefore(element, link(position).next);
+
+    };
+
+    void remove(T *element) {
+
+        // unlink element from its neighbours
+        IntrusiveLink<T>& elementLink = link(element);
+        if(elementLink.previous != nullptr) link(elementLink.previous).next = elementLink.next;
+        else first = elementLink.next;
+        if(elementLink.next != nullptr) link(elementLink.next).previous = elementLink.previous;
+        else last = elementLink.previous;
+
+        // clear links and decrement count
+        elementLink.previous = nullptr;
+        elementLink.next = nullptr;
+        count--;
+
+    };
+
+    T *removeFront() {
+
+        // unlink first element if there is any
+        T *element = first;
+        if(element != nullptr) remove(element);
+        return element;
+
+    };
+
+    usz size() const {
+        return count;
+    };
+
+    bool isEmpty() const {
+        return count == 0;
+    };
+
+    T *getFirst() const {
+        return first;
+    };
+
+    T *getLast() const {
+        return last;
+    };
+
+    T *getNext(T *element) const {
+        return link(element).next;
+    };
+
+    T *getPrevious(T *element) const {
+        return link(element).previous;
+    };
+
+    template<typename F>
+    void forEach(F function) {
+
+        // next element is read before calling the function, so it may remove current one
+        T *current = first;
+        while(current != nullptr) {
+            T *next = link(current).next;
+            function(current);
+            current = next;
+        }
+
+    };
+
+private:
+
+    static IntrusiveLink<T>& link(T *element) { return element->*Link; };
+
+    T *first = nullptr;
+    T *last = nullptr;
+    usz count = 0;
+
+};
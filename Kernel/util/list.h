@@ -172,6 +172,14 @@ public:
         return getReference(index)->value;
     };
 
+    template<typename F>
+    void forEach(F function) {
+
+        // walk nodes one by one, which is much cheaper than indexing every element
+        for(Node *current = first; current != nullptr; current = current->next) function(current->value);
+
+    };
+
     const T& operator[](usz index) const {
         return get(index);
     };
@@ -187,8 +195,8 @@ private:
         Node(T & val) : value(val) {};
 
         T value;
-        Node *previous;
-        Node *next;
+        Node *previous = nullptr;
+        Node *next = nullptr;
     };
 
     Node *first = nullptr;
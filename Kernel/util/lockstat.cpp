@@ -0,0 +1,123 @@
+#include "util/lockstat.h"
+#ifdef KERNEL_LOCKSTAT
+#include "driver/arch/cpu.h"
+#include "util/hashmap.h"
+#include "util/logger.h"
+
+void LockStatistics::Probe::acquired(u64 startTimestamp, bool contended) {
+
+    // resolve site on first acquisition, lock may have been constructed before anything else was running
+    if(site == nullptr) site = findSite(name, line);
+    u64 timestamp = CPU::readTimestampCounter();
+    acquiredTimestamp = timestamp;
+    if(site == nullptr) {
+        __atomic_add_fetch(&droppedAcquisitions, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    // account acquisition, other locks of the same site may update it concurrently
+    __atomic_add_fetch(&site->acquisitions, 1, __ATOMIC_RELAXED);
+    if(!contended) return;
+    u64 spinCycles = timestamp - startTimestamp;
+    __atomic_add_fetch(&site->contendedAcquisitions, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&site->totalSpinCycles, spinCycles, __ATOMIC_RELAXED);
+    updateMaximum(&site->maxSpinCycles, spinCycles);
+
+}
+
+void LockStatistics::Probe::released() {
+
+    // account time since acquisition
+    if(site == nullptr) return;
+    u64 holdCycles = CPU::readTimestampCounter() - acquiredTimestamp;
+    __atomic_add_fetch(&site->totalHoldCycles, holdCycles, __ATOMIC_RELAXED);
+    updateMaximum(&site->maxHoldCycles, holdCycles);
+
+}
+
+void LockStatistics::dump() {
+
+    // print every used site, averages are per acquisition (spin per contended acquisition)
+    Logger::printFormat("[lockstat] lock statistics (cycles):\n");
+    for(usz i = 0; i < maxSiteCount; i++) {
+        Site& site = sites[i];
+        if(!__atomic_load_n(&site.ready, __ATOMIC_ACQUIRE)) continue;
+        u64 acquisitions = __atomic_load_n(&site.acquisitions, __ATOMIC_RELAXED);
+        if(acquisitions == 0) continue;
+        u64 contended = __atomic_load_n(&site.contendedAcquisitions, __ATOMIC_RELAXED);
+        u64 averageSpin = (contended == 0) ? 0 : __atomic_load_n(&site.totalSpinCycles, __ATOMIC_RELAXED) / contended;
+        u64 averageHold = __atomic_load_n(&site.totalHoldCycles, __ATOMIC_RELAXED) / acquisitions;
+        Logger::printFormat("[lockstat]   - %s:%u - acquisitions: %u, contended: %u, spin avg/max: %u/%u, hold avg/max: %u/%u\n",
+            site.name, site.line, acquisitions, contended, averageSpin, __atomic_load_n(&site.maxSpinCycles, __ATOMIC_RELAXED),
+            averageHold, __atomic_load_n(&site.maxHoldCycles, __ATOMIC_RELAXED));
+    }
+    u64 dropped = __atomic_load_n(&droppedAcquisitions, __ATOMIC_RELAXED);
+    if(dropped != 0) Logger::printFormat("[lockstat] %u acquisitions of locks over the limit of %u sites were not recorded\n", dropped, maxSiteCount);
+
+}
+
+void LockStatistics::reset() {
+
+    // zero counters of all sites, concurrent updates may survive, which is fine for statistics
+    for(usz i = 0; i < maxSiteCount; i++) {
+        Site& site = sites[i];
+        __atomic_store_n(&site.acquisitions, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site.contendedAcquisitions, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site.totalSpinCycles, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site.maxSpinCycles, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site.totalHoldCycles, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&site.maxHoldCycles, 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&droppedAcquisitions, 0, __ATOMIC_RELAXED);
+
+}
+
+LockStatistics::Site *LockStatistics::findSite(const char *name, u32 line) {
+
+    // sites live in fixed table, so that locks of the heap itself can be tracked (nothing is allocated here)
+    u64 nameHash = 0;
+    for(const char *current = name; *current != '\0'; current++) nameHash = nameHash * 31 + static_cast<u8>(*current);
+    usz home = hashInteger(nameHash ^ line) % maxSiteCount;
+    for(usz probe = 0; probe < maxSiteCount; probe++) {
+        Site& site = sites[(home + probe) % maxSiteCount];
+
+        // claim free slot, other cores see the site only after it is filled
+        bool expected = false;
+        if(__atomic_compare_exchange_n(&site.claimed, &expected, true, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            site.name = name;
+            site.line = line;
+            __atomic_store_n(&site.ready, true, __ATOMIC_RELEASE);
+            return &site;
+        }
+
+        // slot is taken, wait until it is filled and compare it
+        while(!__atomic_load_n(&site.ready, __ATOMIC_ACQUIRE)) CPU::pause();
+        if(site.line == line && sameName(site.name, name)) return &site;
+    }
+
+    // table is full
+    return nullptr;
+
+}
+
+bool LockStatistics::sameName(const char *first, const char *second) {
+
+    // the same literal may have different addresses in different translation units
+    if(first == second) return true;
+    while(*first != '\0' && *first == *second) {
+        first++;
+        second++;
+    }
+    return *first == *second;
+
+}
+
+void LockStatistics::updateMaximum(u64 *maximum, u64 value) {
+
+    // raise the maximum unless someone raised it above value already
+    u64 current = __atomic_load_n(maximum, __ATOMIC_RELAXED);
+    while(value > current && !__atomic_compare_exchange_n(maximum, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+}
+
+#endif
@@ -0,0 +1,81 @@
+#pragma once
+#ifdef KERNEL_LOCKSTAT
+#include <util/types.h>
+
+/**
+ * @brief Class collecting lock statistics (built in only with LOCKSTAT=1), statistics are aggregated per lock site
+ *        (name or file and line where the lock is declared), so every global lock has its own entry and dynamically
+ *        created locks of one kind (e.g. spinlocks of all address spaces) share one
+ */
+class LockStatistics {
+
+public:
+
+    /**
+     * @brief Statistics of single lock site
+     */
+    struct Site {
+        const char *name;
+        u32 line;
+        bool claimed;
+        bool ready;
+        u64 acquisitions;
+        u64 contendedAcquisitions;
+        u64 totalSpinCycles;
+        u64 maxSpinCycles;
+        u64 totalHoldCycles;
+        u64 maxHoldCycles;
+    };
+
+    /**
+     * @brief Bookkeeping embedded in every instrumented lock, it is touched only by the lock owner
+     */
+    class Probe {
+
+    public:
+        constexpr Probe(const char *name, u32 line) : name(name), line(line) {};
+
+        /**
+         * @brief Records acquisition of the lock, called by new owner
+         * @param startTimestamp Timestamp counter read before first attempt to take the lock
+         * @param contended Whether the lock was not free at the first attempt
+         */
+        void acquired(u64 startTimestamp, bool contended);
+
+        /**
+         * @brief Records release of the lock, called by owner right before releasing it
+         */
+        void released();
+
+    private:
+        const char *name;
+        u32 line;
+        Site *site = nullptr;
+        u64 acquiredTimestamp = 0;
+
+    };
+
+    /**
+     * @brief Prints statistics of all lock sites which were acquired at least once, using kernel logger
+     */
+    static void dump();
+
+    /**
+     * @brief Zeroes all collected statistics (sites stay registered)
+     */
+    static void reset();
+
+private:
+
+    static constexpr usz maxSiteCount = 128;
+
+    static Site *findSite(const char *name, u32 line);
+    static bool sameName(const char *first, const char *second);
+    static void updateMaximum(u64 *maximum, u64 value);
+
+    static inline Site sites[maxSiteCount] = {};
+    static inline u64 droppedAcquisitions = 0;
+
+};
+
+#endif
@@ -7,13 +7,13 @@ void Logger::setBackingDevice(ITextOutput *device) {
 void Logger::printFormat(const char *format) {
 
     // lock spinlock if needed
-    if(printRecursionDepth == 0) loggerSpinlock.lock();
+    if(printRecursionDepth.get() == 0) loggerSpinlock.lock();
 
     // make text colorful (green), print format and reset color attribute
     print(format);
 
     // unlock spinlock 
-    if(printRecursionDepth == 0) loggerSpinlock.unlock();
+    if(printRecursionDepth.get() == 0) loggerSpinlock.unlock();
 
 }
 
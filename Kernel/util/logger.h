@@ -1,5 +1,6 @@
 #pragma once
 #include <driver/iface/itxtout.h>
+#include <util/percpu.h>
 #include <util/types.h>
 #include <util/spinlock.h>
 
@@ -16,7 +17,7 @@ public:
     static void printFormat(const char *format, T value, Args... args) {
 
         // if current depth is 0, print color code
-        if(printRecursionDepth == 0) {
+        if(printRecursionDepth.get() == 0) {
 			loggerSpinlock.lock();
 		}
 
@@ -33,7 +34,7 @@ public:
                 format++;
                 if(*format == '\0') {
                     print("<invalid format>");
-                    if(printRecursionDepth == 0) {
+                    if(printRecursionDepth.get() == 0) {
                         print("\u001b[0m");
                         loggerSpinlock.unlock();
 					}
@@ -50,20 +51,20 @@ public:
                     case 'u':
                     case 'b':
                         print(value);
-                        printRecursionDepth++;
+                        printRecursionDepth.get()++;
                         printFormat(format + 1, args...);
-                        printRecursionDepth--;
-                        if(printRecursionDepth == 0) {
+                        printRecursionDepth.get()--;
+                        if(printRecursionDepth.get() == 0) {
 							loggerSpinlock.unlock();
 						}
                         return;
                     case 'x':
                         shouldNextNumberBeHex = true;
                         print(value);
-                        printRecursionDepth++;
+                        printRecursionDepth.get()++;
                         printFormat(format + 1, args...);
-                        printRecursionDepth--;
-                        if(printRecursionDepth == 0) {
+                        printRecursionDepth.get()--;
+                        if(printRecursionDepth.get() == 0) {
 							loggerSpinlock.unlock();
 						}
                         return;
@@ -83,7 +84,7 @@ public:
         }
 
         // print color reset
-        if(printRecursionDepth == 0) {
+        if(printRecursionDepth.get() == 0) {
             loggerSpinlock.unlock();
         }
 
@@ -96,8 +97,8 @@ private:
 
     static inline ITextOutput *currentOutputDevice = nullptr;
     static inline bool shouldNextNumberBeHex = false;
-    static inline usz printRecursionDepth = 0;
-    static inline Spinlock loggerSpinlock;
+    static inline PerCPU<usz> printRecursionDepth; // per core, as other cores must not skip locking while one prints
+    static inline Spinlock loggerSpinlock{"logger"};
 
     static void print(const char character);
     static void print(const char *string);
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <util/types.h>
+
+/**
+ * Link embedded in element of MPSC queue
+ */
+template<typename T>
+struct MPSCLink {
+    T *next = nullptr;
+};
+
+/**
+ * Class encapsulating lock-free intrusive queue with many producers and single consumer, producers push onto atomic
+ * stack and consumer detaches it whole, restoring FIFO order (so there is no ABA problem and pushing never spins
+ * for long, which makes it usable from interrupt handlers)
+ */
+template<typename T, MPSCLink<T> T::*Link>
+class MPSCQueue {
+
+public:
+
+    constexpr MPSCQueue() {};
+
+    MPSCQueue(const MPSCQueue &) = delete;
+    MPSCQueue& operator=(const MPSCQueue &) = delete;
+
+    /**
+     * @brief Adds element to the queue, may be called by any number of producers concurrently
+     * @param element Element to be added, it must not be in the queue already
+     * @return true if queue was empty before, false otherwise
+     */
+    bool push(T *element) {
+
+        // link element in front of current head and try to publish it
+        T *currentHead = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        do {
+            (element->*Link).next = currentHead;
+        } while(!__atomic_compare_exchange_n(&head, &currentHead, element, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+        return currentHead == nullptr;
+
+    };
+
+    /**
+     * @brief Detaches all queued elements, may be called only by the consumer
+     * @return First of detached elements in order of pushing (following ones are reached by getNext), nullptr if queue was empty
+     */
+    T *takeAll() {
+
+        // detach the stack at once
+        T *current = __atomic_exchange_n(&head, nullptr, __ATOMIC_ACQUIRE);
+
+        // reverse it, so that elements are processed in order of pushing
+        T *reversed = nullptr;
+        while(current != nullptr) {
+            T *next = (current->*Link).next;
+            (current->*Link).next = reversed;
+            reversed = current;
+            current = next;
+        }
+        return reversed;
+
+    };
+
+    bool isEmpty() const {
+        return __atomic_load_n(&head, __ATOMIC_RELAXED) == nullptr;
+    };
+
+    static T *getNext(T *element) {
+        return (element->*Link).next;
+    };
+
+private:
+
+    T *head = nullptr;
+
+};
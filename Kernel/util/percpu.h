@@ -0,0 +1,106 @@
+#pragma once
+
+#include <driver/arch/cpu.h>
+#include <util/types.h>
+
+/**
+ * Class encapsulating per-core instances of variable, every core has its own instance on separate cache lines, so that
+ * cores never share lines they write (instances are indexed by LAPIC ID, current core is found through GS base)
+ * NOTE: instances are over-aligned, so this has to have static storage (heap does not provide such alignment)
+ */
+template<typename T>
+class PerCPU {
+
+public:
+
+    constexpr PerCPU() {};
+
+    PerCPU(const PerCPU &) = delete;
+    PerCPU& operator=(const PerCPU &) = delete;
+
+    /**
+     * @brief Returns instance of currently executing core
+     * @return Instance of current core
+     * NOTE: caller must not move to other core while using it (interrupts or preemption have to be disabled)
+     */
+    T& get() {
+        return slots[CPU::getCoreAPICID()].value;
+    };
+
+    /**
+     * @brief Returns instance of given core
+     * @param core LAPIC ID of the core
+     * @return Instance of given core
+     */
+    T& get(u8 core) {
+        return slots[core].value;
+    };
+
+    T& operator[](u8 core) {
+        return slots[core].value;
+    };
+
+    template<typename F>
+    void forEach(F function) {
+
+        // walk instances of all possible cores, in order of LAPIC IDs
+        for(u32 i = 0; i < CPU::maxCoreCount; i++) function(static_cast<u8>(i), slots[i].value);
+
+    };
+
+private:
+
+    struct alignas(CPU::cacheLineSize) Slot {
+        T value;
+    };
+
+    Slot slots[CPU::maxCoreCount] = {};
+
+};
+
+/**
+ * Class encapsulating statistics counter split between cores, every core adds only to its own instance (which never
+ * leaves its cache), while reader sums all of them - cheap for frequently updated and rarely read counters
+ */
+class PerCPUCounter {
+
+public:
+
+    constexpr PerCPUCounter() {};
+
+    PerCPUCounter(const PerCPUCounter &) = delete;
+    PerCPUCounter& operator=(const PerCPUCounter &) = delete;
+
+    /**
+     * @brief Adds value to instance of currently executing core
+     * @param value Value to be added
+     */
+    void add(u64 value = 1) {
+
+        // atomic add keeps the count right even if the caller moves to other core between finding and updating the
+        // instance, it does not bounce the line anyway (only the owner writes it in common case)
+        __atomic_fetch_add(&counters.get(), value, __ATOMIC_RELAXED);
+
+    };
+
+    /**
+     * @brief Returns sum of instances of all cores
+     * @return Current value of the counter (additions running concurrently may be missed)
+     */
+    u64 sum() {
+
+        u64 total = 0;
+        counters.forEach([&total](u8, u64& counter) { total += __atomic_load_n(&counter, __ATOMIC_RELAXED); });
+        return total;
+
+    };
+
+    void reset() {
+        counters.forEach([](u8, u64& counter) { __atomic_store_n(&counter, 0, __ATOMIC_RELAXED); });
+    };
+
+private:
+
+    PerCPU<u64> counters;
+
+};
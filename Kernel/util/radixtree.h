@@ -0,0 +1,139 @@
+#pragma once
+
+#include <util/types.h>
+
+/**
+ * Class encapsulating radix tree mapping sparse integer keys (e.g. page frame numbers, PIDs or LBAs) to values,
+ * tree grows in height only as much as the largest key requires and nodes are created only for populated ranges
+ * NOTE: value equal to default constructed one means empty slot, slots never move, so pointers to them stay valid
+ */
+template<typename T>
+class RadixTree {
+
+public:
+
+    constexpr RadixTree() {};
+
+    RadixTree(const RadixTree &) = delete;
+    RadixTree& operator=(const RadixTree &) = delete;
+
+    ~RadixTree() { destroy(root, height); };
+
+    /**
+     * @brief Returns slot for given key, creating nodes on the way if needed
+     * @param key Key
+     * @return Pointer to the slot
+     */
+    T *getSlot(u64 key) {
+
+        // add levels above current root until key fits
+        while(height == 0 || (height * bitsPerLevel < 64 && (key >> (height * bitsPerLevel)) != 0)) {
+            if(height == 0) root = new Leaf();
+            else {
+                Node *newRoot = new Node();
+                newRoot->children[0] = root;
+                root = newRoot;
+            }
+            height++;
+        }
+
+        // walk down interior nodes, creating missing ones
+        void *current = root;
+        for(usz level = height - 1; level > 0; level--) {
+            Node *node = reinterpret_cast<Node*>(current);
+            usz index = (key >> (level * bitsPerLevel)) & (childrenPerNode - 1);
+            if(node->children[index] == nullptr) node->children[index] = (level == 1) ? static_cast<void*>(new Leaf()) : static_cast<void*>(new Node());
+            current = node->children[index];
+        }
+
+        // return slot in the leaf
+        return &reinterpret_cast<Leaf*>(current)->values[key & (childrenPerNode - 1)];
+
+    };
+
+    /**
+     * @brief Returns slot for given key without creating anything
+     * @param key Key
+     * @return Pointer to the slot, nullptr if no node covers the key
+     */
+    T *findSlot(u64 key) const {
+
+        // key may be beyond the tree
+        if(height == 0 || (height * bitsPerLevel < 64 && (key >> (height * bitsPerLevel)) != 0)) return nullptr;
+
+        // walk down interior nodes
+        void *current = root;
+        for(usz level = height - 1; level > 0; level--) {
+            usz index = (key >> (level * bitsPerLevel)) & (childrenPerNode - 1);
+            current = reinterpret_cast<Node*>(current)->children[index];
+            if(current == nullptr) return nullptr;
+        }
+
+        // return slot in the leaf
+        return &reinterpret_cast<Leaf*>(current)->values[key & (childrenPerNode - 1)];
+
+    };
+
+    T get(u64 key) const {
+        T *slot = findSlot(key);
+        return (slot == nullptr) ? T() : *slot;
+    };
+
+    void set(u64 key, const T& value) {
+        *getSlot(key) = value;
+    };
+
+    template<typename F>
+    void forEach(F function) {
+
+        // walk all non-empty slots in ascending order of keys
+        walk(root, height, 0, function);
+
+    };
+
+private:
+
+    static constexpr usz bitsPerLevel = 6;
+    static constexpr usz childrenPerNode = 1ull << bitsPerLevel;
+
+    struct Node {
+        void *children[childrenPerNode] = {};
+    };
+
+    struct Leaf {
+        T values[childrenPerNode] = {};
+    };
+
+    void *root = nullptr;
+    usz height = 0;
+
+    static void destroy(void *current, usz level) {
+
+        // free children first, leaves are at level 1
+        if(current == nullptr) return;
+        if(level == 1) {
+            delete reinterpret_cast<Leaf*>(current);
+            return;
+        }
+        Node *node = reinterpret_cast<Node*>(current);
+        for(usz i = 0; i < childrenPerNode; i++) destroy(node->children[i], level - 1);
+        delete node;
+
+    };
+
+    template<typename F>
+    static void walk(void *current, usz level, u64 prefix, F& function) {
+
+        // call function for every occupied slot of leaf, descend otherwise
+        if(current == nullptr) return;
+        if(level == 1) {
+            Leaf *leaf = reinterpret_cast<Leaf*>(current);
+            for(usz i = 0; i < childrenPerNode; i++) if(!(leaf->values[i] == T())) function((prefix << bitsPerLevel) | i, leaf->values[i]);
+            return;
+        }
+        Node *node = reinterpret_cast<Node*>(current);
+        for(usz i = 0; i < childrenPerNode; i++) walk(node->children[i], level - 1, (prefix << bitsPerLevel) | i, function);
+
+    };
+
+};
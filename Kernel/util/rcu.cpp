@@ -0,0 +1,107 @@
+#include "util/rcu.h"
+
+void RCU::readLock() {
+
+    // full barrier orders the increment before loads of protected data, so writer never misses this reader
+    // (interrupts are disabled, so that thread is not preempted and moved between picking the core and incrementing)
+    bool interruptState = CPU::enterCritical();
+    __atomic_add_fetch(&cores.get().nesting, 1, __ATOMIC_SEQ_CST);
+    CPU::exitCritical(interruptState);
+
+}
+
+void RCU::readUnlock() {
+
+    // leaving outermost section ends all sections of this core which could have been observed by writers
+    bool interruptState = CPU::enterCritical();
+    CoreState& state = cores.get();
+    if(__atomic_sub_fetch(&state.nesting, 1, __ATOMIC_RELEASE) == 0) __atomic_add_fetch(&state.generation, 1, __ATOMIC_RELEASE);
+    CPU::exitCritical(interruptState);
+
+}
+
+bool RCU::isReading() {
+
+    // nesting of the core is written only by the core itself
+    bool interruptState = CPU::enterCritical();
+    bool reading = __atomic_load_n(&cores.get().nesting, __ATOMIC_RELAXED) != 0;
+    CPU::exitCritical(interruptState);
+    return reading;
+
+}
+
+void RCU::synchronize() {
+
+    // wait until every core left sections it was in at the moment of snapshot
+    Snapshot snapshot;
+    takeSnapshot(snapshot);
+    while(!gracePeriodEnded(snapshot)) CPU::pause();
+
+}
+
+void RCU::call(WorkItem *item) {
+
+    // callbacks wait in lock-free queue until current grace period ends
+    __atomic_store_n(&item->queued, true, __ATOMIC_RELAXED);
+    pendingCallbacks.push(item);
+
+}
+
+void RCU::poll() {
+
+    // fast path - nothing to do
+    if(__atomic_load_n(&waitingCallbacks, __ATOMIC_RELAXED) == nullptr && pendingCallbacks.isEmpty()) return;
+
+    // only one core processes callbacks at a time, others just skip
+    if(__atomic_exchange_n(&polling, true, __ATOMIC_ACQUIRE)) return;
+
+    // run callbacks whose grace period ended
+    if(waitingCallbacks != nullptr && gracePeriodEnded(waitingSnapshot)) {
+        WorkItem *item = waitingCallbacks;
+        waitingCallbacks = nullptr;
+        while(item != nullptr) {
+            WorkItem *next = MPSCQueue<WorkItem, &WorkItem::link>::getNext(item);
+            __atomic_store_n(&item->queued, false, __ATOMIC_RELAXED);
+            item->function(item->data);
+            item = next;
+        }
+    }
+
+    // start grace period for callbacks queued meanwhile
+    if(waitingCallbacks == nullptr) {
+        waitingCallbacks = pendingCallbacks.takeAll();
+        if(waitingCallbacks != nullptr) takeSnapshot(waitingSnapshot);
+    }
+
+    __atomic_store_n(&polling, false, __ATOMIC_RELEASE);
+
+}
+
+void RCU::takeSnapshot(Snapshot& snapshot) {
+
+    // order publication of new data (done by caller) before reading states of readers
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    // cores outside of read-side sections cannot see old data anymore, others have to finish current section
+    snapshot.quiescentCores = 0;
+    for(usz i = 0; i < CPU::maxCoreCount; i++) {
+        snapshot.generation[i] = __atomic_load_n(&cores[i].generation, __ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&cores[i].nesting, __ATOMIC_ACQUIRE) == 0) snapshot.quiescentCores |= (1ull << i);
+    }
+
+}
+
+bool RCU::gracePeriodEnded(Snapshot& snapshot) {
+
+    // every core has to be quiescent at snapshot, now, or it had to leave its section since then
+    for(usz i = 0; i < CPU::maxCoreCount; i++) {
+        if(snapshot.quiescentCores & (1ull << i)) continue;
+        if(__atomic_load_n(&cores[i].nesting, __ATOMIC_ACQUIRE) == 0 || __atomic_load_n(&cores[i].generation, __ATOMIC_ACQUIRE) != snapshot.generation[i]) {
+            snapshot.quiescentCores |= (1ull << i);
+            continue;
+        }
+        return false;
+    }
+    return true;
+
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <driver/arch/cpu.h>
+#include <util/mpsc.h>
+#include <util/percpu.h>
+#include <util/softirq.h>
+#include <util/types.h>
+
+/**
+ * @brief Class implementing read-copy-update synchronization for read-mostly data - readers never wait, writers publish
+ * new version of data and free old one after grace period (when every core left read-side sections which could see it)
+ */
+class RCU {
+
+public:
+
+    /**
+     * @brief Enters read-side critical section on currently executing core, sections may be nested
+     * NOTE: reader must not block or migrate to other core inside of the section
+     */
+    static void readLock();
+
+    /**
+     * @brief Leaves read-side critical section on currently executing core
+     */
+    static void readUnlock();
+
+    /**
+     * @brief Checks whether currently executing core is inside of read-side section (it must not be preempted then)
+     * @return true if core is inside of read-side section, false otherwise
+     */
+    static bool isReading();
+
+    /**
+     * @brief Waits until all read-side sections which were in progress at the moment of call finish
+     * NOTE: must not be called from inside of read-side section
+     */
+    static void synchronize();
+
+    /**
+     * @brief Runs work item after grace period, without waiting for it (e.g. to free old version of data)
+     * @param item Work item to be run, it must not be queued anywhere else
+     */
+    static void call(WorkItem *item);
+
+    /**
+     * @brief Frees object allocated with new after grace period
+     * @param object Object to be freed
+     */
+    template<typename T>
+    static void free(T *object) {
+
+        // wrap object in work item deleting both of them
+        struct Deleter : WorkItem {
+            T *object;
+        };
+        Deleter *deleter = new Deleter;
+        deleter->object = object;
+        deleter->function = [](void *data) {
+            Deleter *self = reinterpret_cast<Deleter*>(data);
+            delete self->object;
+            delete self;
+        };
+        deleter->data = deleter;
+        call(deleter);
+
+    };
+
+    /**
+     * @brief Checks whether grace period of callbacks ended and starts new one if needed, never waits
+     * NOTE: called by softirq pump at the end of every interrupt
+     */
+    static void poll();
+
+    /**
+     * @brief Reads pointer published by writer, to be used inside of read-side section
+     * @param pointer Pointer to be read
+     * @return Value of the pointer
+     */
+    template<typename T>
+    static T dereference(T& pointer) { return __atomic_load_n(&pointer, __ATOMIC_ACQUIRE); };
+
+    /**
+     * @brief Publishes new value of pointer, everything written before is visible to readers which see the value
+     * @param pointer Pointer to be updated
+     * @param value New value
+     */
+    template<typename T>
+    static void assign(T& pointer, T value) { __atomic_store_n(&pointer, value, __ATOMIC_RELEASE); };
+
+private:
+
+    struct CoreState {
+        usz nesting;
+        usz generation;
+    };
+
+    struct Snapshot {
+        usz generation[CPU::maxCoreCount];
+        u64 quiescentCores;
+    };
+
+    static void takeSnapshot(Snapshot& snapshot);
+    static bool gracePeriodEnded(Snapshot& snapshot);
+
+    static inline PerCPU<CoreState> cores;
+    static inline MPSCQueue<WorkItem, &WorkItem::link> pendingCallbacks;
+    static inline WorkItem *waitingCallbacks = nullptr;
+    static inline Snapshot waitingSnapshot;
+    static inline bool polling = false;
+
+};
+
+/**
+ * @brief Class encapsulating read-side section of RCU limited to a scope
+ */
+class ScopedRCURead {
+
+public:
+    ScopedRCURead() { RCU::readLock(); };
+    ~ScopedRCURead() { RCU::readUnlock(); };
+
+};
@@ -0,0 +1,181 @@
+#pragma once
+#include <driver/arch/cpu.h>
+#include <util/types.h>
+
+/**
+ * @brief Lock-free ring channel with single producer and single consumer
+ * @note Ring does not use any pointers, so it may be placed in shared memory object (after calling initialize) and used from several address spaces
+ */
+template<typename T, usz Capacity>
+class SPSCRing {
+
+    static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "ring capacity has to be power of two");
+
+public:
+
+    SPSCRing() { initialize(); }
+
+    /**
+     * @brief Resets the ring to empty state (needed when ring is placed in memory without calling constructor)
+     */
+    void initialize() {
+        producer.position = 0;
+        producer.cachedPosition = 0;
+        consumer.position = 0;
+        consumer.cachedPosition = 0;
+    }
+
+    /**
+     * @brief Appends element to the ring (may be called only by producer)
+     * @param value Element to be appended
+     * @return true if element was appended, false if ring is full
+     */
+    bool push(const T& value) {
+
+        // consumer position is read only when cached one says the ring is full
+        usz tail = producer.position;
+        if(tail - producer.cachedPosition == Capacity) {
+            producer.cachedPosition = __atomic_load_n(&consumer.position, __ATOMIC_ACQUIRE);
+            if(tail - producer.cachedPosition == Capacity) return false;
+        }
+
+        // store element, then publish it
+        slots[tail & (Capacity - 1)] = value;
+        __atomic_store_n(&producer.position, tail + 1, __ATOMIC_RELEASE);
+        return true;
+
+    }
+
+    /**
+     * @brief Takes oldest element from the ring (may be called only by consumer)
+     * @param value Set to taken element
+     * @return true if element was taken, false if ring is empty
+     */
+    bool pop(T& value) {
+
+        // producer position is read only when cached one says the ring is empty
+        usz head = consumer.position;
+        if(head == consumer.cachedPosition) {
+            consumer.cachedPosition = __atomic_load_n(&producer.position, __ATOMIC_ACQUIRE);
+            if(head == consumer.cachedPosition) return false;
+        }
+
+        // read element, then free its slot
+        value = slots[head & (Capacity - 1)];
+        __atomic_store_n(&consumer.position, head + 1, __ATOMIC_RELEASE);
+        return true;
+
+    }
+
+    /**
+     * @brief Returns approximate count of elements in the ring
+     * @return Count of elements
+     */
+    usz size() { return __atomic_load_n(&producer.position, __ATOMIC_ACQUIRE) - __atomic_load_n(&consumer.position, __ATOMIC_ACQUIRE); }
+
+private:
+
+    // every side writes only its own cache line
+    struct alignas(CPU::cacheLineSize) Side {
+        usz position;
+        usz cachedPosition;
+    };
+
+    Side producer;
+    Side consumer;
+    alignas(CPU::cacheLineSize) T slots[Capacity];
+
+};
+
+/**
+ * @brief Lock-free bounded ring channel with multiple producers and multiple consumers
+ * @note Ring does not use any pointers, so it may be placed in shared memory object (after calling initialize) and used from several address spaces
+ */
+template<typename T, usz Capacity>
+class MPMCRing {
+
+    static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "ring capacity has to be power of two");
+
+public:
+
+    MPMCRing() { initialize(); }
+
+    /**
+     * @brief Resets the ring to empty state (needed when ring is placed in memory without calling constructor)
+     */
+    void initialize() {
+        for(usz i = 0; i < Capacity; i++) slots[i].sequence = i;
+        enqueuePosition.value = 0;
+        dequeuePosition.value = 0;
+    }
+
+    /**
+     * @brief Appends element to the ring
+     * @param value Element to be appended
+     * @return true if element was appended, false if ring is full
+     */
+    bool push(const T& value) {
+
+        // claim position whose slot was already freed by consumers (sequence equal to position)
+        usz position = __atomic_load_n(&enqueuePosition.value, __ATOMIC_RELAXED);
+        Slot *slot = nullptr;
+        for(;;) {
+            slot = &slots[position & (Capacity - 1)];
+            isz difference = static_cast<isz>(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE)) - static_cast<isz>(position);
+            if(difference == 0) {
+                if(__atomic_compare_exchange_n(&enqueuePosition.value, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+            }
+            else if(difference < 0) return false;
+            else position = __atomic_load_n(&enqueuePosition.value, __ATOMIC_RELAXED);
+        }
+
+        // store element and mark slot as full
+        slot->value = value;
+        __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+        return true;
+
+    }
+
+    /**
+     * @brief Takes oldest element from the ring
+     * @param value Set to taken element
+     * @return true if element was taken, false if ring is empty
+     */
+    bool pop(T& value) {
+
+        // claim position whose slot was already filled by producers (sequence one past position)
+        usz position = __atomic_load_n(&dequeuePosition.value, __ATOMIC_RELAXED);
+        Slot *slot = nullptr;
+        for(;;) {
+            slot = &slots[position & (Capacity - 1)];
+            isz difference = static_cast<isz>(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE)) - static_cast<isz>(position + 1);
+            if(difference == 0) {
+                if(__atomic_compare_exchange_n(&dequeuePosition.value, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+            }
+            else if(difference < 0) return false;
+            else position = __atomic_load_n(&dequeuePosition.value, __ATOMIC_RELAXED);
+        }
+
+        // read element and free the slot for next round of producers
+        value = slot->value;
+        __atomic_store_n(&slot->sequence, position + Capacity, __ATOMIC_RELEASE);
+        return true;
+
+    }
+
+private:
+
+    struct alignas(CPU::cacheLineSize) Slot {
+        usz sequence;
+        T value;
+    };
+
+    struct alignas(CPU::cacheLineSize) Position {
+        usz value;
+    };
+
+    Position enqueuePosition;
+    Position dequeuePosition;
+    Slot slots[Capacity];
+
+};
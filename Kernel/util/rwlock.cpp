@@ -0,0 +1,77 @@
+#include "util/rwlock.h"
+
+usz RWLock::getReaderSlot() {
+
+    // reader stays on its core between lock and unlock (interrupts are disabled by scoped guards)
+    return CPU::getCoreAPICID() % readerSlotCount;
+
+}
+
+void RWLock::readLock() {
+
+    ReaderSlot& slot = readers[getReaderSlot()];
+    for(;;) {
+
+        // announce ourselves and check for writer (full barrier pairs with the one in writeLock)
+        __atomic_add_fetch(&slot.count, 1, __ATOMIC_SEQ_CST);
+        if(!__atomic_load_n(&writerActive, __ATOMIC_SEQ_CST)) return;
+
+        // writer is active or waiting, step back so that it may proceed and wait for it to finish
+        __atomic_sub_fetch(&slot.count, 1, __ATOMIC_RELEASE);
+        while(__atomic_load_n(&writerActive, __ATOMIC_RELAXED)) CPU::pause();
+
+    }
+
+}
+
+void RWLock::readUnlock() {
+
+    // leave our slot, release orders reads of the section before writer may observe zero
+    __atomic_sub_fetch(&readers[getReaderSlot()].count, 1, __ATOMIC_RELEASE);
+
+}
+
+void RWLock::writeLock() {
+
+    // serialize writers and block new readers
+    writersLock.lock();
+    __atomic_store_n(&writerActive, true, __ATOMIC_SEQ_CST);
+
+    // wait until readers which got in before us leave
+    for(usz i = 0; i < readerSlotCount; i++) {
+        while(__atomic_load_n(&readers[i].count, __ATOMIC_ACQUIRE) != 0) CPU::pause();
+    }
+
+}
+
+void RWLock::writeUnlock() {
+
+    // let readers in and pass the lock to next writer
+    __atomic_store_n(&writerActive, false, __ATOMIC_RELEASE);
+    writersLock.unlock();
+
+}
+
+bool RWLock::isWriteLocked() {
+    return __atomic_load_n(&writerActive, __ATOMIC_ACQUIRE);
+}
+
+ScopedReadLock::ScopedReadLock(RWLock & lock) : rwLock(lock) {
+    wereInterruptsEnabled = CPU::enterCritical();
+    rwLock.readLock();
+}
+
+ScopedReadLock::~ScopedReadLock() {
+    rwLock.readUnlock();
+    CPU::exitCritical(wereInterruptsEnabled);
+}
+
+ScopedWriteLock::ScopedWriteLock(RWLock & lock) : rwLock(lock) {
+    wereInterruptsEnabled = CPU::enterCritical();
+    rwLock.writeLock();
+}
+
+ScopedWriteLock::~ScopedWriteLock() {
+    rwLock.writeUnlock();
+    CPU::exitCritical(wereInterruptsEnabled);
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <driver/arch/cpu.h>
+#include <util/spinlock.h>
+
+/**
+ * @brief Reader-writer spinlock with reader counts spread over per-core cache lines, so that concurrent readers do not
+ *        bounce a shared counter between cores (writers are expensive - they have to check every reader slot)
+ * NOTE: lock does not touch interrupt state, use ScopedReadLock and ScopedWriteLock, which disable interrupts, unless
+ *       the lock is never taken in interrupt or fault context
+ */
+class RWLock {
+
+public:
+    RWLock(const RWLock & ) = delete;
+    RWLock(RWLock && ) = delete;
+    RWLock() = default;
+    void readLock();
+    void readUnlock();
+    void writeLock();
+    void writeUnlock();
+    bool isWriteLocked();
+
+private:
+    // cores share reader slots modulo this count, which bounds size of the lock to 1 KiB
+    static constexpr usz readerSlotCount = 16;
+
+    // slot is padded rather than aligned, so that objects holding the lock do not need over-aligned allocation
+    struct ReaderSlot {
+        usz count;
+        u8 padding[CPU::cacheLineSize - sizeof(usz)];
+    };
+
+    static usz getReaderSlot();
+
+    ReaderSlot readers[readerSlotCount] = {};
+    RawSpinlock writersLock;
+    bool writerActive = false;
+
+};
+
+class ScopedReadLock {
+
+public:
+    ScopedReadLock() = delete;
+    ScopedReadLock(const ScopedReadLock & ) = delete;
+    ScopedReadLock(ScopedReadLock && ) = delete;
+
+    ScopedReadLock(RWLock& lock);
+    ~ScopedReadLock();
+
+private:
+    RWLock& rwLock;
+    bool wereInterruptsEnabled;
+
+};
+
+class ScopedWriteLock {
+
+public:
+    ScopedWriteLock() = delete;
+    ScopedWriteLock(const ScopedWriteLock & ) = delete;
+    ScopedWriteLock(ScopedWriteLock && ) = delete;
+
+    ScopedWriteLock(RWLock& lock);
+    ~ScopedWriteLock();
+
+private:
+    RWLock& rwLock;
+    bool wereInterruptsEnabled;
+
+};
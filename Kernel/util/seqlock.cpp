@@ -0,0 +1,35 @@
+#include "util/seqlock.h"
+
+u64 SeqLock::readBegin() {
+
+    // odd sequence means that writer is in the middle of update
+    u64 current;
+    while((current = __atomic_load_n(&sequence, __ATOMIC_ACQUIRE)) & 1) CPU::pause();
+    return current;
+
+}
+
+bool SeqLock::readRetry(u64 startSequence) {
+
+    // order reads of the section before reading the sequence again
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&sequence, __ATOMIC_RELAXED) != startSequence;
+
+}
+
+void SeqLock::writeLock() {
+
+    // serialize writers and make sequence odd before any data is written
+    writersLock.lock();
+    __atomic_store_n(&sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+}
+
+void SeqLock::writeUnlock() {
+
+    // make sequence even again after all data is written
+    __atomic_store_n(&sequence, sequence + 1, __ATOMIC_RELEASE);
+    writersLock.unlock();
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <util/spinlock.h>
+
+/**
+ * @brief Sequence lock - writers bump sequence number around each update, readers never write shared memory and just
+ *        retry if the sequence changed under them, which suits small, very frequently read values (e.g. clock state)
+ * NOTE: writers disable interrupts, readers may run anywhere (even in interrupt handler interrupting a writer on
+ *       other core), but they must not follow pointers read inside the section before validating it
+ */
+class SeqLock {
+
+public:
+    SeqLock(const SeqLock & ) = delete;
+    SeqLock(SeqLock && ) = delete;
+    SeqLock() = default;
+
+    /**
+     * @brief Starts read section, waiting for writer in progress to finish
+     * @return Sequence number to be passed to readRetry
+     */
+    u64 readBegin();
+
+    /**
+     * @brief Ends read section
+     * @param startSequence Sequence number returned by readBegin
+     * @return true if data was modified during the section and has to be read again, false otherwise
+     */
+    bool readRetry(u64 startSequence);
+
+    void writeLock();
+    void writeUnlock();
+
+private:
+    u64 sequence = 0;
+    Spinlock writersLock;
+
+};
+
+/**
+ * Value of trivially copyable type protected by sequence lock, reads return consistent snapshot of the whole value
+ */
+template<typename T>
+class SeqLocked {
+
+public:
+
+    constexpr SeqLocked() {};
+
+    SeqLocked(const SeqLocked &) = delete;
+    SeqLocked& operator=(const SeqLocked &) = delete;
+
+    T read() {
+
+        // copy the value until it is copied without concurrent write
+        T snapshot;
+        u64 sequence;
+        do {
+            sequence = lock.readBegin();
+            copy(&snapshot, &value);
+        } while(lock.readRetry(sequence));
+        return snapshot;
+
+    };
+
+    void write(const T& newValue) {
+
+        // copy new value inside write section
+        lock.writeLock();
+        copy(&value, &newValue);
+        lock.writeUnlock();
+
+    };
+
+private:
+
+    static_assert(sizeof(T) % sizeof(u64) == 0, "value protected by sequence lock has to consist of whole quadwords");
+
+    // copies quadword by quadword with atomic accesses, so that racing copy is not undefined behaviour, only discarded
+    static void copy(T *destination, const T *source) {
+        u64 *to = reinterpret_cast<u64*>(destination);
+        const u64 *from = reinterpret_cast<const u64*>(source);
+        for(usz i = 0; i < sizeof(T) / sizeof(u64); i++) __atomic_store_n(&to[i], __atomic_load_n(&from[i], __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    };
+
+    SeqLock lock;
+    T value = T();
+
+};
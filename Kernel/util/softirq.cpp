@@ -0,0 +1,67 @@
+#include "util/softirq.h"
+#include "util/rcu.h"
+
+bool SoftIRQ::schedule(WorkItem *item) {
+
+    // item which is still pending will run anyway
+    if(__atomic_exchange_n(&item->queued, true, __ATOMIC_ACQ_REL)) return false;
+
+    // stay on this core while pushing to its queue
+    bool interruptState = CPU::enterCritical();
+    cores.get().queue.push(item);
+    CPU::exitCritical(interruptState);
+    return true;
+
+}
+
+void SoftIRQ::run() {
+
+    // only outermost pump of the core runs the work
+    bool interruptState = CPU::enterCritical();
+    CoreState& state = cores.get();
+    if(state.running) {
+        CPU::exitCritical(interruptState);
+        return;
+    }
+    state.running = true;
+
+    // drain the queue with interrupts enabled, emptiness is checked again with them disabled, so that items queued
+    // by interrupt which came right after last drain are not left behind
+    while(!state.queue.isEmpty()) {
+
+        CPU::setInterruptState(true);
+        for(WorkItem *item = state.queue.takeAll(); item != nullptr; item = state.queue.takeAll()) {
+            while(item != nullptr) {
+
+                // read link before running, as the item may be queued again or freed by its function
+                WorkItem *next = MPSCQueue<WorkItem, &WorkItem::link>::getNext(item);
+                __atomic_store_n(&item->queued, false, __ATOMIC_RELEASE);
+                item->function(item->data);
+                processedCount.add();
+                item = next;
+
+            }
+        }
+        CPU::setInterruptState(false);
+
+    }
+
+    // interrupts are natural points at which grace periods of RCU callbacks are checked
+    RCU::poll();
+
+    state.running = false;
+    CPU::exitCritical(interruptState);
+
+}
+
+bool SoftIRQ::isRunning() {
+
+    // flag of the core is written only by the core itself
+    bool interruptState = CPU::enterCritical();
+    bool running = cores.get().running;
+    CPU::exitCritical(interruptState);
+    return running;
+
+}
+
+usz SoftIRQ::getProcessedCount() { return processedCount.sum(); }
@@ -0,0 +1,59 @@
+#pragma once
+#include <driver/arch/cpu.h>
+#include <util/mpsc.h>
+#include <util/percpu.h>
+#include <util/types.h>
+
+/**
+ * @brief Deferred piece of work, run by softirq pump of the core on which it was scheduled
+ */
+struct WorkItem {
+    EventHandler function = nullptr;
+    void *data = nullptr;
+    bool queued = false;
+    MPSCLink<WorkItem> link;
+};
+
+/**
+ * @brief Class running work deferred by interrupt handlers (bottom halves) with interrupts enabled, after EOI was sent
+ */
+class SoftIRQ {
+
+public:
+
+    /**
+     * @brief Queues work item on currently executing core, it is run when the core finishes servicing current interrupt
+     * @param item Work item to be run, it may be scheduled again (or freed) by its own function
+     * @return true if item was queued, false if it was still pending
+     */
+    static bool schedule(WorkItem *item);
+
+    /**
+     * @brief Runs all work items queued on currently executing core, interrupts are enabled while they run
+     * NOTE: called by interrupt handler after EOI, nested calls (from interrupts which came meanwhile) return immediately
+     */
+    static void run();
+
+    /**
+     * @brief Checks whether currently executing core is running deferred work (interrupt came in the middle of it)
+     * @return true if softirq pump of the core is running, false otherwise
+     */
+    static bool isRunning();
+
+    /**
+     * @brief Returns count of work items run so far on all cores
+     * @return Count of run work items
+     */
+    static usz getProcessedCount();
+
+private:
+
+    struct CoreState {
+        MPSCQueue<WorkItem, &WorkItem::link> queue;
+        bool running;
+    };
+
+    static inline PerCPU<CoreState> cores;
+    static inline PerCPUCounter processedCount;
+
+};
@@ -1,20 +1,86 @@
 #include "util/spinlock.h"
 
+void RawSpinlock::lock() {
+
+    // take a ticket and wait for our turn
+    u32 ticket = __atomic_fetch_add(&nextTicket, 1, __ATOMIC_RELAXED);
+    for(;;) {
+
+        // check whether it is our turn
+        u32 owner = __atomic_load_n(&ownerTicket, __ATOMIC_ACQUIRE);
+        if(owner == ticket) return;
+
+        // back off proportionally to count of waiters ahead of us
+        for(u32 i = (ticket - owner) * backoffPauses; i > 0; i--) CPU::pause();
+
+    }
+
+}
+
+bool RawSpinlock::tryLock() {
+
+    // take a ticket only if it would be served right away
+    u32 owner = __atomic_load_n(&ownerTicket, __ATOMIC_ACQUIRE);
+    u32 expected = owner;
+    return __atomic_compare_exchange_n(&nextTicket, &expected, owner + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+
+}
+
+bool RawSpinlock::isLocked() {
+
+    // lock is held if any ticket was not served yet
+    return __atomic_load_n(&nextTicket, __ATOMIC_ACQUIRE) != __atomic_load_n(&ownerTicket, __ATOMIC_ACQUIRE);
+
+}
+
+void RawSpinlock::unlock() {
+
+    // check if locked
+    if(!isLocked()) return;
+
+    // serve next ticket (only owner writes it)
+    __atomic_store_n(&ownerTicket, ownerTicket + 1, __ATOMIC_RELEASE);
+
+}
+
 void Spinlock::lock() {
     
     // enter critical section
-    wereInterruptsEnabled = CPU::enterCritical();
+    bool interruptState = CPU::enterCritical();
+
+    // wait for our turn, interrupt state is saved only by the owner
+#ifdef KERNEL_LOCKSTAT
+    u64 startTimestamp = CPU::readTimestampCounter();
+    bool contended = !rawLock.tryLock();
+    if(contended) rawLock.lock();
+    statistics.acquired(startTimestamp, contended);
+#else
+    rawLock.lock();
+#endif
+    wereInterruptsEnabled = interruptState;
+
+}
+
+bool Spinlock::tryLock() {
 
-    // try to lock indefinately
-    bool expected = false;
-    while(!__atomic_compare_exchange_n(&locked, &expected, true, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) { expected = false; }
+    // enter critical section and leave it if lock is taken
+    bool interruptState = CPU::enterCritical();
+    if(!rawLock.tryLock()) {
+        CPU::exitCritical(interruptState);
+        return false;
+    }
+#ifdef KERNEL_LOCKSTAT
+    statistics.acquired(0, false);
+#endif
+    wereInterruptsEnabled = interruptState;
+    return true;
 
 }
 
 bool Spinlock::isLocked() {
 
     // return atomically the value of spinlock
-    return __atomic_load_n(&locked, __ATOMIC_ACQUIRE);
+    return rawLock.isLocked();
 
 }
 
@@ -23,11 +89,65 @@ void Spinlock::unlock() {
     // check if locked
     if(!isLocked()) return;
 
-    // store "false" value in spinlock
-    __atomic_store_n(&locked, false, __ATOMIC_RELEASE);
+    // release the lock
+    bool interruptState = wereInterruptsEnabled;
+#ifdef KERNEL_LOCKSTAT
+    statistics.released();
+#endif
+    rawLock.unlock();
 
     // exit critical section
-    CPU::exitCritical(wereInterruptsEnabled);
+    CPU::exitCritical(interruptState);
+
+}
+
+void MCSLock::lock(Node& node) {
+
+    // append own node to the queue
+#ifdef KERNEL_LOCKSTAT
+    u64 startTimestamp = CPU::readTimestampCounter();
+#endif
+    node.next = nullptr;
+    node.locked = true;
+    Node *previous = __atomic_exchange_n(&tail, &node, __ATOMIC_ACQ_REL);
+    if(previous != nullptr) {
+
+        // link behind previous waiter and spin on own node until it hands the lock over
+        __atomic_store_n(&previous->next, &node, __ATOMIC_RELEASE);
+        while(__atomic_load_n(&node.locked, __ATOMIC_ACQUIRE)) CPU::pause();
+
+    }
+#ifdef KERNEL_LOCKSTAT
+    statistics.acquired(startTimestamp, previous != nullptr);
+#endif
+
+}
+
+bool MCSLock::isLocked() {
+
+    // lock is held if anyone is queued
+    return __atomic_load_n(&tail, __ATOMIC_ACQUIRE) != nullptr;
+
+}
+
+void MCSLock::unlock(Node& node) {
+
+#ifdef KERNEL_LOCKSTAT
+    statistics.released();
+#endif
+
+    // if nobody is linked behind us, try to empty the queue
+    Node *next = __atomic_load_n(&node.next, __ATOMIC_ACQUIRE);
+    if(next == nullptr) {
+        Node *expected = &node;
+        if(__atomic_compare_exchange_n(&tail, &expected, nullptr, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) return;
+
+        // someone is just appending itself, wait until it links
+        while((next = __atomic_load_n(&node.next, __ATOMIC_ACQUIRE)) == nullptr) CPU::pause();
+    }
+
+    // hand the lock over
+    __atomic_store_n(&next->locked, false, __ATOMIC_RELEASE);
 
 }
 
@@ -39,3 +159,20 @@ ScopedSpinlock::~ScopedSpinlock() {
     spinlock.unlock();
 }
 
+ScopedRawSpinlock::ScopedRawSpinlock(RawSpinlock & lock) : spinlock(lock) {
+    spinlock.lock();
+}
+
+ScopedRawSpinlock::~ScopedRawSpinlock() {
+    spinlock.unlock();
+}
+
+ScopedMCSLock::ScopedMCSLock(MCSLock & lock, bool irqSave) : mcsLock(lock), irqSave(irqSave) {
+    if(irqSave) wereInterruptsEnabled = CPU::enterCritical();
+    mcsLock.lock(node);
+}
+
+ScopedMCSLock::~ScopedMCSLock() {
+    mcsLock.unlock(node);
+    if(irqSave) CPU::exitCritical(wereInterruptsEnabled);
+}
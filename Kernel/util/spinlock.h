@@ -1,25 +1,108 @@
 #pragma once
 #include <driver/arch/cpu.h>
+#include <util/lockstat.h>
 
 /**
- * @brief Simple spinlock implementation
+ * @brief Fair ticket spinlock which does not touch interrupt state, usable only for locks never taken in interrupt context
+ */
+class RawSpinlock {
+
+public:
+    RawSpinlock(const RawSpinlock & ) = delete;
+    RawSpinlock(RawSpinlock && ) = delete;
+    RawSpinlock() = default;
+    void lock();
+    bool tryLock();
+    bool isLocked();
+    void unlock();
+
+private:
+    // pauses per waiter ahead of us between reads of the lock, so that waiters do not hammer the cache line
+    static constexpr u32 backoffPauses = 32;
+
+    u32 nextTicket = 0;
+    u32 ownerTicket = 0;
+
+};
+
+/**
+ * @brief Simple spinlock implementation (fair ticket lock which disables interrupts while held, so it may be taken in interrupt context)
  */
 class Spinlock {
 
 public:
     Spinlock(const Spinlock & ) = delete;
     Spinlock(Spinlock && ) = delete;
-    Spinlock() = default;
+
+    /**
+     * @brief Constructor
+     * @param name Name under which lock statistics are reported (file of declaration by default), ignored without LOCKSTAT=1
+     * @param line Line reported along with the name
+     */
+#ifdef KERNEL_LOCKSTAT
+    constexpr Spinlock(const char *name = __builtin_FILE(), u32 line = __builtin_LINE()) : statistics(name, line) {};
+#else
+    constexpr Spinlock(const char * = nullptr, u32 = 0) {};
+#endif
+
     void lock();
+    bool tryLock();
     bool isLocked();
     void unlock();
 
 private:
-    bool locked=  false;
+    RawSpinlock rawLock;
 
     bool wereInterruptsEnabled=  false;
 
+#ifdef KERNEL_LOCKSTAT
+    LockStatistics::Probe statistics;
+#endif
+
+};
+
+/**
+ * @brief Queued (MCS) lock - every waiter spins on its own node, so handover touches only cache lines of two cores
+ */
+class MCSLock {
+
+public:
+
+    /**
+     * @brief Queue node of single waiter, it has to live until the lock is released (usually on stack of the waiter)
+     */
+    struct Node {
+        Node *next;
+        bool locked;
+    };
+
+    MCSLock(const MCSLock & ) = delete;
+    MCSLock(MCSLock && ) = delete;
+
+    /**
+     * @brief Constructor
+     * @param name Name under which lock statistics are reported (file of declaration by default), ignored without LOCKSTAT=1
+     * @param line Line reported along with the name
+     */
+#ifdef KERNEL_LOCKSTAT
+    constexpr MCSLock(const char *name = __builtin_FILE(), u32 line = __builtin_LINE()) : statistics(name, line) {};
+#else
+    constexpr MCSLock(const char * = nullptr, u32 = 0) {};
+#endif
+
+    void lock(Node& node);
+    bool isLocked();
+    void unlock(Node& node);
+
+private:
+    Node *tail = nullptr;
+
+#ifdef KERNEL_LOCKSTAT
+    LockStatistics::Probe statistics;
+#endif
+
 };
+
 class ScopedSpinlock {
 
 public:
@@ -34,3 +117,41 @@ private:
     Spinlock& spinlock;
 
 };
+
+class ScopedRawSpinlock {
+
+public:
+    ScopedRawSpinlock() = delete;
+    ScopedRawSpinlock(const ScopedRawSpinlock & ) = delete;
+    ScopedRawSpinlock(ScopedRawSpinlock && ) = delete;
+
+    ScopedRawSpinlock(RawSpinlock& lock);
+    ~ScopedRawSpinlock();
+
+private:
+    RawSpinlock& spinlock;
+
+};
+
+class ScopedMCSLock {
+
+public:
+    ScopedMCSLock() = delete;
+    ScopedMCSLock(const ScopedMCSLock & ) = delete;
+    ScopedMCSLock(ScopedMCSLock && ) = delete;
+
+    /**
+     * @brief Constructor - acquires the lock
+     * @param lock Lock to be acquired
+     * @param irqSave Whether to disable interrupts while the lock is held (needed if it is taken in interrupt context)
+     */
+    ScopedMCSLock(MCSLock& lock, bool irqSave = true);
+    ~ScopedMCSLock();
+
+private:
+    MCSLock& mcsLock;
+    MCSLock::Node node;
+    bool irqSave;
+    bool wereInterruptsEnabled = false;
+
+};
@@ -1,4 +1,5 @@
 #include "util/timer.h"
+#include "sched/idle.h"
 
 
 Timer::Timer() : fired(false), running(false) {}
@@ -8,19 +9,27 @@ void Timer::wait(usz milliseconds) {
     // don't do anything if timer is already running
     if(running) return;
 
-    // set fields accordingly
+    // set fields accordingly, handler wakes waiting thread (or core, if scheduling does not run there yet)
     fired = false;
     running = true;
+    blocking = true;
+    waitingThread = Scheduler::getCurrentThread();
+    waitingCore = CPU::getCoreAPICID();
 
     // set timer in HPET
     eventID = HPET::createTimedEvent(milliseconds, &Timer::eventHandler, reinterpret_cast<void*>(this));
 
-    // wait until interrupt fired
-    while(!fired);
+    // wait until interrupt fired, thread lets other threads run meanwhile, core sleeps otherwise
+    if(waitingThread != nullptr) {
+        do Scheduler::block();
+        while(!__atomic_load_n(&fired, __ATOMIC_ACQUIRE));
+    }
+    else while(!__atomic_load_n(&fired, __ATOMIC_ACQUIRE)) Idle::wait();
 
     // set fields
     fired = false;
     running = false;
+    blocking = false;
 
 }
 
@@ -32,6 +41,7 @@ void Timer::nonBlockingWait(usz milliseconds) {
     // set fields accordingly
     fired = false;
     running = true;
+    blocking = false;
 
     // set timer in HPET
     eventID = HPET::createTimedEvent(milliseconds, &Timer::eventHandler, reinterpret_cast<void*>(this));
@@ -56,7 +66,15 @@ void Timer::eventHandler(void *timer) {
 
     // make fired if running
     if(!castedTimer->running) return;
-    castedTimer->fired = true;
+    bool blocking = castedTimer->blocking;
+    Thread *waitingThread = castedTimer->waitingThread;
+    u8 waitingCore = castedTimer->waitingCore;
     castedTimer->running = false;
+    __atomic_store_n(&castedTimer->fired, true, __ATOMIC_RELEASE);
+
+    // wake the waiter up (timer may be gone once it sees fired, so only copied fields are used)
+    if(!blocking) return;
+    if(waitingThread != nullptr) Scheduler::wakeUp(waitingThread);
+    else Idle::wake(waitingCore);
 
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include <util/types.h>
 #include <driver/arch/hpet.h>
+#include <sched/scheduler.h>
 
 /**
  * @brief Simple timer implementation - using HPET
@@ -18,6 +19,9 @@ private:
     static void eventHandler(void *timer);
     bool fired = false;
     bool running = false;
+    bool blocking = false;
+    Thread *waitingThread = nullptr;
+    u8 waitingCore = 0;
     usz eventID = 0;
 
 };
\ No newline at end of file
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <util/types.h>
+#include <util/logger.h>
+
+// placement new, as there is no standard library to provide it
+inline void *operator new(long unsigned int, void *address) noexcept { return address; }
+
+/**
+ * Class encapsulating generic growable array with elements stored contiguously
+ */
+template<typename T>
+class Vector {
+
+public:
+
+    Vector() {};
+
+    /**
+     * @brief Constructor
+     * @param initialCapacity Count of elements for which storage is allocated upfront
+     */
+    Vector(usz initialCapacity) { reserve(initialCapacity); };
+
+    Vector(const Vector &) = delete;
+    Vector& operator=(const Vector &) = delete;
+
+    Vector(Vector &&other) : elements(other.elements), count(other.count), capacity(other.capacity) {
+
+        // take over storage of the other vector
+        other.elements = nullptr;
+        other.count = 0;
+        other.capacity = 0;
+
+    };
+
+    Vector& operator=(Vector &&other) {
+
+        // release own storage and take over storage of the other vector
+        if(this == &other) return *this;
+        clear();
+        ::operator delete(elements);
+        elements = other.elements;
+        count = other.count;
+        capacity = other.capacity;
+        other.elements = nullptr;
+        other.count = 0;
+        other.capacity = 0;
+        return *this;
+
+    };
+
+    ~Vector() {
+
+        // destroy all elements and free storage
+        clear();
+        ::operator delete(elements);
+
+    };
+
+    /**
+     * @brief Makes sure that storage for given count of elements is allocated
+     * @param newCapacity Requested count of elements
+     */
+    void reserve(usz newCapacity) {
+
+        // check if storage is large enough already
+        if(newCapacity <= capacity) return;
+
+        // allocate new storage and move elements to it
+        T *newElements = static_cast<T*>(::operator new(newCapacity * sizeof(T)));
+        for(usz i = 0; i < count; i++) {
+            new (&newElements[i]) T(static_cast<T&&>(elements[i]));
+            elements[i].~T();
+        }
+
+        // free old storage
+        ::operator delete(elements);
+        elements = newElements;
+        capacity = newCapacity;
+
+    };
+
+    void appendBack(const T& newElement) {
+
+        // element may live inside the storage, so copy it before growing
+        T copy(newElement);
+        appendBack(static_cast<T&&>(copy));
+
+    };
+
+    void appendBack(T&& newElement) {
+
+        // grow if needed and construct element in place
+        if(count == capacity) grow();
+        new (&elements[count]) T(static_cast<T&&>(newElement));
+        count++;
+
+    };
+
+    void appendFront(const T& newElement) { insertAt(newElement, 0); };
+
+    void appendFront(T&& newElement) { insertAt(static_cast<T&&>(newElement), 0); };
+
+    void insertAt(const T& newElement, usz index) {
+
+        // element may live inside the storage, so copy it before shifting
+        T copy(newElement);
+        insertAt(static_cast<T&&>(copy), index);
+
+    };
+
+    void insertAt(T&& newElement, usz index) {
+
+        // if insertion would take place outside the vector, just append back
+        if(index >= count) {
+            appendBack(static_cast<T&&>(newElement));
+            return;
+        }
+
+        // grow if needed and shift elements after index by one place
+        if(count == capacity) grow();
+        new (&elements[count]) T(static_cast<T&&>(elements[count - 1]));
+        for(usz i = count - 1; i > index; i--) elements[i] = static_cast<T&&>(elements[i - 1]);
+        elements[index] = static_cast<T&&>(newElement);
+        count++;
+
+    };
+
+    void remove(usz index) {
+
+        // check bounds
+        checkIndex(index);
+
+        // shift elements after index by one place and destroy the last one
+        for(usz i = index; i + 1 < count; i++) elements[i] = static_cast<T&&>(elements[i + 1]);
+        elements[count - 1].~T();
+        count--;
+
+    };
+
+    /**
+     * @brief Removes element by moving last one in its place, which does not preserve order
+     * @param index Index of element to be removed
+     */
+    void removeUnordered(usz index) {
+
+        // check bounds
+        checkIndex(index);
+
+        // move last element in place of removed one
+        if(index != count - 1) elements[index] = static_cast<T&&>(elements[count - 1]);
+        elements[count - 1].~T();
+        count--;
+
+    };
+
+    void removeBack() { remove(count - 1); };
+
+    void clear() {
+
+        // destroy all elements, storage is kept for reuse
+        for(usz i = 0; i < count; i++) elements[i].~T();
+        count = 0;
+
+    };
+
+    usz size() const {
+        return count;
+    };
+
+    usz getCapacity() const {
+        return capacity;
+    };
+
+    bool isEmpty() const {
+        return count == 0;
+    };
+
+    T& get(usz index) {
+        checkIndex(index);
+        return elements[index];
+    };
+
+    const T& get(usz index) const {
+        checkIndex(index);
+        return elements[index];
+    };
+
+    T& getBack() {
+        return get(count - 1);
+    };
+
+    T *getData() {
+        return elements;
+    };
+
+    template<typename F>
+    void forEach(F function) {
+
+        // elements are contiguous, so this is just a linear walk
+        for(usz i = 0; i < count; i++) function(elements[i]);
+
+    };
+
+    const T& operator[](usz index) const {
+        return get(index);
+    };
+
+    T& operator [](usz index) {
+        return get(index);
+    };
+
+    T *begin() { return elements; };
+    T *end() { return elements + count; };
+    const T *begin() const { return elements; };
+    const T *end() const { return elements + count; };
+
+private:
+
+    static constexpr usz initialCapacity = 4;
+
+    T *elements = nullptr;
+    usz count = 0;
+    usz capacity = 0;
+
+    void grow() {
+
+        // double the capacity, so appending is amortized constant time
+        reserve((capacity == 0) ? initialCapacity : capacity * 2);
+
+    };
+
+    void checkIndex(usz index) const {
+
+        // check bounds
+        if(index >= count) {
+            Logger::printFormat("[vector] index out of range, aborting...\n");
+            for(;;);
+            // TODO: panic!
+        }
+
+    };
+
+};